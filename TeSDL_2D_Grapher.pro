@@ -3,12 +3,49 @@ CONFIG += c++1z
 CONFIG -= app_bundle
 CONFIG -= qt
 
-LIBS += -lSDL2  -lSDL2_ttf -lSDL2_gfx
+LIBS += -lSDL2  -lSDL2_ttf -lSDL2_gfx -lz -lpthread
 
 SOURCES += main.cpp \
     parser.cpp \
-    grapher.cpp
+    grapher.cpp \
+    glyphatlas.cpp \
+    softrenderer.cpp \
+    compiler.cpp \
+    batchrenderer.cpp \
+    mappedfile.cpp \
+    dataseries.cpp \
+    streamseries.cpp \
+    samplecache.cpp \
+    filewatcher.cpp \
+    profiler.cpp \
+    allocationcounter.cpp \
+    inputreplay.cpp \
+    curvebounds.cpp \
+    featurefinder.cpp \
+    samplepool.cpp \
+    equationbundle.cpp \
+    segmentindex.cpp \
+    heatmap.cpp
 
 HEADERS += \
     parser.h \
-    grapher.h
+    grapher.h \
+    glyphatlas.h \
+    softrenderer.h \
+    compiler.h \
+    batchrenderer.h \
+    stopwatch.h \
+    mappedfile.h \
+    dataseries.h \
+    spscring.h \
+    streamseries.h \
+    samplecache.h \
+    filewatcher.h \
+    profiler.h \
+    inputreplay.h \
+    curvebounds.h \
+    featurefinder.h \
+    samplepool.h \
+    equationbundle.h \
+    segmentindex.h \
+    heatmap.h
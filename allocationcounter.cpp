@@ -0,0 +1,25 @@
+#include "profiler.h"
+#include <cstdlib>
+#include <new>
+
+//Every allocation of the program goes through here to be counted. Kept in
+//a translation unit of its own, so the replaced operators are not inlined
+//into the callers of one and mismatched with the library version of the
+//other.
+void *operator new(std::size_t size)
+{
+    Profiler::count(Profiler::ALLOCATIONS);
+    if(void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
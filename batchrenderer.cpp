@@ -0,0 +1,101 @@
+#include "batchrenderer.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+BatchRenderer::BatchRenderer(int threads):
+    m_sdl_initializer(0),
+    m_threads(threads),
+    m_programCache(std::make_shared<iat::ProgramCache>()),
+    m_samplePool(std::make_shared<SamplePool>())
+{
+    if(m_threads <= 0)
+        m_threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<BatchJob> BatchRenderer::readJobs(std::istream &in)
+{
+    std::vector<BatchJob> jobs;
+    std::string line;
+    int lineNumber = 0;
+    while(std::getline(in, line))
+    {
+        ++lineNumber;
+        std::stringstream ss;
+        ss << line;
+        BatchJob job;
+        if(!(ss >> job.pathToSettings) || job.pathToSettings[0] == '#')
+            continue;
+        if(!(ss >> job.pathToEquations >> job.pathToImage >> job.width >> job.height))
+            throw std::runtime_error("Invalid batch job at line " + std::to_string(lineNumber));
+        if(job.pathToEquations == "-")
+            job.pathToEquations.clear();
+        job.hasViewport = bool(ss >> job.Xmin >> job.Xmax >> job.Ymin >> job.Ymax);
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+int BatchRenderer::run(const std::vector<BatchJob> &jobs, std::ostream &report)
+{
+    Stopwatch total;
+    const int workers = std::max<int>(1, std::min<size_t>(m_threads, jobs.size()));
+    //With fewer jobs than cores the spare cores rasterize tiles instead
+    const int rasterThreads = std::max(1, m_threads / workers);
+    std::atomic<size_t> nextJob{0};
+    std::atomic<int> failed{0};
+    std::mutex reportMutex;
+    auto worker = [&]()
+    {
+        for(size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+        {
+            std::ostringstream line;
+            line << "job " << i + 1 << " ";
+            try
+            {
+                StageTimings timings;
+                Stopwatch job;
+                runJob(jobs[i], rasterThreads, timings);
+                line << "ok " << jobs[i].pathToImage;
+                for(const auto &t: timings)
+                    line << " " << t.first << "=" << t.second << "ms";
+                line << " total=" << job.elapsed() << "ms";
+            }
+            catch(std::exception &ex)
+            {
+                ++failed;
+                line << "failed " << jobs[i].pathToImage << ": " << ex.what();
+            }
+            std::lock_guard<std::mutex> lock(reportMutex);
+            report << line.str() << std::endl;
+        }
+    };
+    std::vector<std::thread> pool;
+    for(int i = 1; i < workers; ++i)
+        pool.emplace_back(worker);
+    worker();
+    for(auto &t: pool)
+        t.join();
+    report << "done: " << jobs.size() << " jobs, " << failed << " failed, "
+           << m_programCache->size() << " compiled expressions, "
+           << total.elapsed() << "ms" << std::endl;
+    return failed;
+}
+
+void BatchRenderer::runJob(const BatchJob &job, int rasterThreads, StageTimings &timings)
+{
+    //The job's equations are loaded instead of the settings' ones, not after
+    Grapher g(job.pathToSettings, true, m_programCache, m_samplePool, job.pathToEquations);
+    timings = g.stageTimings();
+    Stopwatch stage;
+    if(job.hasViewport)
+        g.setViewport(job.Xmin, job.Xmax, job.Ymin, job.Ymax);
+    timings.emplace_back("setup", stage.lap());
+    const size_t constructionStages = g.stageTimings().size();
+    g.exportImage(job.pathToImage, job.width, job.height, rasterThreads);
+    timings.insert(timings.end(), g.stageTimings().begin() + constructionStages,
+                   g.stageTimings().end());
+}
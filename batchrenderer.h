@@ -0,0 +1,44 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include "grapher.h"
+#include "compiler.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BatchJob
+{
+    std::string pathToSettings;
+    //Empty means the equations file named in the settings
+    std::string pathToEquations;
+    std::string pathToImage;
+    int width, height;
+    bool hasViewport;
+    double Xmin, Xmax, Ymin, Ymax;
+};
+
+//Renders many plots offscreen on a pool of worker threads. All jobs share
+//one pool of compiled expressions and one of samples, so equations repeated
+//across jobs are compiled only once and overlapping ranges sampled once.
+class BatchRenderer
+{
+public:
+    explicit BatchRenderer(int threads = 0);
+    //One job per line:
+    //<settings> <equations|-> <image.png|image.ppm> <width> <height> [Xmin Xmax Ymin Ymax]
+    //Empty lines and lines starting with '#' are skipped
+    static std::vector<BatchJob> readJobs(std::istream &in);
+    //Reports every job with its stage timings; returns the number of failed jobs
+    int run(const std::vector<BatchJob> &jobs, std::ostream &report);
+private:
+    SDLInitObject m_sdl_initializer;
+    int m_threads;
+    std::shared_ptr<iat::ProgramCache> m_programCache;
+    std::shared_ptr<SamplePool> m_samplePool;
+    void runJob(const BatchJob &job, int rasterThreads, StageTimings &timings);
+};
+
+#endif // BATCHRENDERER_H
@@ -0,0 +1,19 @@
+TEMPLATE = app
+CONFIG += c++1z console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TARGET = exprbench
+INCLUDEPATH += ..
+
+SOURCES += exprbench.cpp \
+    ../parser.cpp \
+    ../compiler.cpp \
+    ../profiler.cpp \
+    ../allocationcounter.cpp
+
+HEADERS += \
+    ../parser.h \
+    ../compiler.h \
+    ../profiler.h \
+    ../stopwatch.h
@@ -0,0 +1,184 @@
+#include "parser.h"
+#include "compiler.h"
+#include "profiler.h"
+#include "stopwatch.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <functional>
+
+//Usage:
+//  exprbench [--csv] [--min-time ms] [--filter name]
+//Measures the expression engine stage by stage for every corpus entry:
+//  tokenize   Compiler::tokenize of the text
+//  parse      Compiler::parse of the tokens
+//  compile    Compiler::compile of the syntax tree
+//  evaluate   Program::evaluate for one X
+//  batch      Program::evaluate over a block of X values, per X
+//  parser     Parser::calculateExpression for one X, as the grapher
+//             sampled curves before the compiled engine
+//One JSON object per line (or CSV with --csv), so results of two versions
+//can be compared by a script.
+
+namespace
+{
+    struct Case
+    {
+        const char *name;
+        const char *expression;
+    };
+
+    const Case CORPUS[] =
+    {
+        {"polynomial", "3*X**4-2*X**3+X**2-7*X+1"},
+        {"trig", "sin(X)*cos(2*X)+tg(X/3)-sqr(sin(X))+arctg(X)"},
+        {"hyperbolic", "th(sh(ch(X/4)/3))+sech(arcsh(X))-cth(ch(X)+1)"},
+        {"logical", "(X>0)&(X<5)|(X==2)+(X!=1)*(X<=-3)"},
+        {"parentheses", "((((((X+1)*2)-3)/4)+((X-1)*(X+2)))*((((X))+(((P)))))/((E)+1))"}
+    };
+
+    enum
+    {
+        SWEEP = 1000,
+        //Points per block, as SamplePool evaluates them
+        BATCH = 128,
+        DEFAULT_MIN_TIME = 200
+    };
+
+    struct Result
+    {
+        double nsPerOp;
+        double opsPerSec;
+        double allocsPerOp;
+        unsigned long long ops;
+    };
+
+    //Runs body(n) with growing n until it takes at least minTime ms;
+    //body returns the number of operations it did
+    Result measure(double minTime, const std::function<unsigned long long(unsigned long long)> &body)
+    {
+        body(1);
+        for(unsigned long long n = 1;; n *= 2)
+        {
+            const uint64_t allocs = Profiler::total(Profiler::ALLOCATIONS);
+            Stopwatch watch;
+            const unsigned long long ops = body(n);
+            const double ms = watch.elapsed();
+            if(ms >= minTime || n >= (1ULL << 40))
+            {
+                const double allocations = Profiler::total(Profiler::ALLOCATIONS) - allocs;
+                return {ms * 1e6 / ops, ops / ms * 1000, allocations / ops, ops};
+            }
+        }
+    }
+
+    double argument(unsigned long long i)
+    {
+        return -10 + 20.0 * (i % SWEEP) / SWEEP + 1e-3;
+    }
+
+    volatile double sink;
+    volatile size_t sizeSink;
+}
+
+int main(int argc, char *argv[])
+{
+    bool csv {false};
+    double minTime {DEFAULT_MIN_TIME};
+    std::string filter;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if(strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            minTime = std::atof(argv[++i]);
+        else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+    }
+    if(csv)
+        std::cout << "case,stage,ns_per_op,ops_per_sec,allocs_per_op,ops" << std::endl;
+    auto report = [&](const Case &c, const char *stage, const Result &r)
+    {
+        std::cout << std::fixed << std::setprecision(3);
+        if(csv)
+            std::cout << c.name << ',' << stage << ',' << r.nsPerOp << ',' << r.opsPerSec << ','
+                      << r.allocsPerOp << ',' << r.ops << std::endl;
+        else
+            std::cout << "{\"case\":\"" << c.name << "\",\"stage\":\"" << stage
+                      << "\",\"ns_per_op\":" << r.nsPerOp << ",\"ops_per_sec\":" << r.opsPerSec
+                      << ",\"allocs_per_op\":" << r.allocsPerOp << ",\"ops\":" << r.ops << "}"
+                      << std::endl;
+    };
+    try
+    {
+        const iat::Compiler compiler;
+        for(const Case &c: CORPUS)
+        {
+            if(!filter.empty() && filter != c.name)
+                continue;
+            const std::string text = c.expression;
+            const std::vector<std::string> tokens = compiler.tokenize(text);
+            const iat::SyntaxNode tree = compiler.parse(tokens);
+            const iat::Program program = compiler.compile(tree);
+            report(c, "tokenize", measure(minTime, [&](unsigned long long n)
+            {
+                for(unsigned long long i = 0; i < n; ++i)
+                    sizeSink = compiler.tokenize(text).size();
+                return n;
+            }));
+            report(c, "parse", measure(minTime, [&](unsigned long long n)
+            {
+                for(unsigned long long i = 0; i < n; ++i)
+                    sizeSink = compiler.parse(tokens).args.size();
+                return n;
+            }));
+            report(c, "compile", measure(minTime, [&](unsigned long long n)
+            {
+                for(unsigned long long i = 0; i < n; ++i)
+                    sizeSink = compiler.compile(tree).code().size();
+                return n;
+            }));
+            report(c, "evaluate", measure(minTime, [&](unsigned long long n)
+            {
+                double sum = 0;
+                for(unsigned long long i = 0; i < n; ++i)
+                    sum += program.evaluate(argument(i));
+                sink = sum;
+                return n;
+            }));
+            report(c, "batch", measure(minTime, [&](unsigned long long n)
+            {
+                double xs[BATCH], ys[BATCH];
+                double *output = ys;
+                unsigned long long done = 0;
+                for(; done < n; done += BATCH)
+                {
+                    for(int k = 0; k < BATCH; ++k)
+                        xs[k] = argument(done + k);
+                    program.evaluate(xs, BATCH, &output);
+                    sink = ys[0];
+                }
+                return done;
+            }));
+            report(c, "parser", measure(minTime, [&](unsigned long long n)
+            {
+                double sum = 0;
+                for(unsigned long long i = 0; i < n; ++i)
+                {
+                    std::vector<std::pair<char, double>> vars {{'X', argument(i)}};
+                    iat::Parser p(text, vars);
+                    sum += p.calculateExpression();
+                }
+                sink = sum;
+                return n;
+            }));
+        }
+    }
+    catch(std::exception &ex)
+    {
+        std::cerr << "Error occurs! " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
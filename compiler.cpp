@@ -0,0 +1,1194 @@
+#include "compiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <ctype.h>
+
+namespace
+{
+    const std::map<std::string, iat::OpCode> &binaryOperators()
+    {
+        static const std::map<std::string, iat::OpCode> ops =
+        {
+            {"+", iat::OpCode::ADD}, {"-", iat::OpCode::SUB},
+            {"e", iat::OpCode::MUL_EXP10}, {"*", iat::OpCode::MUL},
+            {"/", iat::OpCode::DIV}, {"**", iat::OpCode::POW},
+            {"mod", iat::OpCode::MOD}, {"<=", iat::OpCode::LE},
+            {">=", iat::OpCode::GE}, {"<", iat::OpCode::LT},
+            {">", iat::OpCode::GT}, {"==", iat::OpCode::EQ},
+            {"!=", iat::OpCode::NE}, {"&", iat::OpCode::AND},
+            {"|", iat::OpCode::OR}, {"^", iat::OpCode::XOR}
+        };
+        return ops;
+    }
+
+    const std::map<std::string, iat::OpCode> &unaryOperators()
+    {
+        static const std::map<std::string, iat::OpCode> ops =
+        {
+            {"e", iat::OpCode::EXP10}, {"+", iat::OpCode::PLUS},
+            {"-", iat::OpCode::NEG}, {"!", iat::OpCode::NOT},
+            {"factorial", iat::OpCode::FACTORIAL}, {"inv", iat::OpCode::INV},
+            {"sign", iat::OpCode::SIGN}, {"abs", iat::OpCode::ABS},
+            {"cbrt", iat::OpCode::CBRT}, {"sqrt", iat::OpCode::SQRT},
+            {"sqr", iat::OpCode::SQR}, {"cube", iat::OpCode::CUBE},
+            {"gradtorad", iat::OpCode::GRADTORAD}, {"radtograd", iat::OpCode::RADTOGRAD},
+            {"_exp", iat::OpCode::EXP}, {"ln", iat::OpCode::LN},
+            {"log2", iat::OpCode::LOG2}, {"log8", iat::OpCode::LOG8},
+            {"log10", iat::OpCode::LOG10}, {"log16", iat::OpCode::LOG16},
+            {"sin", iat::OpCode::SIN}, {"cos", iat::OpCode::COS},
+            {"tg", iat::OpCode::TG}, {"ctg", iat::OpCode::CTG},
+            {"secans", iat::OpCode::SECANS}, {"csecans", iat::OpCode::CSECANS},
+            {"arcsin", iat::OpCode::ARCSIN}, {"arccos", iat::OpCode::ARCCOS},
+            {"arctg", iat::OpCode::ARCTG}, {"arcctg", iat::OpCode::ARCCTG},
+            {"arcsecans", iat::OpCode::ARCSECANS}, {"arccsecans", iat::OpCode::ARCCSECANS},
+            {"sh", iat::OpCode::SH}, {"ch", iat::OpCode::CH}, {"th", iat::OpCode::TH},
+            {"cth", iat::OpCode::CTH}, {"sech", iat::OpCode::SECH},
+            {"csech", iat::OpCode::CSECH}, {"arcsh", iat::OpCode::ARCSH},
+            {"arcch", iat::OpCode::ARCCH}, {"arcth", iat::OpCode::ARCTH},
+            {"arccth", iat::OpCode::ARCCTH}, {"arcsech", iat::OpCode::ARCSECH},
+            {"arccsech", iat::OpCode::ARCCSECH}
+        };
+        return ops;
+    }
+
+    //Variables and constants Parser used to substitute into the text, T and Y
+    bool isSymbol(char ch)
+    {
+        return ch == 'X' || ch == 'T' || ch == 'Y' || ch == 'P' || ch == 'E' || ch == 'G';
+    }
+
+    double symbolValue(char ch)
+    {
+        switch(ch)
+        {
+            case 'P':
+                return M_PI;
+            case 'E':
+                return M_E;
+            case 'G':
+                return (1 + sqrt(5)) / 2;
+        }
+        return 0;
+    }
+
+    double angleFactor(const std::string &angleUnit)
+    {
+        if(angleUnit == "gradus")
+            return M_PI / 180;
+        if(angleUnit == "grad")
+            return M_PI / 200;
+        return 1;
+    }
+
+    //Position of the '=' of a definition, one that is not part of "==",
+    //"<=", ">=" or "!="
+    size_t assignment(const std::string &line)
+    {
+        for(size_t i = 0; i < line.size(); ++i)
+        {
+            if(line[i] != '=')
+                continue;
+            if(i + 1 < line.size() && line[i + 1] == '=')
+                ++i;
+            else if(i == 0 || (line[i - 1] != '<' && line[i - 1] != '>' && line[i - 1] != '!'))
+                return i;
+        }
+        return std::string::npos;
+    }
+
+    //"name = body" or "name(a, b) = body"
+    bool splitDefinition(const std::string &line, std::string &name,
+                         std::vector<std::string> &parameters, std::string &body)
+    {
+        const size_t eq = assignment(line);
+        if(eq == std::string::npos)
+            return false;
+        const std::string head = line.substr(0, eq);
+        const char *p = head.c_str();
+        auto readWord = [&p](std::string &word)
+        {
+            word.clear();
+            while(isspace(*p)) ++p;
+            while(isalnum(*p) || *p == '_') word.push_back(*p++);
+            while(isspace(*p)) ++p;
+            return !word.empty();
+        };
+        parameters.clear();
+        if(!readWord(name))
+            return false;
+        if(*p == '(')
+        {
+            ++p;
+            for(;;)
+            {
+                std::string parameter;
+                if(!readWord(parameter))
+                    return false;
+                parameters.push_back(parameter);
+                if(*p != ',')
+                    break;
+                ++p;
+            }
+            if(*p++ != ')')
+                return false;
+            while(isspace(*p)) ++p;
+        }
+        body = line.substr(eq + 1);
+        return *p == '\0';
+    }
+
+    template<typename Real>
+    inline Real checkedDivisor(Real b)
+    {
+        if(b == 0)
+            throw iat::ErrorParser(iat::ParserErrorCode::DIVISION_BY_ZERO);
+        return b;
+    }
+
+    template<typename Real>
+    inline Real checkedArgument(Real a, bool inRange)
+    {
+        if(!inRange)
+            throw iat::ErrorParser(iat::ParserErrorCode::ARGUMENT_OUT_OF_RANGE);
+        return a;
+    }
+
+    double factorial(double a)
+    {
+        //Same unsigned long arithmetic as Parser::factorial; from 66! on the
+        //product has more than 64 factors of two and wraps around to zero
+        unsigned int n = fabs(floor(a));
+        if(n >= 66)
+            return 0;
+        unsigned long int result = 1;
+        for(unsigned int i = 2; i <= n; ++i)
+            result *= i;
+        return result;
+    }
+}
+
+double iat::Program::evaluate(double x, double t, const double *parameters) const
+{
+    return evaluateAt(x, 0, t, parameters);
+}
+
+double iat::Program::evaluateAt(double x, double y, double t, const double *parameters) const
+{
+    if(!parameters)
+        parameters = m_parameters.data();
+    double inlineSlots[INLINE_SLOTS];
+    std::vector<double> heapSlots;
+    double *slots = inlineSlots;
+    if(m_code.size() > INLINE_SLOTS)
+    {
+        heapSlots.resize(m_code.size());
+        slots = heapSlots.data();
+    }
+    for(size_t i = 0; i < m_code.size(); ++i)
+        slots[i] = execute(m_code[i], slots, x, y, t, parameters);
+    return slots[m_outputs.front()];
+}
+
+long double iat::Program::evaluateExtended(long double x, double t,
+                                           const double *parameters) const
+{
+    if(!parameters)
+        parameters = m_parameters.data();
+    long double inlineSlots[INLINE_SLOTS];
+    std::vector<long double> heapSlots;
+    long double *slots = inlineSlots;
+    if(m_code.size() > INLINE_SLOTS)
+    {
+        heapSlots.resize(m_code.size());
+        slots = heapSlots.data();
+    }
+    for(size_t i = 0; i < m_code.size(); ++i)
+        slots[i] = execute(m_code[i], slots, x, 0, t, parameters);
+    return slots[m_outputs.front()];
+}
+
+void iat::Program::evaluate(const double *xs, size_t count, double *const *outputs,
+                            double t, const double *parameters) const
+{
+    evaluate(xs, nullptr, count, outputs, t, parameters);
+}
+
+void iat::Program::evaluate(const double *xs, const double *ys, size_t count,
+                            double *const *outputs, double t,
+                            const double *parameters) const
+{
+    if(!parameters)
+        parameters = m_parameters.data();
+    //Per thread and kept, so that batches on long-lived threads, such as
+    //heatmap workers, allocate nothing once they have grown
+    thread_local std::vector<bool> needed;
+    thread_local std::vector<double> columns;
+    needed.assign(m_code.size(), false);
+    for(size_t i = 0; i < m_outputs.size(); ++i)
+        needed[m_outputs[i]] = needed[m_outputs[i]] || outputs[i];
+    for(size_t i = m_code.size(); i-- > 0;)
+    {
+        if(!needed[i])
+            continue;
+        if(m_code[i].a >= 0)
+            needed[m_code[i].a] = true;
+        if(m_code[i].b >= 0)
+            needed[m_code[i].b] = true;
+    }
+    //One column of count values per instruction; the common arithmetic runs
+    //in plain loops, everything else through execute() with its checks
+    columns.resize(m_code.size() * count);
+    for(size_t i = 0; i < m_code.size(); ++i)
+    {
+        if(!needed[i])
+            continue;
+        const Instruction &in = m_code[i];
+        double *out = &columns[i * count];
+        const double *a = in.a >= 0 ? &columns[in.a * count] : nullptr;
+        const double *b = in.b >= 0 ? &columns[in.b * count] : nullptr;
+        switch(in.op)
+        {
+            case OpCode::CONST:
+                std::fill(out, out + count, in.value);
+                break;
+            case OpCode::VAR_X:
+                std::copy(xs, xs + count, out);
+                break;
+            case OpCode::VAR_T:
+                std::fill(out, out + count, t);
+                break;
+            case OpCode::VAR_PARAMETER:
+                std::fill(out, out + count, parameters[int(in.value)]);
+                break;
+            case OpCode::VAR_Y:
+                if(ys)
+                    std::copy(ys, ys + count, out);
+                else
+                    std::fill(out, out + count, 0.0);
+                break;
+            case OpCode::ADD:
+                for(size_t k = 0; k < count; ++k)
+                    out[k] = a[k] + b[k];
+                break;
+            case OpCode::SUB:
+                for(size_t k = 0; k < count; ++k)
+                    out[k] = a[k] - b[k];
+                break;
+            case OpCode::MUL:
+                for(size_t k = 0; k < count; ++k)
+                    out[k] = a[k] * b[k];
+                break;
+            case OpCode::NEG:
+                for(size_t k = 0; k < count; ++k)
+                    out[k] = -a[k];
+                break;
+            default:
+            {
+                const Instruction scalar {in.op, 0, 1, in.value};
+                for(size_t k = 0; k < count; ++k)
+                {
+                    const double operands[2] = {a ? a[k] : 0, b ? b[k] : 0};
+                    out[k] = execute(scalar, operands, xs[k], ys ? ys[k] : 0, t, parameters);
+                }
+                break;
+            }
+        }
+    }
+    for(size_t i = 0; i < m_outputs.size(); ++i)
+    {
+        if(outputs[i])
+            std::copy(&columns[m_outputs[i] * count], &columns[m_outputs[i] * count] + count,
+                      outputs[i]);
+    }
+}
+
+const std::vector<iat::Instruction> &iat::Program::code() const
+{
+    return m_code;
+}
+
+const std::string &iat::Program::angleUnit() const
+{
+    return m_angleUnit;
+}
+
+size_t iat::Program::outputs() const
+{
+    return m_outputs.size();
+}
+
+int iat::Program::output(size_t i) const
+{
+    return m_outputs.at(i);
+}
+
+const std::vector<double> &iat::Program::parameters() const
+{
+    return m_parameters;
+}
+
+iat::Program iat::Program::fromCode(std::vector<Instruction> code, std::vector<int> outputs,
+                                    const std::string &angleUnit,
+                                    std::vector<double> parameters,
+                                    std::shared_ptr<const Program> group, int groupOutput)
+{
+    for(size_t i = 0; i < code.size(); ++i)
+    {
+        const Instruction &in = code[i];
+        const bool isLeaf = in.op <= OpCode::VAR_Y;
+        const bool isBinary = in.op >= OpCode::ADD && in.op <= OpCode::XOR;
+        const bool isUnary = in.op >= OpCode::EXP10 && in.op <= OpCode::ARCCSECH;
+        bool isValid = (isLeaf && in.a == -1 && in.b == -1) ||
+                ((isUnary || isBinary) && in.a >= 0 && size_t(in.a) < i &&
+                 (isBinary ? in.b >= 0 && size_t(in.b) < i : in.b == -1));
+        if(in.op == OpCode::VAR_PARAMETER)
+            isValid = isValid && in.value >= 0 && in.value < parameters.size() &&
+                    in.value == int(in.value);
+        if(!isValid)
+            throw ErrorParser(ParserErrorCode::UNKNOW_EXPRESSION_TYPE);
+    }
+    if(outputs.empty())
+        throw ErrorParser(ParserErrorCode::UNKNOW_EXPRESSION_TYPE);
+    for(int output: outputs)
+    {
+        if(output < 0 || size_t(output) >= code.size())
+            throw ErrorParser(ParserErrorCode::UNKNOW_EXPRESSION_TYPE);
+    }
+    if(group && (groupOutput < 0 || size_t(groupOutput) >= group->outputs()))
+        throw ErrorParser(ParserErrorCode::UNKNOW_EXPRESSION_TYPE);
+    Program program;
+    program.m_code = std::move(code);
+    program.m_outputs = std::move(outputs);
+    program.m_angleUnit = angleUnit;
+    program.m_angleFactor = angleFactor(angleUnit);
+    program.m_parameters = std::move(parameters);
+    program.m_group = std::move(group);
+    program.m_groupOutput = program.m_group ? groupOutput : -1;
+    return program;
+}
+
+const std::shared_ptr<const iat::Program> &iat::Program::group() const
+{
+    return m_group;
+}
+
+int iat::Program::groupOutput() const
+{
+    return m_groupOutput;
+}
+
+bool iat::Program::dependsOnTime() const
+{
+    return dependencies() & DEPENDS_ON_T;
+}
+
+uint64_t iat::Program::dependencies() const
+{
+    //Compaction leaves only instructions the outputs use; for a group that
+    //is the union of all outputs
+    uint64_t dependencies = 0;
+    for(const auto &in: m_code)
+    {
+        if(in.op == OpCode::VAR_X)
+            dependencies |= DEPENDS_ON_X;
+        else if(in.op == OpCode::VAR_T)
+            dependencies |= DEPENDS_ON_T;
+        else if(in.op == OpCode::VAR_Y)
+            dependencies |= DEPENDS_ON_Y;
+        else if(in.op == OpCode::VAR_PARAMETER)
+            dependencies |= uint64_t(DEPENDS_ON_PARAMETER) << int(in.value);
+    }
+    return dependencies;
+}
+
+template<typename Real>
+Real iat::Program::execute(const Instruction &in, const Real *slots, Real x, double y,
+                           double t, const double *parameters) const
+{
+    switch(in.op)
+    {
+        case OpCode::CONST: return in.value;
+        case OpCode::VAR_X: return x;
+        case OpCode::VAR_T: return t;
+        case OpCode::VAR_Y: return y;
+        case OpCode::VAR_PARAMETER: return parameters[int(in.value)];
+        case OpCode::ADD: return slots[in.a] + slots[in.b];
+        case OpCode::SUB: return slots[in.a] - slots[in.b];
+        case OpCode::MUL_EXP10: return slots[in.a] * std::pow(10, slots[in.b]);
+        case OpCode::MUL: return slots[in.a] * slots[in.b];
+        case OpCode::DIV: return slots[in.a] / checkedDivisor(slots[in.b]);
+        case OpCode::POW: return std::pow(slots[in.a], slots[in.b]);
+        case OpCode::MOD:
+            return (int)slots[in.a] % (int)checkedDivisor((int)slots[in.b]);
+        case OpCode::LE: return slots[in.a] <= slots[in.b] ? 1 : 0;
+        case OpCode::GE: return slots[in.a] >= slots[in.b] ? 1 : 0;
+        case OpCode::LT: return slots[in.a] < slots[in.b] ? 1 : 0;
+        case OpCode::GT: return slots[in.a] > slots[in.b] ? 1 : 0;
+        case OpCode::EQ: return slots[in.a] == slots[in.b] ? 1 : 0;
+        case OpCode::NE: return slots[in.a] != slots[in.b] ? 1 : 0;
+        case OpCode::AND: return (slots[in.a] != 0 && slots[in.b] != 0) ? 1 : 0;
+        case OpCode::OR: return (slots[in.a] != 0 || slots[in.b] != 0) ? 1 : 0;
+        case OpCode::XOR: return ((slots[in.a] != 0) != (slots[in.b] != 0)) ? 1 : 0;
+        default:
+            break;
+    }
+    const Real a = slots[in.a];
+    switch(in.op)
+    {
+        case OpCode::EXP10: return std::pow(10, a);
+        case OpCode::PLUS: return +a;
+        case OpCode::NEG: return -a;
+        case OpCode::NOT: return (a != 0) ? 0 : 1;
+        case OpCode::FACTORIAL: return factorial(a);
+        case OpCode::INV: return (a != 0) ? std::pow(a, -1) : 0.0;
+        case OpCode::SIGN: return (a >= 0) ? 1 : -1;
+        case OpCode::ABS: return std::fabs(a);
+        case OpCode::CBRT: return std::pow(a, std::pow(3, -1));
+        case OpCode::SQRT: return std::sqrt(checkedArgument(a, a >= 0));
+        case OpCode::SQR: return std::pow(a, 2);
+        case OpCode::CUBE: return std::pow(a, 3);
+        case OpCode::GRADTORAD: return M_PI * a / 180;
+        case OpCode::RADTOGRAD: return 180 * a / M_PI;
+        case OpCode::EXP: return std::exp(a);
+        case OpCode::LN: return std::log(checkedArgument(a, a >= 0));
+        case OpCode::LOG2: return std::log2(checkedArgument(a, a >= 0));
+        case OpCode::LOG8: return std::log10(checkedArgument(a, a >= 0)) / std::log10(8);
+        case OpCode::LOG10: return std::log10(checkedArgument(a, a >= 0));
+        case OpCode::LOG16: return std::log10(checkedArgument(a, a >= 0)) / std::log10(16);
+        case OpCode::SIN: return std::sin(a * m_angleFactor);
+        case OpCode::COS: return std::cos(a * m_angleFactor);
+        case OpCode::TG: return std::tan(a * m_angleFactor);
+        case OpCode::CTG:
+            checkedDivisor(std::tan(a));
+            return std::pow(std::tan(a * m_angleFactor), -1);
+        case OpCode::SECANS:
+            checkedDivisor(std::sin(a));
+            return std::pow(std::sin(a * m_angleFactor), -1);
+        case OpCode::CSECANS:
+            checkedDivisor(std::cos(a));
+            return std::pow(std::cos(a * m_angleFactor), -1);
+        case OpCode::ARCSIN: return std::asin(checkedArgument(a, std::fabs(a) <= 1));
+        case OpCode::ARCCOS: return std::acos(checkedArgument(a, std::fabs(a) <= 1));
+        case OpCode::ARCTG: return std::atan(a);
+        case OpCode::ARCCTG: return std::atan(1 / checkedDivisor(a));
+        case OpCode::ARCSECANS: return std::asin(1 / checkedDivisor(a));
+        case OpCode::ARCCSECANS: return std::acos(1 / checkedDivisor(a));
+        case OpCode::SH: return std::sinh(a);
+        case OpCode::CH: return std::cosh(a);
+        case OpCode::TH: return std::tanh(a);
+        case OpCode::CTH: return std::pow(checkedDivisor(std::tanh(a)), -1);
+        case OpCode::SECH: return std::pow(checkedDivisor(std::sinh(a)), -1);
+        case OpCode::CSECH: return 1 / std::cosh(a);
+        case OpCode::ARCSH: return std::asinh(a);
+        case OpCode::ARCCH: return std::acosh(checkedArgument(a, a >= 1));
+        case OpCode::ARCTH: return std::atanh(checkedArgument(a, std::fabs(a) < 1));
+        case OpCode::ARCCTH:
+            checkedDivisor(a);
+            return std::atanh(std::pow(checkedArgument(a, std::fabs(a) > 1), -1));
+        case OpCode::ARCSECH: return std::asinh(std::pow(checkedDivisor(a), -1));
+        case OpCode::ARCCSECH:
+            checkedDivisor(a);
+            return std::acosh(std::pow(checkedArgument(a, a <= 1), -1));
+        default:
+            break;
+    }
+    throw ErrorParser(ParserErrorCode::UNKNOW_EXPRESSION_TYPE);
+}
+
+iat::AnimationSampler::AnimationSampler(std::shared_ptr<const Program> program,
+                                        std::vector<double> xs):
+    m_program(std::move(program)),
+    m_xs(std::move(xs))
+{
+    const auto &code = m_program->m_code;
+    m_dependencies.resize(code.size(), 0);
+    m_needed.resize(code.size(), false);
+    m_columns.resize(code.size());
+    m_scalars.resize(code.size(), 0);
+    m_needed[m_program->m_outputs.front()] = true;
+    for(size_t i = code.size(); i-- > 0;)
+    {
+        if(!m_needed[i])
+            continue;
+        if(code[i].a >= 0)
+            m_needed[code[i].a] = true;
+        if(code[i].b >= 0)
+            m_needed[code[i].b] = true;
+    }
+    for(size_t i = 0; i < code.size(); ++i)
+    {
+        const Instruction &in = code[i];
+        if(in.op == OpCode::VAR_X)
+            m_dependencies[i] = DEPENDS_ON_X;
+        else if(in.op == OpCode::VAR_T)
+            m_dependencies[i] = DEPENDS_ON_T;
+        else if(in.op == OpCode::VAR_Y)
+            m_dependencies[i] = DEPENDS_ON_Y;
+        else if(in.op == OpCode::VAR_PARAMETER)
+            m_dependencies[i] = uint64_t(DEPENDS_ON_PARAMETER) << int(in.value);
+        else if(in.op != OpCode::CONST)
+            m_dependencies[i] = m_dependencies[in.a] | (in.b >= 0 ? m_dependencies[in.b] : 0);
+        if(m_needed[i] && !(m_dependencies[i] & ~uint64_t(DEPENDS_ON_X)))
+            run(i, 0, nullptr);
+    }
+}
+
+const std::shared_ptr<const iat::Program> &iat::AnimationSampler::program() const
+{
+    return m_program;
+}
+
+const std::vector<double> &iat::AnimationSampler::xs() const
+{
+    return m_xs;
+}
+
+void iat::AnimationSampler::setXs(const std::vector<double> &xs)
+{
+    m_xs.assign(xs.begin(), xs.end());
+    m_isEvaluated = false;
+    for(size_t i = 0; i < m_dependencies.size(); ++i)
+    {
+        if(m_needed[i] && !(m_dependencies[i] & ~uint64_t(DEPENDS_ON_X)))
+            run(i, 0, nullptr);
+    }
+}
+
+void iat::AnimationSampler::evaluate(double t, const double *parameters,
+                                     std::vector<double> &ys)
+{
+    if(!parameters)
+        parameters = m_program->m_parameters.data();
+    //What changed since the last call; the first call computes everything
+    //that does not depend on X only
+    uint64_t changed = ~uint64_t(DEPENDS_ON_X);
+    if(m_isEvaluated)
+    {
+        changed = t != m_time ? uint64_t(DEPENDS_ON_T) : 0;
+        for(size_t j = 0; j < m_parameters.size(); ++j)
+        {
+            if(parameters[j] != m_parameters[j])
+                changed |= uint64_t(DEPENDS_ON_PARAMETER) << j;
+        }
+    }
+    //Until every instruction ran, the columns are current for no T, so a
+    //call interrupted by an exception is followed by a full one
+    m_isEvaluated = false;
+    m_recomputed = 0;
+    for(size_t i = 0; i < m_dependencies.size(); ++i)
+    {
+        if(m_needed[i] && (m_dependencies[i] & changed))
+        {
+            run(i, t, parameters);
+            ++m_recomputed;
+        }
+    }
+    m_isEvaluated = true;
+    m_time = t;
+    m_parameters.assign(parameters, parameters + m_program->m_parameters.size());
+    const int output = m_program->m_outputs.front();
+    if(m_dependencies[output] & DEPENDS_ON_X)
+        ys = m_columns[output];
+    else
+        ys.assign(m_xs.size(), m_scalars[output]);
+}
+
+size_t iat::AnimationSampler::mixedInstructions() const
+{
+    size_t count = 0;
+    for(size_t i = 0; i < m_dependencies.size(); ++i)
+        count += m_needed[i] && (m_dependencies[i] & DEPENDS_ON_X) &&
+                (m_dependencies[i] & ~uint64_t(DEPENDS_ON_X));
+    return count;
+}
+
+size_t iat::AnimationSampler::recomputed() const
+{
+    return m_recomputed;
+}
+
+//A division by zero or argument out of range gives NaN for that value only;
+//the instructions using it pass NaN on, so the curve has a gap there
+void iat::AnimationSampler::run(size_t i, double t, const double *parameters)
+{
+    const Instruction &in = m_program->m_code[i];
+    if(!(m_dependencies[i] & DEPENDS_ON_X))
+    {
+        const double operands[2] = {in.a >= 0 ? m_scalars[in.a] : 0,
+                                    in.b >= 0 ? m_scalars[in.b] : 0};
+        try
+        {
+            m_scalars[i] = m_program->execute({in.op, 0, 1, in.value}, operands, 0.0, 0, t,
+                                              parameters);
+        }
+        catch(std::exception &)
+        {
+            m_scalars[i] = NAN;
+        }
+        return;
+    }
+    //A column operand advances with k, a single value does not
+    auto operand = [this](int j, size_t &step) -> const double *
+    {
+        step = 0;
+        if(j < 0)
+            return &m_scalars[0];
+        if(m_dependencies[j] & DEPENDS_ON_X)
+        {
+            step = 1;
+            return m_columns[j].data();
+        }
+        return &m_scalars[j];
+    };
+    size_t stepA, stepB;
+    const double *a = operand(in.a, stepA);
+    const double *b = operand(in.b, stepB);
+    std::vector<double> &out = m_columns[i];
+    out.resize(m_xs.size());
+    const size_t count = m_xs.size();
+    switch(in.op)
+    {
+        case OpCode::VAR_X:
+            out = m_xs;
+            break;
+        case OpCode::ADD:
+            for(size_t k = 0; k < count; ++k)
+                out[k] = a[k * stepA] + b[k * stepB];
+            break;
+        case OpCode::SUB:
+            for(size_t k = 0; k < count; ++k)
+                out[k] = a[k * stepA] - b[k * stepB];
+            break;
+        case OpCode::MUL:
+            for(size_t k = 0; k < count; ++k)
+                out[k] = a[k * stepA] * b[k * stepB];
+            break;
+        default:
+        {
+            const Instruction scalar {in.op, 0, 1, in.value};
+            for(size_t k = 0; k < count; ++k)
+            {
+                const double operands[2] = {a[k * stepA], b[k * stepB]};
+                try
+                {
+                    out[k] = m_program->execute(scalar, operands, m_xs[k], 0, t, parameters);
+                }
+                catch(std::exception &)
+                {
+                    out[k] = NAN;
+                }
+            }
+            break;
+        }
+    }
+}
+
+iat::Compiler::Compiler(const std::string &angleUnit):
+    m_angleUnit(angleUnit)
+{}
+
+bool iat::Compiler::isDefinition(const std::string &line)
+{
+    std::string name, body;
+    std::vector<std::string> parameters;
+    return splitDefinition(line, name, parameters, body);
+}
+
+void iat::Compiler::define(const std::string &definition)
+{
+    std::string name, body;
+    std::vector<std::string> parameters;
+    if(!splitDefinition(definition, name, parameters, body) || !isName(name))
+        throw ErrorParser(ParserErrorCode::INVALID_DEFINITION);
+    for(size_t i = 0; i < parameters.size(); ++i)
+    {
+        if(!isName(parameters[i]) || parameters[i] == name ||
+           std::count(parameters.begin(), parameters.begin() + i, parameters[i]) > 0)
+            throw ErrorParser(ParserErrorCode::INVALID_DEFINITION);
+    }
+    //The name itself is not known yet, so a definition cannot call itself
+    m_parameters = parameters;
+    SyntaxNode tree;
+    try
+    {
+        tree = parse(body);
+    }
+    catch(...)
+    {
+        m_parameters.clear();
+        throw;
+    }
+    m_parameters.clear();
+    m_definitions[name] = Definition{parameters.size(), tree};
+}
+
+bool iat::Compiler::isParameter(const std::string &line)
+{
+    return line.compare(0, 6, "param ") == 0;
+}
+
+//"param name = value [min max]"; without a range it is [-10, 10], widened
+//to the value if needed
+iat::Parameter iat::Compiler::parseParameter(const std::string &line)
+{
+    std::string text = line.substr(6);
+    std::replace(text.begin(), text.end(), ',', ' ');
+    const size_t eq = text.find('=');
+    if(!isParameter(line) || eq == std::string::npos)
+        throw ErrorParser(ParserErrorCode::INVALID_DEFINITION);
+    Parameter parameter {"", 0, -10, 10};
+    std::string rest;
+    std::stringstream head(text.substr(0, eq));
+    if(!(head >> parameter.name) || head >> rest)
+        throw ErrorParser(ParserErrorCode::INVALID_DEFINITION);
+    std::stringstream tail(text.substr(eq + 1));
+    if(!(tail >> parameter.value))
+        throw ErrorParser(ParserErrorCode::INVALID_DEFINITION);
+    char bracket;
+    if(tail >> bracket)
+    {
+        if(bracket != '[' || !(tail >> parameter.min >> parameter.max >> bracket) ||
+           bracket != ']' || tail >> rest)
+            throw ErrorParser(ParserErrorCode::INVALID_DEFINITION);
+    }
+    else
+    {
+        parameter.min = std::min(parameter.min, parameter.value);
+        parameter.max = std::max(parameter.max, parameter.value);
+    }
+    if(!(parameter.min < parameter.max) || parameter.value < parameter.min ||
+       parameter.value > parameter.max)
+        throw ErrorParser(ParserErrorCode::INVALID_DEFINITION);
+    return parameter;
+}
+
+void iat::Compiler::declare(const Parameter &parameter)
+{
+    if(!isName(parameter.name) || m_declared.size() >= MAX_PARAMETERS)
+        throw ErrorParser(ParserErrorCode::INVALID_DEFINITION);
+    m_declared.push_back(parameter.name);
+    m_declaredValues.push_back(parameter.value);
+}
+
+bool iat::Compiler::isName(const std::string &name) const
+{
+    if(name.empty() || !(isalpha(name[0]) || name[0] == '_'))
+        return false;
+    for(char ch: name)
+    {
+        if(!isalnum(ch) && ch != '_')
+            return false;
+    }
+    if(name.size() == 1 && isSymbol(name[0]))
+        return false;
+    const auto &tokens = Parser::tokens();
+    return std::find(tokens.begin(), tokens.end(), name) == tokens.end() &&
+            m_definitions.find(name) == m_definitions.end() &&
+            std::find(m_declared.begin(), m_declared.end(), name) == m_declared.end();
+}
+
+//Length of the longest defined name, declared parameter or definition
+//parameter at p, 0 if none
+size_t iat::Compiler::matchName(const char *p) const
+{
+    size_t size = 0;
+    for(const auto &definition: m_definitions)
+    {
+        const std::string &name = definition.first;
+        if(name.size() > size && strncmp(p, name.c_str(), name.size()) == 0)
+            size = name.size();
+    }
+    for(const auto *names: {&m_declared, &m_parameters})
+    {
+        for(const auto &name: *names)
+        {
+            if(name.size() > size && strncmp(p, name.c_str(), name.size()) == 0)
+                size = name.size();
+        }
+    }
+    return size;
+}
+
+std::vector<std::string> iat::Compiler::tokenize(const std::string &input) const
+{
+    std::vector<std::string> tokens;
+    const char *p = input.c_str();
+    for(;;)
+    {
+        while (isspace(*p)) ++p;
+        if (isdigit(*p))
+        {
+            std::string number;
+            while (isdigit(*p) || *p == '.') number.push_back(*p++);
+            tokens.push_back(number);
+            continue;
+        }
+        size_t size = 0;
+        if (isSymbol(*p) || *p == ',')
+        {
+            size = 1;
+        }
+        else
+        {
+            for (const auto& t : Parser::tokens())
+            {
+                if (strncmp(p, t.c_str(), t.size()) == 0)
+                {
+                    size = t.size();
+                    break;
+                }
+            }
+        }
+        //A defined name wins over an operator or symbol it starts with
+        size = std::max(size, matchName(p));
+        //Like Parser, everything after the first unknown character is ignored
+        if (size == 0)
+            return tokens;
+        tokens.push_back(std::string(p, size));
+        p += size;
+    }
+}
+
+iat::SyntaxNode iat::Compiler::parse(const std::vector<std::string> &tokens) const
+{
+    size_t pos = 0;
+    return parseBinaryExpression(tokens, pos, 0);
+}
+
+iat::SyntaxNode iat::Compiler::parse(const std::string &input) const
+{
+    int balance = 0;
+    for(auto &s : input)
+    {
+        if (s == '(') balance++;
+        if (s == ')') balance--;
+    }
+    if(balance != 0)
+        throw ErrorParser(ParserErrorCode::UNBALANCED_PARENTHESIS);
+    return parse(tokenize(input));
+}
+
+iat::SyntaxNode iat::Compiler::parseUnaryExpression(const std::vector<std::string> &tokens,
+                                                    size_t &pos) const
+{
+    if (pos >= tokens.size())
+        throw ErrorParser(ParserErrorCode::INVALID_INPUT_EXPRESSION);
+    const std::string &token = tokens[pos++];
+    auto parameter = std::find(m_parameters.begin(), m_parameters.end(), token);
+    if (parameter != m_parameters.end())
+        return SyntaxNode{"#" + std::to_string(parameter - m_parameters.begin()), {}};
+    if (std::find(m_declared.begin(), m_declared.end(), token) != m_declared.end())
+        return SyntaxNode{token, {}};
+    auto definition = m_definitions.find(token);
+    if (definition != m_definitions.end()) {
+        SyntaxNode call {token, {}};
+        if (definition->second.parameters == 0)
+            return call;
+        if (pos >= tokens.size() || tokens[pos++] != "(")
+            throw ErrorParser(ParserErrorCode::INVALID_INPUT_EXPRESSION);
+        for (;;) {
+            call.args.push_back(parseBinaryExpression(tokens, pos, 0));
+            if (pos >= tokens.size() || tokens[pos] != ",")
+                break;
+            ++pos;
+        }
+        if (pos >= tokens.size() || tokens[pos++] != ")")
+            throw ErrorParser(ParserErrorCode::CLOSED_PARENTHESIS_EXPECTED);
+        if (call.args.size() != definition->second.parameters)
+            throw ErrorParser(ParserErrorCode::ARGUMENT_COUNT_MISMATCH);
+        return call;
+    }
+    if (token == "(") {
+        auto result = parseBinaryExpression(tokens, pos, 0);
+        if (pos >= tokens.size() || tokens[pos++] != ")")
+            throw ErrorParser(ParserErrorCode::CLOSED_PARENTHESIS_EXPECTED);
+        return result;
+    }
+    if (isdigit(token[0]) || isSymbol(token[0]))
+        return SyntaxNode{token, {}};
+    return SyntaxNode{token, {parseUnaryExpression(tokens, pos)}};
+}
+
+iat::SyntaxNode iat::Compiler::parseBinaryExpression(const std::vector<std::string> &tokens,
+                                                     size_t &pos, int minPriority) const
+{
+    auto leftExpression = parseUnaryExpression(tokens, pos);
+    for (;;) {
+        if (pos >= tokens.size())
+            return leftExpression;
+        const std::string &op = tokens[pos];
+        auto priority = getPriority(op);
+        if (priority <= minPriority)
+            return leftExpression;
+        ++pos;
+        auto rightExpression = parseBinaryExpression(tokens, pos, priority);
+        leftExpression = SyntaxNode{op, {leftExpression, rightExpression}};
+    }
+}
+
+iat::Program iat::Compiler::compile(const SyntaxNode &tree) const
+{
+    return compile(std::vector<SyntaxNode>{tree});
+}
+
+iat::Program iat::Compiler::compile(const std::string &input) const
+{
+    return compile(parse(input));
+}
+
+iat::Program iat::Compiler::compile(const std::vector<SyntaxNode> &trees) const
+{
+    Program program;
+    program.m_angleUnit = m_angleUnit;
+    program.m_angleFactor = angleFactor(m_angleUnit);
+    program.m_parameters = m_declaredValues;
+    Emitted emitted;
+    for(const auto &tree: trees)
+        program.m_outputs.push_back(emit(program, tree, {}, emitted));
+    compact(program);
+    return program;
+}
+
+int iat::Compiler::emit(Program &program, const SyntaxNode &node,
+                        const std::vector<int> &arguments, Emitted &emitted) const
+{
+    if(node.token[0] == '#')
+        return arguments.at(std::atoi(node.token.c_str() + 1));
+    auto definition = m_definitions.find(node.token);
+    if(definition != m_definitions.end())
+    {
+        //Arguments are computed in the caller's scope, then the body is
+        //inlined with its parameters bound to them
+        std::vector<int> values;
+        for(const auto &arg: node.args)
+            values.push_back(emit(program, arg, arguments, emitted));
+        return emit(program, definition->second.body, values, emitted);
+    }
+    Instruction in {OpCode::CONST, -1, -1, 0};
+    switch(node.args.size())
+    {
+        case 0:
+        {
+            auto declared = std::find(m_declared.begin(), m_declared.end(), node.token);
+            if(declared != m_declared.end())
+            {
+                in.op = OpCode::VAR_PARAMETER;
+                in.value = declared - m_declared.begin();
+            }
+            else if(node.token == "X")
+                in.op = OpCode::VAR_X;
+            else if(node.token == "T")
+                in.op = OpCode::VAR_T;
+            else if(node.token == "Y")
+                in.op = OpCode::VAR_Y;
+            else if(isSymbol(node.token[0]))
+                in.value = symbolValue(node.token[0]);
+            else
+                in.value = std::atof(node.token.c_str());
+            break;
+        }
+        case 1:
+        {
+            auto op = unaryOperators().find(node.token);
+            if(op == unaryOperators().end())
+                throw ErrorParser(ParserErrorCode::UNKNOWN_UNARY_OPERATOR);
+            in.op = op->second;
+            in.a = emit(program, node.args[0], arguments, emitted);
+            break;
+        }
+        case 2:
+        {
+            auto op = binaryOperators().find(node.token);
+            if(op == binaryOperators().end())
+                throw ErrorParser(ParserErrorCode::UNKNOWN_BINARY_OPERATOR);
+            in.op = op->second;
+            in.a = emit(program, node.args[0], arguments, emitted);
+            in.b = emit(program, node.args[1], arguments, emitted);
+            break;
+        }
+        default:
+            throw ErrorParser(ParserErrorCode::UNKNOW_EXPRESSION_TYPE);
+    }
+    return append(program, in, emitted);
+}
+
+int iat::Compiler::append(Program &program, Instruction in, Emitted &emitted) const
+{
+    auto &code = program.m_code;
+    //An operation on constants is done now, unless it fails; then it stays
+    //and reports its error on evaluation as before
+    if(in.a >= 0 && code[in.a].op == OpCode::CONST &&
+       (in.b < 0 || code[in.b].op == OpCode::CONST))
+    {
+        const double operands[2] = {code[in.a].value, in.b >= 0 ? code[in.b].value : 0};
+        try
+        {
+            in = {OpCode::CONST, -1, -1,
+                  program.execute({in.op, 0, 1, in.value}, operands, 0.0, 0, 0, nullptr)};
+        }
+        catch(ErrorParser &)
+        {
+        }
+    }
+    uint64_t bits;
+    memcpy(&bits, &in.value, sizeof(bits));
+    const auto key = std::make_tuple(int(in.op), in.a, in.b, bits);
+    auto found = emitted.find(key);
+    if(found != emitted.end())
+        return found->second;
+    code.push_back(in);
+    return emitted[key] = code.size() - 1;
+}
+
+//Drops instructions that only fed folded ones
+void iat::Compiler::compact(Program &program)
+{
+    auto &code = program.m_code;
+    std::vector<bool> used(code.size(), false);
+    for(int output: program.m_outputs)
+        used[output] = true;
+    for(size_t i = code.size(); i-- > 0;)
+    {
+        if(!used[i])
+            continue;
+        if(code[i].a >= 0)
+            used[code[i].a] = true;
+        if(code[i].b >= 0)
+            used[code[i].b] = true;
+    }
+    std::vector<int> index(code.size(), -1);
+    std::vector<Instruction> kept;
+    for(size_t i = 0; i < code.size(); ++i)
+    {
+        if(!used[i])
+            continue;
+        Instruction in = code[i];
+        if(in.a >= 0)
+            in.a = index[in.a];
+        if(in.b >= 0)
+            in.b = index[in.b];
+        index[i] = kept.size();
+        kept.push_back(in);
+    }
+    code.swap(kept);
+    for(int &output: program.m_outputs)
+        output = index[output];
+}
+
+std::shared_ptr<const iat::Program> iat::ProgramCache::get(const std::string &expression,
+                                                          const std::string &angleUnit)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    dropExpired();
+    auto &entry = m_programs[std::make_pair(expression, angleUnit)];
+    auto program = entry.lock();
+    if(!program)
+    {
+        program = std::make_shared<const Program>(Compiler(angleUnit).compile(expression));
+        entry = program;
+    }
+    return program;
+}
+
+std::vector<std::shared_ptr<const iat::Program>> iat::ProgramCache::get(
+        const std::vector<std::string> &expressions, const std::vector<std::string> &definitions,
+        const std::string &angleUnit)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    dropExpired();
+    if(expressions.empty())
+        return {};
+    const GroupKey key = std::make_tuple(expressions, definitions, angleUnit);
+    auto found = m_groups.find(key);
+    if(found != m_groups.end())
+    {
+        //Another thread may have let go of them since dropExpired()
+        std::vector<std::shared_ptr<const Program>> programs;
+        for(const auto &program: found->second)
+        {
+            programs.push_back(program.lock());
+            if(!programs.back())
+                break;
+        }
+        if(programs.back())
+            return programs;
+    }
+    Compiler compiler(angleUnit);
+    for(const auto &definition: definitions)
+    {
+        if(Compiler::isParameter(definition))
+            compiler.declare(Compiler::parseParameter(definition));
+        else
+            compiler.define(definition);
+    }
+    std::vector<SyntaxNode> trees;
+    for(const auto &expression: expressions)
+        trees.push_back(compiler.parse(expression));
+    //Every program also works on its own, e.g. for single evaluations
+    std::shared_ptr<const Program> group;
+    if(trees.size() > 1)
+        group = std::make_shared<const Program>(compiler.compile(trees));
+    std::vector<std::shared_ptr<const Program>> compiled;
+    for(size_t i = 0; i < trees.size(); ++i)
+    {
+        auto program = std::make_shared<Program>(compiler.compile(trees[i]));
+        program->m_group = group;
+        program->m_groupOutput = group ? int(i) : -1;
+        compiled.push_back(program);
+    }
+    m_groups[key].assign(compiled.begin(), compiled.end());
+    return compiled;
+}
+
+void iat::ProgramCache::insert(const std::vector<std::string> &expressions,
+                               const std::vector<std::string> &definitions,
+                               const std::string &angleUnit,
+                               std::vector<std::shared_ptr<const Program>> programs)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    dropExpired();
+    m_groups[std::make_tuple(expressions, definitions, angleUnit)].assign(programs.begin(),
+                                                                         programs.end());
+}
+
+size_t iat::ProgramCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t size = 0;
+    for(const auto &entry: m_programs)
+        size += !entry.second.expired();
+    for(const auto &group: m_groups)
+    {
+        for(const auto &program: group.second)
+            size += !program.expired();
+    }
+    return size;
+}
+
+//A group goes as soon as one of its programs is gone; the others may
+//still be held, but the group is compiled again on its next lookup
+void iat::ProgramCache::dropExpired()
+{
+    for(auto i = m_programs.begin(); i != m_programs.end();)
+    {
+        if(i->second.expired())
+            i = m_programs.erase(i);
+        else
+            ++i;
+    }
+    for(auto i = m_groups.begin(); i != m_groups.end();)
+    {
+        const auto &programs = i->second;
+        if(std::any_of(programs.begin(), programs.end(),
+                       [](const std::weak_ptr<const Program> &program)
+        {
+            return program.expired();
+        }))
+            i = m_groups.erase(i);
+        else
+            ++i;
+    }
+}
@@ -0,0 +1,265 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+#include "parser.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <cstdint>
+
+namespace iat {
+    //Values are stored in equation bundles; EquationBundle::VERSION goes up
+    //when they change
+    enum class OpCode : unsigned char
+    {
+        //VAR_PARAMETER reads the parameter whose index is in value, VAR_Y
+        //the Y of a heatmap pixel
+        CONST, VAR_X, VAR_T, VAR_PARAMETER, VAR_Y,
+        //binary
+        ADD, SUB, MUL_EXP10, MUL, DIV, POW, MOD, LE, GE, LT, GT, EQ, NE,
+        AND, OR, XOR,
+        //unary
+        EXP10, PLUS, NEG, NOT, FACTORIAL, INV, SIGN, ABS, CBRT, SQRT, SQR,
+        CUBE, GRADTORAD, RADTOGRAD, EXP, LN, LOG2, LOG8, LOG10, LOG16, SIN,
+        COS, TG, CTG, SECANS, CSECANS, ARCSIN, ARCCOS, ARCTG, ARCCTG,
+        ARCSECANS, ARCCSECANS, SH, CH, TH, CTH, SECH, CSECH, ARCSH, ARCCH,
+        ARCTH, ARCCTH, ARCSECH, ARCCSECH
+    };
+
+    struct Instruction
+    {
+        OpCode op;
+        int a;
+        int b;
+        double value;
+    };
+
+    struct SyntaxNode
+    {
+        std::string token;
+        std::vector<SyntaxNode> args;
+    };
+
+    //Bits of Program::dependencies(): X, T, Y, then one per parameter, the
+    //one of parameter i being DEPENDS_ON_PARAMETER << i
+    enum : uint64_t
+    {
+        DEPENDS_ON_X = 1, DEPENDS_ON_T = 2, DEPENDS_ON_Y = 4, DEPENDS_ON_PARAMETER = 8
+    };
+
+    //"param name = value [min max]", a number that can be changed while the
+    //equations are shown, e.g. with a slider
+    struct Parameter
+    {
+        std::string name;
+        double value;
+        double min;
+        double max;
+    };
+
+    //A named constant or function; the body refers to parameter i as "#i"
+    struct Definition
+    {
+        size_t parameters;
+        SyntaxNode body;
+    };
+
+    //An expression compiled once into straight-line code, so that it can be
+    //evaluated for many arguments without parsing it again. Instruction i
+    //stores its result in slot i, its operands refer to earlier slots.
+    //Evaluation reports the same errors as Parser::calculateExpression().
+    class Program
+    {
+    public:
+        //Parameter i is read from parameters[i]; without parameters the
+        //values they were declared with are used
+        double evaluate(double x, double t = 0, const double *parameters = nullptr) const;
+        //The same at the point (x, y)
+        double evaluateAt(double x, double y, double t = 0,
+                          const double *parameters = nullptr) const;
+        //The same in long double, for arguments closer together than double
+        //tells apart; slower, and no more precise where long double is double
+        long double evaluateExtended(long double x, double t = 0,
+                                     const double *parameters = nullptr) const;
+        //Runs every instruction over all count arguments before the next
+        //one. outputs[i] receives the values of output i; a null output is
+        //not computed, nor is anything only it needs.
+        void evaluate(const double *xs, size_t count, double *const *outputs,
+                      double t = 0, const double *parameters = nullptr) const;
+        //The same at the points (xs[k], ys[k]); without ys Y is 0
+        void evaluate(const double *xs, const double *ys, size_t count,
+                      double *const *outputs, double t = 0,
+                      const double *parameters = nullptr) const;
+        const std::vector<Instruction> &code() const;
+        const std::string &angleUnit() const;
+        size_t outputs() const;
+        //Slot of output i
+        int output(size_t i) const;
+        //Values the parameters were declared with
+        const std::vector<double> &parameters() const;
+        //True if the first output uses the time variable T
+        bool dependsOnTime() const;
+        //DEPENDS_ON_* bits of what the first output uses
+        uint64_t dependencies() const;
+        //Set when the expression was compiled together with others: the
+        //group computes all of them, common subexpressions once, and this
+        //program is output groupOutput() of it
+        const std::shared_ptr<const Program> &group() const;
+        int groupOutput() const;
+        //A program from code compiled earlier, e.g. read from an equation
+        //bundle. Throws ErrorParser unless every operation is known, every
+        //operand an earlier slot and every output a slot.
+        static Program fromCode(std::vector<Instruction> code, std::vector<int> outputs,
+                                const std::string &angleUnit, std::vector<double> parameters,
+                                std::shared_ptr<const Program> group = nullptr,
+                                int groupOutput = -1);
+    private:
+        friend class Compiler;
+        friend class ProgramCache;
+        friend class AnimationSampler;
+        enum
+        {
+            INLINE_SLOTS = 64
+        };
+        std::vector<Instruction> m_code;
+        std::vector<int> m_outputs;
+        std::string m_angleUnit;
+        double m_angleFactor{1};
+        //Declared values of the parameters
+        std::vector<double> m_parameters;
+        std::shared_ptr<const Program> m_group;
+        int m_groupOutput{-1};
+        template<typename Real>
+        Real execute(const Instruction &in, const Real *slots, Real x, double y, double t,
+                     const double *parameters) const;
+    };
+
+    //Evaluates a program that uses T or parameters for a fixed set of X
+    //values, frame after frame. Every instruction keeps its result and is
+    //run again only when T or a parameter it depends on changed, so parts
+    //that depend on X only are computed once for the set, and moving one
+    //parameter recomputes only what uses it.
+    class AnimationSampler
+    {
+    public:
+        AnimationSampler(std::shared_ptr<const Program> program, std::vector<double> xs);
+        const std::shared_ptr<const Program> &program() const;
+        const std::vector<double> &xs() const;
+        //Moves to another X set; the buffers are kept, so a pan allocates
+        //nothing once they are large enough
+        void setXs(const std::vector<double> &xs);
+        //Values that fail to evaluate are NaN
+        void evaluate(double t, const double *parameters, std::vector<double> &ys);
+        //Instructions run for every X and frame
+        size_t mixedInstructions() const;
+        //Instructions the last evaluate() ran
+        size_t recomputed() const;
+    private:
+        std::shared_ptr<const Program> m_program;
+        std::vector<double> m_xs;
+        std::vector<uint64_t> m_dependencies;
+        std::vector<bool> m_needed;
+        //Per instruction a column of values for the X set or a single value
+        std::vector<std::vector<double>> m_columns;
+        std::vector<double> m_scalars;
+        //T and parameters of the last evaluate(); the first one runs all
+        bool m_isEvaluated{false};
+        double m_time{0};
+        std::vector<double> m_parameters;
+        size_t m_recomputed{0};
+        void run(size_t i, double t, const double *parameters);
+    };
+
+    //Same grammar and operator priorities as Parser, but the variable X and
+    //the constants P, E and G stay symbolic instead of being substituted
+    //into the text. The time variable T, the Y of heatmaps and parameters
+    //are known only here.
+    //Named constants and functions are inlined, operations on constants
+    //folded and repeated subexpressions computed once.
+    class Compiler
+    {
+    public:
+        enum
+        {
+            //One DEPENDS_ON_* bit each
+            MAX_PARAMETERS = 61
+        };
+        explicit Compiler(const std::string &angleUnit = "radian");
+        //"name = body" or "name(a, b) = body"; a single '=' tells a
+        //definition from a comparison
+        static bool isDefinition(const std::string &line);
+        //The name may be used by later definitions and expressions. Throws
+        //ErrorParser for a malformed definition or a name already in use.
+        void define(const std::string &definition);
+        static bool isParameter(const std::string &line);
+        //Throws ErrorParser if the line is malformed or the range empty
+        static Parameter parseParameter(const std::string &line);
+        //Parameters get indices in the order they are declared. Throws
+        //ErrorParser for a name already in use or too many parameters.
+        void declare(const Parameter &parameter);
+        std::vector<std::string> tokenize(const std::string &input) const;
+        SyntaxNode parse(const std::vector<std::string> &tokens) const;
+        SyntaxNode parse(const std::string &input) const;
+        Program compile(const SyntaxNode &tree) const;
+        Program compile(const std::string &input) const;
+        //One program with an output per tree
+        Program compile(const std::vector<SyntaxNode> &trees) const;
+    private:
+        //Emitted instructions by operation, operands and constant bits
+        using Emitted = std::map<std::tuple<int, int, int, uint64_t>, int>;
+        std::string m_angleUnit;
+        std::map<std::string, Definition> m_definitions;
+        //Names of the declared parameters by index, and their values
+        std::vector<std::string> m_declared;
+        std::vector<double> m_declaredValues;
+        //Parameters of the definition being parsed
+        std::vector<std::string> m_parameters;
+        bool isName(const std::string &name) const;
+        size_t matchName(const char *p) const;
+        SyntaxNode parseUnaryExpression(const std::vector<std::string> &tokens,
+                                        size_t &pos) const;
+        SyntaxNode parseBinaryExpression(const std::vector<std::string> &tokens,
+                                         size_t &pos, int minPriority) const;
+        int emit(Program &program, const SyntaxNode &node, const std::vector<int> &arguments,
+                 Emitted &emitted) const;
+        int append(Program &program, Instruction in, Emitted &emitted) const;
+        static void compact(Program &program);
+    };
+
+    //Thread safe pool of compiled expressions keyed by text and angle unit,
+    //shared by everything that plots the same equations. The pool does not
+    //keep programs alive: an entry lasts as long as some view holds its
+    //programs, and is dropped on a later lookup once none does.
+    class ProgramCache
+    {
+    public:
+        std::shared_ptr<const Program> get(const std::string &expression,
+                                           const std::string &angleUnit);
+        //Programs of the expressions of one equations file, compiled with its
+        //definitions and parameter declarations, in file order, and linked to
+        //one group program
+        std::vector<std::shared_ptr<const Program>> get(
+                const std::vector<std::string> &expressions,
+                const std::vector<std::string> &definitions, const std::string &angleUnit);
+        //Adds programs compiled earlier for what get() would compile
+        void insert(const std::vector<std::string> &expressions,
+                    const std::vector<std::string> &definitions, const std::string &angleUnit,
+                    std::vector<std::shared_ptr<const Program>> programs);
+        //Programs still held somewhere
+        size_t size() const;
+    private:
+        using GroupKey = std::tuple<std::vector<std::string>, std::vector<std::string>,
+                                    std::string>;
+        mutable std::mutex m_mutex;
+        std::map<std::pair<std::string, std::string>, std::weak_ptr<const Program>> m_programs;
+        std::map<GroupKey, std::vector<std::weak_ptr<const Program>>> m_groups;
+
+        //Called with m_mutex held
+        void dropExpired();
+    };
+}
+
+#endif // COMPILER_H
@@ -0,0 +1,76 @@
+#include "curvebounds.h"
+#include <algorithm>
+#include <cmath>
+
+bool CurveBounds::Box::intersects(double xmin, double xmax, double ymin, double ymax) const
+{
+    return Xmin <= xmax && Xmax >= xmin && Ymin <= ymax && Ymax >= ymin;
+}
+
+void CurveBounds::build(const std::vector<std::pair<double, double>> &line)
+{
+    m_size = line.size();
+    m_chunks.clear();
+    m_isEmpty = true;
+    m_total = {INFINITY, -INFINITY, INFINITY, -INFINITY};
+    if(line.size() < 2)
+        return;
+    //Chunk c holds the segments starting at points [c * CHUNK_SIZE, (c + 1) * CHUNK_SIZE),
+    //so its box includes the first point of the next chunk as well
+    for(size_t first = 0; first + 1 < line.size(); first += CHUNK_SIZE)
+    {
+        const size_t last = std::min(line.size(), first + CHUNK_SIZE + 1);
+        Box box {INFINITY, -INFINITY, INFINITY, -INFINITY};
+        for(size_t i = first; i < last; ++i)
+        {
+            const double x = line[i].first, y = line[i].second;
+            if(!std::isfinite(x) || !std::isfinite(y))
+                continue;
+            box.Xmin = std::min(box.Xmin, x);
+            box.Xmax = std::max(box.Xmax, x);
+            box.Ymin = std::min(box.Ymin, y);
+            box.Ymax = std::max(box.Ymax, y);
+        }
+        m_chunks.push_back(box);
+        m_total.Xmin = std::min(m_total.Xmin, box.Xmin);
+        m_total.Xmax = std::max(m_total.Xmax, box.Xmax);
+        m_total.Ymin = std::min(m_total.Ymin, box.Ymin);
+        m_total.Ymax = std::max(m_total.Ymax, box.Ymax);
+    }
+    //A curve that failed to evaluate everywhere has nothing to draw
+    m_isEmpty = !(m_total.Xmin <= m_total.Xmax);
+}
+
+bool CurveBounds::intersects(double Xmin, double Xmax, double Ymin, double Ymax) const
+{
+    return !m_isEmpty && m_total.intersects(Xmin, Xmax, Ymin, Ymax);
+}
+
+bool CurveBounds::empty() const
+{
+    return m_isEmpty;
+}
+
+const CurveBounds::Box &CurveBounds::box() const
+{
+    return m_total;
+}
+
+void CurveBounds::visibleRanges(double Xmin, double Xmax, double Ymin, double Ymax,
+                                std::vector<std::pair<size_t, size_t>> &ranges) const
+{
+    ranges.clear();
+    if(!intersects(Xmin, Xmax, Ymin, Ymax))
+        return;
+    for(size_t c = 0; c < m_chunks.size(); ++c)
+    {
+        if(!m_chunks[c].intersects(Xmin, Xmax, Ymin, Ymax))
+            continue;
+        const size_t first = c * CHUNK_SIZE;
+        const size_t last = std::min(m_size, first + CHUNK_SIZE + 1);
+        if(!ranges.empty() && ranges.back().second == first + 1)
+            ranges.back().second = last;
+        else
+            ranges.emplace_back(first, last);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef CURVEBOUNDS_H
+#define CURVEBOUNDS_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+//World space bounding boxes of a sampled curve: one for every chunk of
+//CHUNK_SIZE segments and one for the whole curve. Drawing walks only the
+//chunks that meet the viewport, and skips the curve when its box does not.
+//Samples that are not finite are left out of the boxes.
+class CurveBounds
+{
+public:
+    struct Box
+    {
+        double Xmin, Xmax, Ymin, Ymax;
+        bool intersects(double xmin, double xmax, double ymin, double ymax) const;
+    };
+    void build(const std::vector<std::pair<double, double>> &line);
+    bool intersects(double Xmin, double Xmax, double Ymin, double Ymax) const;
+    bool empty() const;
+    //Box of the whole curve, meaningless when empty()
+    const Box &box() const;
+    //Point ranges [first, last) whose segments may meet the rectangle;
+    //neighbouring chunks are merged into one range
+    void visibleRanges(double Xmin, double Xmax, double Ymin, double Ymax,
+                       std::vector<std::pair<size_t, size_t>> &ranges) const;
+private:
+    enum
+    {
+        CHUNK_SIZE = 256
+    };
+    std::vector<Box> m_chunks;
+    Box m_total;
+    size_t m_size{0};
+    bool m_isEmpty{true};
+};
+
+#endif // CURVEBOUNDS_H
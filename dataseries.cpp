@@ -0,0 +1,263 @@
+#include "dataseries.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    const char INDEX_MAGIC[8] = {'T', 'E', 'S', 'E', 'R', 'I', 'E', 'S'};
+
+    //strtod needs a terminated string, a mapped file is not terminated
+    bool parseNumber(const char *&p, const char *end, double &value)
+    {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == ';'))
+            ++p;
+        char buffer[64];
+        size_t length = 0;
+        while(p < end && length + 1 < sizeof(buffer) && *p != '\n' && *p != '\r' &&
+              *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+            buffer[length++] = *p++;
+        buffer[length] = 0;
+        char *parsed;
+        value = strtod(buffer, &parsed);
+        return length > 0 && *parsed == 0;
+    }
+}
+
+DataSeries::DataSeries(const std::string &pathToFile)
+{
+    uint64_t size, mtime;
+    if(!MappedFile::stat(pathToFile, size, mtime))
+        throw std::runtime_error("Could not find data series " + pathToFile);
+    const std::string pathToIndex = pathToFile + ".idx";
+    if(!openIndex(pathToIndex, size, mtime))
+    {
+        buildIndex(pathToFile, pathToIndex, size, mtime);
+        if(!openIndex(pathToIndex, size, mtime))
+            throw std::runtime_error("Could not index data series " + pathToFile);
+    }
+    const IndexHeader *header = static_cast<const IndexHeader*>(m_index.data());
+    if(header->pointsOffset == 0)
+    {
+        m_source = MappedFile(pathToFile);
+        m_points = static_cast<const double*>(m_source.data());
+    }
+    else
+    {
+        m_points = reinterpret_cast<const double*>(
+                    static_cast<const char*>(m_index.data()) + header->pointsOffset);
+    }
+}
+
+size_t DataSeries::size() const
+{
+    return m_count;
+}
+
+void DataSeries::sample(double Xmin, double Xmax, int pixels,
+                        std::vector<std::pair<double, double>> &out) const
+{
+    out.clear();
+    if(m_count == 0 || pixels <= 0)
+        return;
+    //Binary search over the x values, which sit at the even positions
+    size_t lo = 0, hi = m_count;
+    while(lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if(x(mid) < Xmin) lo = mid + 1; else hi = mid;
+    }
+    size_t begin = lo > 0 ? lo - 1 : 0;
+    lo = begin;
+    hi = m_count;
+    while(lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if(x(mid) <= Xmax) lo = mid + 1; else hi = mid;
+    }
+    size_t end = std::min(m_count, lo + 1);
+    const size_t visible = end - begin;
+    if(visible <= size_t(2 * pixels))
+    {
+        for(size_t i = begin; i < end; ++i)
+            out.emplace_back(x(i), y(i));
+        return;
+    }
+    //Fewer than BUCKET_SIZE points per pixel: the summaries are too coarse,
+    //the points themselves are reduced to a pair per pixel
+    if(visible < size_t(BUCKET_SIZE) * pixels || m_levels.empty())
+    {
+        reducePerPixel(begin, end, Xmin, Xmax, pixels, [this](size_t i)
+        {
+            return std::make_pair(x(i), y(i));
+        }, out);
+        return;
+    }
+    //Coarsest level whose buckets still hold at most visible / pixels points
+    size_t level = 0, bucket = BUCKET_SIZE;
+    while(level + 1 < m_levels.size() && bucket * FANOUT <= visible / pixels)
+    {
+        ++level;
+        bucket *= FANOUT;
+    }
+    const Summary *summaries = m_levels[level];
+    const size_t last = std::min(m_levelSizes[level], (end - 1) / bucket + 1);
+    for(size_t b = begin / bucket; b < last; ++b)
+    {
+        const Summary &s = summaries[b];
+        const double center = (s.Xmin + s.Xmax) / 2;
+        out.emplace_back(center, s.Ymin);
+        out.emplace_back(center, s.Ymax);
+    }
+}
+
+bool DataSeries::isRaw(const std::string &pathToFile)
+{
+    std::string ext = pathToFile.substr(pathToFile.find_last_of('.') + 1);
+    return ext == "bin" || ext == "raw";
+}
+
+bool DataSeries::openIndex(const std::string &pathToIndex, uint64_t sourceSize,
+                           uint64_t sourceMtime)
+{
+    uint64_t size, mtime;
+    if(!MappedFile::stat(pathToIndex, size, mtime) || size < sizeof(IndexHeader))
+        return false;
+    m_index = MappedFile(pathToIndex);
+    const IndexHeader *header = static_cast<const IndexHeader*>(m_index.data());
+    if(memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+       header->version != VERSION || header->sourceSize != sourceSize ||
+       header->sourceMtime != sourceMtime || header->levels > MAX_LEVELS)
+        return false;
+    m_count = header->count;
+    m_levels.clear();
+    m_levelSizes.clear();
+    const char *base = static_cast<const char*>(m_index.data());
+    for(uint32_t i = 0; i < header->levels; ++i)
+    {
+        if(header->levelOffset[i] + header->levelSize[i] * sizeof(Summary) > size)
+            return false;
+        m_levels.push_back(reinterpret_cast<const Summary*>(base + header->levelOffset[i]));
+        m_levelSizes.push_back(header->levelSize[i]);
+    }
+    return true;
+}
+
+void DataSeries::buildIndex(const std::string &pathToFile, const std::string &pathToIndex,
+                            uint64_t sourceSize, uint64_t sourceMtime)
+{
+    AtomicFileWriter file(pathToIndex);
+    if(!file.isOpen())
+        throw std::runtime_error("Could not write index " + pathToIndex);
+    std::ofstream &fo = file.stream();
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = VERSION;
+    header.sourceSize = sourceSize;
+    header.sourceMtime = sourceMtime;
+    fo.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<Summary> summaries;
+    Summary current {0, 0, 0, 0};
+    double lastX = -INFINITY;
+    uint64_t count = 0;
+    auto add = [&](double x, double y)
+    {
+        if(x < lastX)
+            throw std::runtime_error("Data series is not sorted by X: " + pathToFile);
+        lastX = x;
+        if(count % BUCKET_SIZE == 0)
+            current = {x, x, y, y};
+        current.Xmax = x;
+        current.Ymin = std::min(current.Ymin, y);
+        current.Ymax = std::max(current.Ymax, y);
+        if(++count % BUCKET_SIZE == 0)
+            summaries.push_back(current);
+    };
+
+    MappedFile source(pathToFile);
+    if(isRaw(pathToFile))
+    {
+        const double *p = static_cast<const double*>(source.data());
+        const size_t n = source.size() / (2 * sizeof(double));
+        for(size_t i = 0; i < n; ++i)
+            add(p[2 * i], p[2 * i + 1]);
+    }
+    else
+    {
+        header.pointsOffset = sizeof(header);
+        std::vector<double> chunk;
+        chunk.reserve(WRITE_CHUNK);
+        const char *p = static_cast<const char*>(source.data());
+        const char *end = p + source.size();
+        while(p < end)
+        {
+            double x, y;
+            //Lines that are not two numbers, such as a header, are skipped
+            if(parseNumber(p, end, x) && parseNumber(p, end, y))
+            {
+                add(x, y);
+                chunk.push_back(x);
+                chunk.push_back(y);
+                if(chunk.size() >= WRITE_CHUNK)
+                {
+                    fo.write(reinterpret_cast<const char*>(chunk.data()),
+                             chunk.size() * sizeof(double));
+                    chunk.clear();
+                }
+            }
+            while(p < end && *p != '\n')
+                ++p;
+            ++p;
+        }
+        fo.write(reinterpret_cast<const char*>(chunk.data()), chunk.size() * sizeof(double));
+    }
+    if(count % BUCKET_SIZE != 0)
+        summaries.push_back(current);
+    header.count = count;
+
+    //Every level merges FANOUT buckets of the level below
+    uint64_t offset = sizeof(header) + (header.pointsOffset ? count * 2 * sizeof(double) : 0);
+    while(!summaries.empty() && header.levels < MAX_LEVELS)
+    {
+        header.levelOffset[header.levels] = offset;
+        header.levelSize[header.levels] = summaries.size();
+        ++header.levels;
+        fo.write(reinterpret_cast<const char*>(summaries.data()),
+                 summaries.size() * sizeof(Summary));
+        offset += summaries.size() * sizeof(Summary);
+        if(summaries.size() == 1)
+            break;
+        std::vector<Summary> merged;
+        for(size_t i = 0; i < summaries.size(); i += FANOUT)
+        {
+            Summary s = summaries[i];
+            for(size_t j = i + 1; j < std::min(summaries.size(), i + FANOUT); ++j)
+            {
+                s.Xmax = summaries[j].Xmax;
+                s.Ymin = std::min(s.Ymin, summaries[j].Ymin);
+                s.Ymax = std::max(s.Ymax, summaries[j].Ymax);
+            }
+            merged.push_back(s);
+        }
+        summaries.swap(merged);
+    }
+    fo.seekp(0);
+    fo.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if(!file.commit())
+        throw std::runtime_error("Could not write index " + pathToIndex);
+}
+
+double DataSeries::x(size_t i) const
+{
+    return m_points[2 * i];
+}
+
+double DataSeries::y(size_t i) const
+{
+    return m_points[2 * i + 1];
+}
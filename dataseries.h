@@ -0,0 +1,106 @@
+#ifndef DATASERIES_H
+#define DATASERIES_H
+
+#include "mappedfile.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+
+//Measured (x, y) samples sorted by x, read from a memory-mapped file.
+//A raw file (.bin, .raw) holds native-endian double pairs; any other file is
+//parsed as CSV with one "x,y" pair per line. A sidecar index next to the
+//file (<file>.idx) stores a min/max summary pyramid, and for CSV also the
+//binary points. It is built once and rebuilt when the file changes, so any
+//viewport is reduced to O(pixels) vertices without reading the whole file.
+class DataSeries
+{
+public:
+    explicit DataSeries(const std::string &pathToFile);
+    size_t size() const;
+    //Points of [Xmin, Xmax] plus one neighbour on each side; dense ranges
+    //are reduced to about a min/max pair per pixel, from the points or from
+    //summary buckets no wider than a pixel
+    void sample(double Xmin, double Xmax, int pixels,
+                std::vector<std::pair<double, double>> &out) const;
+    //The lowest and the highest of points [begin, end), read with point(i),
+    //in every pixel column of [Xmin, Xmax], in the order they come. The
+    //first and the last point, the neighbours outside, are kept as they are.
+    template<typename Index, typename PointAt>
+    static void reducePerPixel(Index begin, Index end, double Xmin, double Xmax, int pixels,
+                               PointAt point, std::vector<std::pair<double, double>> &out);
+private:
+    enum
+    {
+        VERSION = 1,
+        BUCKET_SIZE = 64,
+        FANOUT = 4,
+        MAX_LEVELS = 16,
+        WRITE_CHUNK = 1 << 16
+    };
+    struct Summary
+    {
+        double Xmin, Xmax, Ymin, Ymax;
+    };
+    struct IndexHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t levels;
+        uint64_t sourceSize;
+        uint64_t sourceMtime;
+        uint64_t count;
+        //Zero when the points are read from the raw source file itself
+        uint64_t pointsOffset;
+        uint64_t levelOffset[MAX_LEVELS];
+        uint64_t levelSize[MAX_LEVELS];
+    };
+    MappedFile m_source;
+    MappedFile m_index;
+    const double *m_points{nullptr};
+    size_t m_count{0};
+    std::vector<const Summary*> m_levels;
+    std::vector<size_t> m_levelSizes;
+
+    static bool isRaw(const std::string &pathToFile);
+    bool openIndex(const std::string &pathToIndex, uint64_t sourceSize, uint64_t sourceMtime);
+    static void buildIndex(const std::string &pathToFile, const std::string &pathToIndex,
+                           uint64_t sourceSize, uint64_t sourceMtime);
+    double x(size_t i) const;
+    double y(size_t i) const;
+};
+
+template<typename Index, typename PointAt>
+void DataSeries::reducePerPixel(Index begin, Index end, double Xmin, double Xmax, int pixels,
+                                PointAt point, std::vector<std::pair<double, double>> &out)
+{
+    if(begin == end)
+        return;
+    out.push_back(point(begin));
+    const double scale = Xmax > Xmin ? pixels / (Xmax - Xmin) : 0;
+    Index i = begin + 1;
+    while(i + 1 < end)
+    {
+        const double column = std::floor((point(i).first - Xmin) * scale);
+        std::pair<double, double> low = point(i), high = low;
+        for(++i; i + 1 < end && std::floor((point(i).first - Xmin) * scale) == column; ++i)
+        {
+            const std::pair<double, double> p = point(i);
+            if(p.second < low.second)
+                low = p;
+            if(p.second > high.second)
+                high = p;
+        }
+        if(high.first < low.first)
+            std::swap(low, high);
+        out.push_back(low);
+        if(high != low)
+            out.push_back(high);
+    }
+    if(i < end)
+        out.push_back(point(i));
+}
+
+#endif // DATASERIES_H
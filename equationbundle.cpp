@@ -0,0 +1,238 @@
+#include "equationbundle.h"
+#include "mappedfile.h"
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <stdexcept>
+
+namespace
+{
+    const char BUNDLE_MAGIC[8] = {'T', 'E', 'S', 'D', 'L', 'E', 'Q', 'B'};
+
+    template<typename T>
+    void writeRecords(std::ofstream &fo, const std::vector<T> &records)
+    {
+        fo.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+    }
+}
+
+bool EquationBundle::isBundle(const std::string &pathToFile)
+{
+    std::ifstream fi(pathToFile, std::ios::binary);
+    char magic[sizeof(BUNDLE_MAGIC)];
+    return fi.read(magic, sizeof(magic)) && memcmp(magic, BUNDLE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool EquationBundle::isMadeFrom(const std::string &pathToFile, uint64_t sourceSize,
+                                uint64_t sourceMtime)
+{
+    std::ifstream fi(pathToFile, std::ios::binary);
+    Header header;
+    return fi.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+            memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) == 0 &&
+            header.version == VERSION && header.sourceSize == sourceSize &&
+            header.sourceMtime == sourceMtime;
+}
+
+EquationBundle::Contents EquationBundle::read(const std::string &pathToFile)
+{
+    static_assert(sizeof(Header) == 80 && sizeof(EntryRecord) == 16 &&
+                  sizeof(ProgramRecord) == 48 && sizeof(InstructionRecord) == 24,
+                  "bundle records must not be padded");
+    MappedFile file(pathToFile);
+    const char *base = static_cast<const char*>(file.data());
+    const size_t size = file.size();
+    auto damaged = [&pathToFile]()
+    {
+        return std::runtime_error("Equations bundle " + pathToFile + " is damaged");
+    };
+    if(size < sizeof(Header))
+        throw damaged();
+    const Header *header = reinterpret_cast<const Header*>(base);
+    if(memcmp(header->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0 ||
+       header->version != VERSION)
+        throw std::runtime_error(pathToFile + " is not an equations bundle of version " +
+                                 std::to_string(VERSION));
+    //Every count is checked against the bytes left before it is used, so
+    //the offsets cannot overflow
+    uint64_t offset = sizeof(Header);
+    auto section = [&](uint64_t count, size_t recordSize)
+    {
+        if(count > (size - offset) / recordSize)
+            throw damaged();
+        const char *records = base + offset;
+        offset += count * recordSize;
+        return records;
+    };
+    const EntryRecord *entries = reinterpret_cast<const EntryRecord*>(
+                section(header->entryCount, sizeof(EntryRecord)));
+    const StringRef *definitions = reinterpret_cast<const StringRef*>(
+                section(header->definitionCount, sizeof(StringRef)));
+    const ProgramRecord *programs = reinterpret_cast<const ProgramRecord*>(
+                section(header->programCount, sizeof(ProgramRecord)));
+    const InstructionRecord *instructions = reinterpret_cast<const InstructionRecord*>(
+                section(header->instructionCount, sizeof(InstructionRecord)));
+    const double *parameters = reinterpret_cast<const double*>(
+                section(header->parameterCount, sizeof(double)));
+    const int32_t *outputs = reinterpret_cast<const int32_t*>(
+                section(header->outputCount, sizeof(int32_t)));
+    const char *strings = section(header->stringsSize, 1);
+    auto string = [&](const StringRef &ref)
+    {
+        if(uint64_t(ref.offset) + ref.size > header->stringsSize)
+            throw damaged();
+        return std::string(strings + ref.offset, ref.size);
+    };
+    auto inRange = [](uint64_t first, uint64_t count, uint64_t total)
+    {
+        return first <= total && count <= total - first;
+    };
+
+    Contents contents;
+    contents.angleUnit = string(header->angleUnit);
+    contents.sourceSize = header->sourceSize;
+    contents.sourceMtime = header->sourceMtime;
+    for(uint32_t i = 0; i < header->definitionCount; ++i)
+        contents.definitions.push_back(string(definitions[i]));
+    //The bytecode was checked when it was compiled; here it is only checked
+    //to be well formed, so a damaged file cannot make evaluation read out of
+    //bounds
+    std::vector<std::shared_ptr<const iat::Program>> compiled;
+    for(uint32_t i = 0; i < header->programCount; ++i)
+    {
+        const ProgramRecord &record = programs[i];
+        if(!inRange(record.firstInstruction, record.instructionCount,
+                    header->instructionCount) ||
+           !inRange(record.firstParameter, record.parameterCount, header->parameterCount) ||
+           !inRange(record.firstOutput, record.outputCount, header->outputCount) ||
+           record.group < -1 || record.group >= int32_t(i))
+            throw damaged();
+        std::vector<iat::Instruction> code(record.instructionCount);
+        for(size_t k = 0; k < code.size(); ++k)
+        {
+            const InstructionRecord &in = instructions[record.firstInstruction + k];
+            code[k] = {iat::OpCode(in.op), in.a, in.b, in.value};
+        }
+        try
+        {
+            compiled.push_back(std::make_shared<const iat::Program>(iat::Program::fromCode(
+                    std::move(code),
+                    std::vector<int>(outputs + record.firstOutput,
+                                     outputs + record.firstOutput + record.outputCount),
+                    contents.angleUnit,
+                    std::vector<double>(parameters + record.firstParameter,
+                                        parameters + record.firstParameter +
+                                        record.parameterCount),
+                    record.group >= 0 ? compiled[record.group] : nullptr,
+                    record.groupOutput)));
+        }
+        catch(iat::ErrorParser &)
+        {
+            throw damaged();
+        }
+    }
+    for(uint32_t i = 0; i < header->entryCount; ++i)
+    {
+        const EntryRecord &entry = entries[i];
+        if(entry.program < -1 || entry.program >= int32_t(header->programCount))
+            throw damaged();
+        contents.expressions.push_back(string(entry.text));
+        contents.colors.push_back({entry.color[0], entry.color[1], entry.color[2],
+                                   entry.color[3]});
+        contents.programs.push_back(entry.program >= 0 ? compiled[entry.program] : nullptr);
+    }
+    return contents;
+}
+
+void EquationBundle::write(const std::string &pathToFile, const Contents &contents)
+{
+    std::string strings;
+    auto addString = [&strings](const std::string &text)
+    {
+        const StringRef ref {uint32_t(strings.size()), uint32_t(text.size())};
+        strings += text;
+        return ref;
+    };
+    std::vector<EntryRecord> entries;
+    std::vector<StringRef> definitions;
+    std::vector<ProgramRecord> programs;
+    std::vector<InstructionRecord> instructions;
+    std::vector<double> parameters;
+    std::vector<int32_t> outputs;
+    //Programs shared by several entries, and groups, are written once
+    std::map<const iat::Program*, int32_t> indices;
+    std::function<int32_t(const iat::Program &)> addProgram =
+            [&](const iat::Program &program) -> int32_t
+    {
+        auto found = indices.find(&program);
+        if(found != indices.end())
+            return found->second;
+        ProgramRecord record;
+        memset(&record, 0, sizeof(record));
+        record.group = program.group() ? addProgram(*program.group()) : -1;
+        record.groupOutput = program.groupOutput();
+        record.firstInstruction = instructions.size();
+        record.instructionCount = program.code().size();
+        for(const auto &in: program.code())
+        {
+            InstructionRecord instruction;
+            memset(&instruction, 0, sizeof(instruction));
+            instruction.op = uint8_t(in.op);
+            instruction.a = in.a;
+            instruction.b = in.b;
+            instruction.value = in.value;
+            instructions.push_back(instruction);
+        }
+        record.firstParameter = parameters.size();
+        record.parameterCount = program.parameters().size();
+        parameters.insert(parameters.end(), program.parameters().begin(),
+                          program.parameters().end());
+        record.firstOutput = outputs.size();
+        record.outputCount = program.outputs();
+        for(size_t i = 0; i < program.outputs(); ++i)
+            outputs.push_back(program.output(i));
+        programs.push_back(record);
+        return indices[&program] = programs.size() - 1;
+    };
+    for(size_t i = 0; i < contents.expressions.size(); ++i)
+    {
+        EntryRecord entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.text = addString(contents.expressions[i]);
+        memcpy(entry.color, contents.colors[i].data(), sizeof(entry.color));
+        entry.program = contents.programs[i] ? addProgram(*contents.programs[i]) : -1;
+        entries.push_back(entry);
+    }
+    for(const auto &definition: contents.definitions)
+        definitions.push_back(addString(definition));
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    header.version = VERSION;
+    header.entryCount = entries.size();
+    header.sourceSize = contents.sourceSize;
+    header.sourceMtime = contents.sourceMtime;
+    header.angleUnit = addString(contents.angleUnit);
+    header.definitionCount = definitions.size();
+    header.programCount = programs.size();
+    header.instructionCount = instructions.size();
+    header.parameterCount = parameters.size();
+    header.outputCount = outputs.size();
+    header.stringsSize = strings.size();
+    AtomicFileWriter file(pathToFile);
+    if(!file.isOpen())
+        throw std::runtime_error("Could not write equations bundle " + pathToFile);
+    std::ofstream &fo = file.stream();
+    fo.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeRecords(fo, entries);
+    writeRecords(fo, definitions);
+    writeRecords(fo, programs);
+    writeRecords(fo, instructions);
+    writeRecords(fo, parameters);
+    writeRecords(fo, outputs);
+    fo.write(strings.data(), strings.size());
+    if(!file.commit())
+        throw std::runtime_error("Could not write equations bundle " + pathToFile);
+}
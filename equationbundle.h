@@ -0,0 +1,95 @@
+#ifndef EQUATIONBUNDLE_H
+#define EQUATIONBUNDLE_H
+
+#include "compiler.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//An equations file compiled ahead of time: the entries with their colors,
+//the definition lines and the checked, optimized bytecode of every
+//expression and of the groups they were compiled in. Loading maps the file
+//and copies its records out; nothing is tokenized or parsed. A bundle keeps
+//the size and modification time of the text it was made from, so a stale
+//one can be told apart.
+class EquationBundle
+{
+public:
+    enum
+    {
+        VERSION = 2
+    };
+    struct Contents
+    {
+        std::string angleUnit;
+        uint64_t sourceSize{0}, sourceMtime{0};
+        //Expression, data series or stream of every entry, in file order
+        std::vector<std::string> expressions;
+        std::vector<std::array<uint8_t, 4>> colors;
+        //Definition and parameter lines, in file order
+        std::vector<std::string> definitions;
+        //Per entry, null for data series and streams
+        std::vector<std::shared_ptr<const iat::Program>> programs;
+    };
+    //Only looks at the magic
+    static bool isBundle(const std::string &pathToFile);
+    //Only looks at the header; true for a bundle of this version made from
+    //the source of that size and modification time
+    static bool isMadeFrom(const std::string &pathToFile, uint64_t sourceSize,
+                           uint64_t sourceMtime);
+    //Throws std::runtime_error for a file that is not a bundle of this
+    //version or is damaged
+    static Contents read(const std::string &pathToFile);
+    //Renamed into place, so a concurrent reader sees the old bundle or the
+    //new one. Throws std::runtime_error if writing fails.
+    static void write(const std::string &pathToFile, const Contents &contents);
+private:
+    //Layout of the file, all records 8 byte aligned: header, entries,
+    //definitions, programs, instructions, parameters, outputs, strings
+    struct StringRef
+    {
+        uint32_t offset, size;
+    };
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint64_t sourceSize, sourceMtime;
+        StringRef angleUnit;
+        uint32_t definitionCount;
+        uint32_t programCount;
+        uint64_t instructionCount;
+        uint64_t parameterCount;
+        uint64_t outputCount;
+        uint64_t stringsSize;
+    };
+    struct EntryRecord
+    {
+        StringRef text;
+        uint8_t color[4];
+        //Index into the programs, -1 for data series and streams
+        int32_t program;
+    };
+    //A program's group comes before it
+    struct ProgramRecord
+    {
+        uint64_t firstInstruction, firstParameter, firstOutput;
+        uint32_t instructionCount, parameterCount, outputCount;
+        int32_t group, groupOutput;
+        uint32_t reserved;
+    };
+    struct InstructionRecord
+    {
+        uint8_t op;
+        uint8_t reserved[3];
+        int32_t a, b;
+        uint32_t reserved2;
+        double value;
+    };
+};
+
+#endif // EQUATIONBUNDLE_H
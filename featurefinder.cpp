@@ -0,0 +1,327 @@
+#include "featurefinder.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+#include <tuple>
+
+namespace
+{
+    //Relative precision of a located minimum; a smooth function is flat
+    //near its minimum, so sqrt(epsilon) is the best that can be told apart
+    const double MINIMUM_TOLERANCE = 1.5e-8;
+    //A refined zero must be this small relative to the bracket values,
+    //which rejects sign changes across poles such as those of tg(X)
+    const double ROOT_TOLERANCE = 1e-9;
+}
+
+FeatureFinder::FeatureFinder(int threads):
+    m_threads(threads)
+{
+    if(m_threads <= 0)
+        m_threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<FeatureFinder::Feature> FeatureFinder::find(const std::vector<Curve> &curves) const
+{
+    //Tasks are the curves first, then the pairs of compiled curves whose
+    //boxes overlap; workers take the next task until none are left
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for(size_t i = 0; i < curves.size(); ++i)
+    {
+        for(size_t j = i + 1; j < curves.size(); ++j)
+        {
+            const CurveBounds &a = *curves[i].bounds, &b = *curves[j].bounds;
+            if(curves[i].program && curves[j].program && !a.empty() && !b.empty() &&
+               a.box().intersects(b.box().Xmin, b.box().Xmax, b.box().Ymin, b.box().Ymax))
+                pairs.emplace_back(i, j);
+        }
+    }
+    const size_t tasks = curves.size() + pairs.size();
+    const int threads = std::max(1, int(std::min<size_t>(m_threads, tasks)));
+    std::vector<std::vector<Feature>> found(threads);
+    std::atomic<size_t> next {0};
+    auto worker = [&](int id)
+    {
+        for(size_t t = next++; t < tasks; t = next++)
+        {
+            if(t < curves.size())
+                findOnCurve(curves[t], found[id]);
+            else
+                findIntersections(curves[pairs[t - curves.size()].first],
+                                  curves[pairs[t - curves.size()].second], found[id]);
+        }
+    };
+    std::vector<std::thread> pool;
+    for(int id = 1; id < threads; ++id)
+        pool.emplace_back(worker, id);
+    worker(0);
+    for(auto &thread: pool)
+        thread.join();
+
+    std::vector<Feature> features;
+    for(const auto &part: found)
+        features.insert(features.end(), part.begin(), part.end());
+    std::sort(features.begin(), features.end(), [](const Feature &a, const Feature &b)
+    {
+        return std::make_tuple(a.curve, a.other, a.x) < std::make_tuple(b.curve, b.other, b.x);
+    });
+    return features;
+}
+
+void FeatureFinder::findOnCurve(const Curve &curve, std::vector<Feature> &out) const
+{
+    const auto &s = *curve.samples;
+    if(s.size() < 2)
+        return;
+    const Function f = [&curve](double x)
+    {
+        return evaluate(curve, x);
+    };
+    for(size_t i = 0; i + 1 < s.size(); ++i)
+    {
+        const double x0 = s[i].first, y0 = s[i].second;
+        const double x1 = s[i + 1].first, y1 = s[i + 1].second;
+        if(!std::isfinite(y0) || !std::isfinite(y1))
+            continue;
+        if(y0 == 0)
+        {
+            out.push_back({Kind::ROOT, x0, 0, curve.index, -1});
+        }
+        else if(y1 != 0 && (y0 < 0) != (y1 < 0))
+        {
+            //Measured series have no function between the samples
+            double x = curve.program ? brentRoot(f, x0, x1, y0, y1) :
+                                       x0 - y0 * (x1 - x0) / (y1 - y0);
+            if(std::isfinite(x) && (!curve.program ||
+                                    isRoot(f(x), std::min(fabs(y0), fabs(y1)))))
+                out.push_back({Kind::ROOT, x, 0, curve.index, -1});
+        }
+        if(i == 0 || !std::isfinite(s[i - 1].second))
+            continue;
+        const double before = y0 - s[i - 1].second, after = y1 - y0;
+        if(!((before > 0 && after < 0) || (before < 0 && after > 0)))
+            continue;
+        const bool isMaximum = before > 0;
+        double x = x0;
+        if(curve.program)
+        {
+            x = isMaximum ? brentMinimum([&f](double t) {return -f(t);}, s[i - 1].first, x1) :
+                            brentMinimum(f, s[i - 1].first, x1);
+        }
+        const double y = curve.program ? f(x) : y0;
+        if(std::isfinite(y))
+            out.push_back({isMaximum ? Kind::MAXIMUM : Kind::MINIMUM, x, y, curve.index, -1});
+    }
+    if(s.back().second == 0)
+        out.push_back({Kind::ROOT, s.back().first, 0, curve.index, -1});
+}
+
+void FeatureFinder::findIntersections(const Curve &a, const Curve &b,
+                                      std::vector<Feature> &out) const
+{
+    const auto &sa = *a.samples, &sb = *b.samples;
+    //Both curves come from the same sampling loop, so the grids agree
+    if(sa.size() != sb.size() || sa.size() < 2 || sa.front().first != sb.front().first)
+        return;
+    const Function g = [&a, &b](double x)
+    {
+        return evaluate(a, x) - evaluate(b, x);
+    };
+    for(size_t i = 0; i + 1 < sa.size(); ++i)
+    {
+        const double g0 = sa[i].second - sb[i].second;
+        const double g1 = sa[i + 1].second - sb[i + 1].second;
+        if(!std::isfinite(g0) || !std::isfinite(g1))
+            continue;
+        double x;
+        if(g0 == 0)
+        {
+            x = sa[i].first;
+        }
+        else if(g1 != 0 && (g0 < 0) != (g1 < 0))
+        {
+            x = brentRoot(g, sa[i].first, sa[i + 1].first, g0, g1);
+            if(!std::isfinite(x) || !isRoot(g(x), std::min(fabs(g0), fabs(g1))))
+                continue;
+        }
+        else
+        {
+            continue;
+        }
+        const double y = evaluate(a, x);
+        if(std::isfinite(y))
+            out.push_back({Kind::INTERSECTION, x, y, a.index, b.index});
+    }
+}
+
+double FeatureFinder::evaluate(const Curve &curve, double x)
+{
+    //Points where the expression is undefined end a bracket like a pole
+    try
+    {
+        if(curve.origin != 0)
+            return curve.program->evaluateExtended(curve.origin + x, curve.time,
+                                                   curve.parameters);
+        return curve.program->evaluate(x, curve.time, curve.parameters);
+    }
+    catch(std::exception &)
+    {
+        return NAN;
+    }
+}
+
+bool FeatureFinder::isRoot(double value, double scale)
+{
+    return fabs(value) <= ROOT_TOLERANCE * (1 + scale);
+}
+
+//Brent's method for a zero of f in [a, b] with f(a) and f(b) of opposite signs
+double FeatureFinder::brentRoot(const Function &f, double a, double b, double fa, double fb)
+{
+    double c = a, fc = fa, d = b - a, e = d;
+    for(int iteration = 0; iteration < MAX_ITERATIONS; ++iteration)
+    {
+        if((fb > 0) == (fc > 0))
+        {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+        if(fabs(fc) < fabs(fb))
+        {
+            a = b;
+            b = c;
+            c = a;
+            fa = fb;
+            fb = fc;
+            fc = fa;
+        }
+        const double tol = 2 * DBL_EPSILON * fabs(b);
+        const double m = (c - b) / 2;
+        if(fabs(m) <= tol || fb == 0)
+            return b;
+        if(fabs(e) >= tol && fabs(fa) > fabs(fb))
+        {
+            //Inverse quadratic interpolation, or secant when only two points differ
+            double p, q;
+            const double s = fb / fa;
+            if(a == c)
+            {
+                p = 2 * m * s;
+                q = 1 - s;
+            }
+            else
+            {
+                const double r = fb / fc;
+                q = fa / fc;
+                p = s * (2 * m * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            if(p > 0)
+                q = -q;
+            else
+                p = -p;
+            if(2 * p < std::min(3 * m * q - fabs(tol * q), fabs(e * q)))
+            {
+                e = d;
+                d = p / q;
+            }
+            else
+            {
+                d = e = m;
+            }
+        }
+        else
+        {
+            d = e = m;
+        }
+        a = b;
+        fa = fb;
+        b += fabs(d) > tol ? d : (m > 0 ? tol : -tol);
+        fb = f(b);
+        if(std::isnan(fb))
+            return NAN;
+    }
+    return b;
+}
+
+//Brent's method for a minimum of f in [a, b], golden section steps mixed
+//with parabolic interpolation
+double FeatureFinder::brentMinimum(const Function &f, double a, double b)
+{
+    const double golden = 0.3819660112501051;
+    double x = (a + b) / 2, w = x, v = x;
+    double fx = f(x), fw = fx, fv = fx;
+    double d = 0, e = 0;
+    for(int iteration = 0; iteration < MAX_ITERATIONS; ++iteration)
+    {
+        const double middle = (a + b) / 2;
+        const double tol1 = MINIMUM_TOLERANCE * fabs(x) + 1e-12;
+        const double tol2 = 2 * tol1;
+        if(fabs(x - middle) <= tol2 - (b - a) / 2)
+            break;
+        bool goldenStep = true;
+        if(fabs(e) > tol1)
+        {
+            double r = (x - w) * (fx - fv);
+            double q = (x - v) * (fx - fw);
+            double p = (x - v) * q - (x - w) * r;
+            q = 2 * (q - r);
+            if(q > 0)
+                p = -p;
+            q = fabs(q);
+            const double previous = e;
+            e = d;
+            if(fabs(p) < fabs(q * previous / 2) && p > q * (a - x) && p < q * (b - x))
+            {
+                d = p / q;
+                const double u = x + d;
+                if(u - a < tol2 || b - u < tol2)
+                    d = middle > x ? tol1 : -tol1;
+                goldenStep = false;
+            }
+        }
+        if(goldenStep)
+        {
+            e = x >= middle ? a - x : b - x;
+            d = golden * e;
+        }
+        const double u = fabs(d) >= tol1 ? x + d : x + (d > 0 ? tol1 : -tol1);
+        const double fu = f(u);
+        if(fu <= fx)
+        {
+            if(u >= x)
+                a = x;
+            else
+                b = x;
+            v = w;
+            w = x;
+            x = u;
+            fv = fw;
+            fw = fx;
+            fx = fu;
+        }
+        else
+        {
+            if(u < x)
+                a = u;
+            else
+                b = u;
+            if(fu <= fw || w == x)
+            {
+                v = w;
+                w = u;
+                fv = fw;
+                fw = fu;
+            }
+            else if(fu <= fv || v == x || v == w)
+            {
+                v = u;
+                fv = fu;
+            }
+        }
+    }
+    return x;
+}
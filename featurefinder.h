@@ -0,0 +1,59 @@
+#ifndef FEATUREFINDER_H
+#define FEATUREFINDER_H
+
+#include "compiler.h"
+#include "curvebounds.h"
+
+#include <vector>
+#include <utility>
+#include <functional>
+
+//Zeros, local extrema and pairwise intersections of compiled curves.
+//Candidates are bracketed on the samples the grapher already has (a sign
+//change of y, of the slope or of the difference of two curves) and refined
+//with Brent's methods on the compiled expressions. Curves and curve pairs
+//are spread over worker threads.
+class FeatureFinder
+{
+public:
+    enum class Kind {ROOT, MINIMUM, MAXIMUM, INTERSECTION};
+    struct Feature
+    {
+        Kind kind;
+        double x, y;
+        //Index of the curve; for an intersection also of the other one
+        int curve, other;
+    };
+    struct Curve
+    {
+        int index;
+        const iat::Program *program;
+        //World space samples on a common X grid
+        const std::vector<std::pair<double, double>> *samples;
+        const CurveBounds *bounds;
+        //Values of T and the parameters the samples were taken at
+        double time;
+        const double *parameters;
+        //Sample X are relative to this, see Grapher::updateOrigin()
+        long double origin;
+    };
+    //A zero or negative thread count means one per hardware thread
+    explicit FeatureFinder(int threads = 0);
+    std::vector<Feature> find(const std::vector<Curve> &curves) const;
+private:
+    enum
+    {
+        MAX_ITERATIONS = 100
+    };
+    using Function = std::function<double(double)>;
+    int m_threads;
+
+    void findOnCurve(const Curve &curve, std::vector<Feature> &out) const;
+    void findIntersections(const Curve &a, const Curve &b, std::vector<Feature> &out) const;
+    static double evaluate(const Curve &curve, double x);
+    static bool isRoot(double value, double scale);
+    static double brentRoot(const Function &f, double a, double b, double fa, double fb);
+    static double brentMinimum(const Function &f, double a, double b);
+};
+
+#endif // FEATUREFINDER_H
@@ -0,0 +1,80 @@
+#include "filewatcher.h"
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+FileWatcher::FileWatcher(std::function<void(const std::string&)> onChange):
+    m_onChange(onChange)
+{
+    //Without inotify the files are simply not watched
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_fd >= 0)
+        m_thread = std::thread(&FileWatcher::watchLoop, this);
+}
+
+FileWatcher::~FileWatcher()
+{
+    m_stop = true;
+    if(m_thread.joinable())
+        m_thread.join();
+    if(m_fd >= 0)
+        close(m_fd);
+}
+
+void FileWatcher::watch(const std::string &pathToFile)
+{
+    if(m_fd < 0)
+        return;
+    const size_t slash = pathToFile.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." :
+                                  slash == 0 ? "/" : pathToFile.substr(0, slash);
+    const std::string name = slash == std::string::npos ? pathToFile : pathToFile.substr(slash + 1);
+    //Adding a directory twice returns the same descriptor
+    int descriptor = inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if(descriptor < 0)
+        return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_watches.push_back({descriptor, name, pathToFile});
+}
+
+void FileWatcher::unwatchAll()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto &watch: m_watches)
+        inotify_rm_watch(m_fd, watch.descriptor);
+    m_watches.clear();
+}
+
+void FileWatcher::watchLoop()
+{
+    alignas(inotify_event) char buffer[EVENT_BUFFER];
+    while(!m_stop)
+    {
+        pollfd pfd {m_fd, POLLIN, 0};
+        if(poll(&pfd, 1, POLL_INTERVAL) <= 0)
+            continue;
+        ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if(length <= 0)
+            continue;
+        std::vector<std::string> changed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(char *p = buffer; p < buffer + length;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+                if(event->len == 0)
+                    continue;
+                for(const auto &watch: m_watches)
+                {
+                    if(watch.descriptor == event->wd && watch.name == event->name &&
+                       std::find(changed.begin(), changed.end(), watch.pathToFile) == changed.end())
+                        changed.push_back(watch.pathToFile);
+                }
+            }
+        }
+        for(const auto &pathToFile: changed)
+            m_onChange(pathToFile);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Reports changes of single files through inotify. The parent directory is
+//watched rather than the file itself, so editors that save by writing a new
+//file and renaming it over the old one are noticed as well.
+class FileWatcher
+{
+public:
+    //onChange is called from the watcher thread with the path given to watch()
+    explicit FileWatcher(std::function<void(const std::string&)> onChange);
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher &operator=(const FileWatcher&) = delete;
+    void watch(const std::string &pathToFile);
+    void unwatchAll();
+private:
+    enum
+    {
+        POLL_INTERVAL = 100,
+        EVENT_BUFFER = 4096
+    };
+    struct Watch
+    {
+        int descriptor;
+        std::string name;
+        std::string pathToFile;
+    };
+    std::function<void(const std::string&)> m_onChange;
+    int m_fd{-1};
+    std::mutex m_mutex;
+    std::vector<Watch> m_watches;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+
+    void watchLoop();
+};
+
+#endif // FILEWATCHER_H
@@ -0,0 +1,135 @@
+#include "glyphatlas.h"
+#include <algorithm>
+#include <stdexcept>
+
+GlyphAtlas::GlyphAtlas(TTF_Font *font)
+{
+    static const SDL_Color white {255, 255, 255, 255};
+    m_lineHeight = TTF_FontHeight(font);
+    std::vector<SDL_Surface*> rendered;
+    //Shelf packing: glyphs go left to right, a new row starts when the
+    //current one is full
+    int x = 0, y = 0, rowHeight = 0;
+    for(int ch = FIRST_CHAR; ch <= LAST_CHAR; ++ch)
+    {
+        Glyph g {{0, 0, 0, 0}, 0};
+        int minx, maxx, miny, maxy;
+        SDL_Surface *s = TTF_RenderGlyph_Blended(font, ch, white);
+        if(s && TTF_GlyphMetrics(font, ch, &minx, &maxx, &miny, &maxy, &g.advance) == 0)
+        {
+            if(x + s->w > ATLAS_WIDTH)
+            {
+                x = 0;
+                y += rowHeight + PADDING;
+                rowHeight = 0;
+            }
+            g.rect = {x, y, s->w, s->h};
+            x += s->w + PADDING;
+            rowHeight = std::max(rowHeight, s->h);
+        }
+        rendered.push_back(s);
+        m_glyphs.push_back(g);
+    }
+    m_surface = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, y + rowHeight, 32,
+                                               SDL_PIXELFORMAT_RGBA32);
+    if(!m_surface)
+    {
+        for(auto s: rendered)
+            SDL_FreeSurface(s);
+        throw std::runtime_error("Could not create glyph atlas: " +
+                                 std::string(SDL_GetError()));
+    }
+    SDL_FillRect(m_surface, NULL, 0);
+    for(unsigned int i = 0; i < rendered.size(); ++i)
+    {
+        if(!rendered[i])
+            continue;
+        SDL_SetSurfaceBlendMode(rendered[i], SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(rendered[i], NULL, m_surface, &m_glyphs[i].rect);
+        SDL_FreeSurface(rendered[i]);
+    }
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    if(m_texture)
+        SDL_DestroyTexture(m_texture);
+    SDL_FreeSurface(m_surface);
+}
+
+const GlyphAtlas::Glyph *GlyphAtlas::glyph(char ch) const
+{
+    if(ch < FIRST_CHAR || ch > LAST_CHAR)
+        return nullptr;
+    return &m_glyphs[ch - FIRST_CHAR];
+}
+
+const SDL_Surface *GlyphAtlas::surface() const
+{
+    return m_surface;
+}
+
+int GlyphAtlas::textWidth(const std::string &text) const
+{
+    int width = 0;
+    for(char ch: text)
+    {
+        const Glyph *g = glyph(ch);
+        if(g)
+            width += g->advance;
+    }
+    return width;
+}
+
+int GlyphAtlas::lineHeight() const
+{
+    return m_lineHeight;
+}
+
+void GlyphAtlas::queueText(const std::string &text, int x, int y, const SDL_Color &color)
+{
+    const float texWidth = m_surface->w;
+    const float texHeight = m_surface->h;
+    for(char ch: text)
+    {
+        const Glyph *g = glyph(ch);
+        if(!g)
+            continue;
+        if(g->rect.w > 0)
+        {
+            const float x0 = x, y0 = y;
+            const float x1 = x + g->rect.w, y1 = y + g->rect.h;
+            const float u0 = g->rect.x / texWidth, v0 = g->rect.y / texHeight;
+            const float u1 = (g->rect.x + g->rect.w) / texWidth;
+            const float v1 = (g->rect.y + g->rect.h) / texHeight;
+            const int base = m_vertices.size();
+            m_vertices.push_back({{x0, y0}, color, {u0, v0}});
+            m_vertices.push_back({{x1, y0}, color, {u1, v0}});
+            m_vertices.push_back({{x1, y1}, color, {u1, v1}});
+            m_vertices.push_back({{x0, y1}, color, {u0, v1}});
+            for(int i: {0, 1, 2, 0, 2, 3})
+                m_indices.push_back(base + i);
+        }
+        x += g->advance;
+    }
+}
+
+void GlyphAtlas::flush(SDL_Renderer *renderer)
+{
+    if(m_texture && m_textureRenderer != renderer)
+    {
+        SDL_DestroyTexture(m_texture);
+        m_texture = nullptr;
+    }
+    if(!m_texture)
+    {
+        m_texture = SDL_CreateTextureFromSurface(renderer, m_surface);
+        SDL_SetTextureBlendMode(m_texture, SDL_BLENDMODE_BLEND);
+        m_textureRenderer = renderer;
+    }
+    if(!m_indices.empty())
+        SDL_RenderGeometry(renderer, m_texture, m_vertices.data(), m_vertices.size(),
+                           m_indices.data(), m_indices.size());
+    m_vertices.clear();
+    m_indices.clear();
+}
@@ -0,0 +1,48 @@
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include <vector>
+#include <string>
+
+//All printable ASCII glyphs of a font rasterized once into a single surface.
+//Text is drawn as textured quads taken from that surface, so labels can be
+//changed every frame without creating new surfaces or textures.
+class GlyphAtlas
+{
+public:
+    struct Glyph
+    {
+        SDL_Rect rect;
+        int advance;
+    };
+    explicit GlyphAtlas(TTF_Font *font);
+    ~GlyphAtlas();
+    GlyphAtlas(const GlyphAtlas&) = delete;
+    GlyphAtlas &operator=(const GlyphAtlas&) = delete;
+    const Glyph *glyph(char ch) const;
+    const SDL_Surface *surface() const;
+    int textWidth(const std::string &text) const;
+    int lineHeight() const;
+    void queueText(const std::string &text, int x, int y, const SDL_Color &color);
+    void flush(SDL_Renderer *renderer);
+private:
+    enum
+    {
+        FIRST_CHAR = 32,
+        LAST_CHAR = 126,
+        ATLAS_WIDTH = 512,
+        PADDING = 1
+    };
+    SDL_Surface *m_surface{nullptr};
+    SDL_Texture *m_texture{nullptr};
+    SDL_Renderer *m_textureRenderer{nullptr};
+    int m_lineHeight{0};
+    std::vector<Glyph> m_glyphs;
+    std::vector<SDL_Vertex> m_vertices;
+    std::vector<int> m_indices;
+};
+
+#endif // GLYPHATLAS_H
@@ -1,4 +1,5 @@
 #include "grapher.h"
+#include "equationbundle.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -6,132 +7,677 @@
 #include <algorithm>
 #include <stdexcept>
 #include <string.h>
+#include <climits>
+#include <cfloat>
+#include <cstdio>
+#include <map>
 
-SDLInitObject::SDLInitObject()
+int SDLInitObject::s_users = 0;
+
+SDLInitObject::SDLInitObject(Uint32 flags):
+    m_flags(flags)
 {
-    if(SDL_Init((SDL_INIT_VIDEO)) < 0)
+    std::lock_guard<std::mutex> lock(mutex());
+    if(s_users == 0)
+    {
+        if(SDL_Init(0) < 0)
+            throw std::runtime_error(vErrors_[ERROR_SDL_INIT] + std::string(SDL_GetError()));
+        if(TTF_Init() < 0)
+        {
+            SDL_Quit();
+            throw std::runtime_error(vErrors_[ERROR_TTF_LOADING] + std::string(TTF_GetError()));
+        }
+    }
+    //Subsystems are reference counted by SDL itself
+    if(SDL_InitSubSystem(flags) < 0)
+    {
+        if(s_users == 0)
+        {
+            TTF_Quit();
+            SDL_Quit();
+        }
         throw std::runtime_error(vErrors_[ERROR_SDL_INIT] + std::string(SDL_GetError()));
-    if(TTF_Init() < 0)
-        throw std::runtime_error(vErrors_[ERROR_TTF_LOADING] + std::string(TTF_GetError()));
+    }
+    ++s_users;
 }
 
 SDLInitObject::~SDLInitObject()
 {
-    TTF_Quit();
-    SDL_Quit();
+    std::lock_guard<std::mutex> lock(mutex());
+    SDL_QuitSubSystem(m_flags);
+    if(--s_users == 0)
+    {
+        TTF_Quit();
+        SDL_Quit();
+    }
+}
+
+std::mutex &SDLInitObject::mutex()
+{
+    static std::mutex sdlMutex;
+    return sdlMutex;
 }
 
-Grapher::Grapher(const std::string &pathToSettingsFile):
-    m_window {SDL_CreateWindow(WINDOW_TITLE.c_str(), WINDOW_X, WINDOW_Y, WINDOW_WIDTH,
-                               WINDOW_HEIGHT, SDL_WINDOW_SHOWN)},
-    m_renderer{SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED)},
-    m_pathToSettingsFile(pathToSettingsFile)
+Grapher::Grapher(const std::string &pathToSettingsFile, bool headless,
+                 std::shared_ptr<iat::ProgramCache> programCache,
+                 std::shared_ptr<SamplePool> samplePool,
+                 const std::string &pathToEquationFile):
+    m_sdl_initializer(headless ? 0 : SDL_INIT_VIDEO),
+    m_window(nullptr),
+    m_renderer(nullptr),
+    m_pathToSettingsFile(pathToSettingsFile),
+    m_programCache(programCache),
+    m_samplePool(samplePool)
 {
+    m_stageTimings.emplace_back("sdl", m_startupClock.elapsed());
+    Stopwatch stage;
+    if(!m_programCache)
+        m_programCache = std::make_shared<iat::ProgramCache>();
+    if(!m_samplePool)
+        m_samplePool = std::make_shared<SamplePool>();
     loadSettings(m_pathToSettingsFile);
+    if(!pathToEquationFile.empty())
+        m_pathToEquationFile = pathToEquationFile;
+    m_sampleCache.reset(new SampleCache(m_pathToSampleCache));
+    m_stageTimings.emplace_back("settings", stage.lap());
+    if(!headless)
+    {
+        m_window = SDL_CreateWindow(WINDOW_TITLE.c_str(), WINDOW_X, WINDOW_Y, WINDOW_WIDTH,
+                                    WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
+        Uint32 rendererFlags = SDL_RENDERER_ACCELERATED;
+        if(m_vsync)
+            rendererFlags |= SDL_RENDERER_PRESENTVSYNC;
+        m_renderer = SDL_CreateRenderer(m_window, -1, rendererFlags);
+        m_stageTimings.emplace_back("window", stage.lap());
+        //Show the window right away; grid, labels and curves follow as soon
+        //as they are ready
+        SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 255);
+        SDL_RenderClear(m_renderer);
+        SDL_RenderPresent(m_renderer);
+        m_stageTimings.emplace_back("first frame", stage.lap());
+        m_timeToFirstFrame = m_startupClock.elapsed();
+        m_streamEvent = SDL_RegisterEvents(2);
+        if(m_streamEvent == Uint32(-1))
+            m_streamEvent = 0;
+        else
+            m_reloadEvent = m_streamEvent + 1;
+    }
     loadData(m_pathToEquationFile);
-    m_font = TTF_OpenFont(m_pathToFontFile.c_str(), m_fontSize);
+    m_stageTimings.emplace_back("equations", stage.lap());
     m_colorText = {0, 0, 0, 255};
     fillTextData();
-    calculateLinesData();
+    if(headless)
+    {
+        installFonts(loadFonts(m_pathToFontFile, m_fontSize));
+        m_stageTimings.emplace_back("font", stage.lap());
+    }
+    else
+    {
+        //Labels and curves are placeholders (absent) until these finish
+        m_pendingFonts = std::async(std::launch::async, &Grapher::loadFonts,
+                                    m_pathToFontFile, m_fontSize);
+        //The worker samples in plain world X, so not at deep zoom
+        if(!isDeepZoom())
+            m_pendingCurves = std::async(std::launch::async, &Grapher::sampleCurves, m_exprList,
+                                         m_programs, m_angleUnit, m_sampleCache.get(),
+                                         m_samplePool, m_Xmin, m_Xmax, m_dX);
+        SDL_SetWindowTitle(m_window, (WINDOW_TITLE + " [loading]").c_str());
+        watchFiles();
+    }
 }
 
 Grapher::~Grapher()
 {
-    for(auto &d: m_textData)
-        SDL_DestroyTexture(d.first);
-    m_textData.clear();
-    TTF_CloseFont(m_font);
-    TTF_Quit();
-    SDL_DestroyRenderer(m_renderer);
-    SDL_DestroyWindow(m_window);
-    SDL_Quit();
+    //Fonts still owned by an unfinished worker are closed below like the others
+    if(m_pendingFonts.valid())
+        installFonts(m_pendingFonts.get());
+    if(m_pendingCurves.valid())
+        m_pendingCurves.wait();
+    m_fileWatcher.reset();
+    if(m_backgroundTexture)
+        SDL_DestroyTexture(m_backgroundTexture);
+    if(m_backgroundScratch)
+        SDL_DestroyTexture(m_backgroundScratch);
+    closeFonts();
+    //Their textures go with the renderer
+    m_heatmaps.clear();
+    if(m_renderer)
+        SDL_DestroyRenderer(m_renderer);
+    if(m_window)
+        SDL_DestroyWindow(m_window);
+}
+
+void Grapher::exportImage(const std::string &pathToImage, int width, int height, int threads)
+{
+    Stopwatch stage;
+    double windowWidth = m_windowWidth, windowHeight = m_windowHeight;
+    if(width > 0 && height > 0)
+    {
+        m_windowWidth = width;
+        m_windowHeight = height;
+    }
+    drainStreams();
+    calculateLinesData();
+    reloadTextData();
+    m_stageTimings.emplace_back("sample", stage.lap());
+    m_softRenderer.reset(new SoftRenderer(m_windowWidth, m_windowHeight));
+    setDrawColor({255, 255, 255, 255});
+    m_softRenderer->clear();
+    draw_all();
+    m_stageTimings.emplace_back("draw", stage.lap());
+    m_softRenderer->render(threads);
+    m_stageTimings.emplace_back("rasterize", stage.lap());
+    m_softRenderer->save(pathToImage);
+    m_softRenderer.reset();
+    m_stageTimings.emplace_back("encode", stage.lap());
+    m_windowWidth = windowWidth;
+    m_windowHeight = windowHeight;
+    invalidateLinesData();
+    reloadTextData();
+}
+
+void Grapher::setViewport(double Xmin, double Xmax, double Ymin, double Ymax)
+{
+    setXRange(Xmin, Xmax);
+    m_Ymin = Ymin;
+    m_Ymax = Ymax;
+    invalidateLinesData();
+    reloadTextData();
+}
+
+void Grapher::setEquationsFile(const std::string &pathToFile)
+{
+    m_pathToEquationFile = pathToFile;
+    loadData(m_pathToEquationFile);
+    invalidateLinesData();
+}
+
+const StageTimings &Grapher::stageTimings() const
+{
+    return m_stageTimings;
+}
+
+void Grapher::setStartupTrace(bool startupTrace)
+{
+    m_startupTrace = startupTrace;
+}
+
+void Grapher::setTraceFile(const std::string &pathToFile)
+{
+    m_profiler.startTrace(pathToFile);
+}
+
+void Grapher::setRecordFile(const std::string &pathToFile)
+{
+    m_recorder.reset(new InputRecorder(pathToFile));
+}
+
+int Grapher::replay(const std::string &pathToLog, const std::string &pathToGolden,
+                    std::ostream &report, int warmupFrames)
+{
+    InputReplay input(pathToLog);
+    //Every replay starts from a completely loaded grapher
+    if(m_pendingFonts.valid())
+        m_pendingFonts.wait();
+    if(m_pendingCurves.valid())
+        m_pendingCurves.wait();
+    pollStartupTasks();
+    updateLinesData();
+    m_profiler.setEnabled(true);
+    uint64_t before[Profiler::COUNTER_COUNT];
+    for(int i = 0; i < Profiler::COUNTER_COUNT; ++i)
+        before[i] = Profiler::total(Profiler::Counter(i));
+    std::vector<double> frameTimes;
+    std::vector<SDL_Event> events;
+    //Allocations of a frame, from its events to endFrame(); reading the log
+    //and the bookkeeping here are left out
+    size_t allocatingFrames = 0, lateAllocations = 0;
+    int lastAllocatingFrame = -1;
+    m_timeStep = 1.0 / DEFAULT_MAX_FPS;
+    m_isRunning = true;
+    while(m_isRunning && input.nextFrame(events))
+    {
+        const uint64_t allocations = Profiler::total(Profiler::ALLOCATIONS);
+        {
+            ProfileScope scope(m_profiler, "events");
+            for(const auto &e: events)
+                userInputPhase(e);
+        }
+        if(!m_isRunning)
+            break;
+        drawingPhase();
+        m_profiler.endFrame();
+        const uint64_t frameAllocations = Profiler::total(Profiler::ALLOCATIONS) - allocations;
+        if(frameAllocations > 0)
+        {
+            ++allocatingFrames;
+            lastAllocatingFrame = frameTimes.size();
+            if(warmupFrames >= 0 && int(frameTimes.size()) >= warmupFrames)
+                lateAllocations += frameAllocations;
+        }
+        frameTimes.push_back(m_profiler.lastFrameTime());
+    }
+    m_profiler.setEnabled(m_showHud);
+    m_timeStep = 0;
+
+    report << "Replay of " << pathToLog << ": " << frameTimes.size() << " frames" << std::endl;
+    if(!frameTimes.empty())
+    {
+        std::vector<double> sorted(frameTimes);
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double p)
+        {
+            return sorted[std::min(sorted.size() - 1, size_t(p / 100 * sorted.size()))];
+        };
+        double sum = 0;
+        for(double t: sorted)
+            sum += t;
+        report << std::fixed << std::setprecision(3)
+               << "  frame time ms: min " << sorted.front() << "  p50 " << percentile(50)
+               << "  p95 " << percentile(95) << "  p99 " << percentile(99) << "  max "
+               << sorted.back() << "  mean " << sum / sorted.size() << std::endl;
+    }
+    report << " ";
+    for(int i = 0; i < Profiler::COUNTER_COUNT; ++i)
+        report << " " << Profiler::counterName(Profiler::Counter(i)) << " "
+               << Profiler::total(Profiler::Counter(i)) - before[i];
+    report << std::endl;
+    report << "  frames that allocated: " << allocatingFrames;
+    if(lastAllocatingFrame >= 0)
+        report << ", the last one is frame " << lastAllocatingFrame;
+    report << std::endl;
+    if(warmupFrames >= 0)
+        report << "  allocations after the first " << warmupFrames << " frames: "
+               << lateAllocations << (lateAllocations ? " FAILED" : " ok") << std::endl;
+    report << "  worst frame " << m_profiler.worstFrameTime() << " ms:" << std::endl;
+    for(const auto &scope: m_profiler.worstFrame())
+    {
+        report << "    " << std::string(2 * scope.depth, ' ') << scope.name;
+        if(scope.index >= 0)
+            report << " " << scope.index;
+        report << "  " << scope.duration << " ms" << std::endl;
+    }
+    const int status = lateAllocations ? 1 : 0;
+    if(pathToGolden.empty())
+        return status;
+
+    //The final frame is drawn once more and read back before presenting it
+    const int width = m_windowWidth, height = m_windowHeight;
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 255);
+    SDL_RenderClear(m_renderer);
+    draw_all();
+    if(SDL_RenderReadPixels(m_renderer, NULL, SDL_PIXELFORMAT_RGBA32, pixels.data(),
+                            width * 4) != 0)
+        throw std::runtime_error("Could not read the frame: " + std::string(SDL_GetError()));
+    std::string message;
+    const bool matches = InputReplay::checkGolden(pathToGolden, pixels, width, height, message);
+    report << "  golden: " << (matches ? "ok, " : "FAILED, ") << message << std::endl;
+    return matches ? status : 1;
 }
 
 void Grapher::run()
 {
-    bool done {false};
-    const unsigned char *keys = SDL_GetKeyboardState(NULL);
-    int x, y, oldX, oldY;
-    bool isMoving{false};
-    while(!done)
+    run({this});
+}
+
+void Grapher::run(const std::vector<Grapher *> &views)
+{
+    auto isRunning = [&views]()
+    {
+        return std::any_of(views.begin(), views.end(),
+                           [](const Grapher *view) {return view->m_isRunning;});
+    };
+    for(Grapher *view: views)
     {
+        view->m_isRunning = true;
+        view->m_reportTime = SDL_GetTicks();
+        view->m_reportCpuTime = std::clock();
+    }
+    while(isRunning())
+    {
+        //Sleep in the event queue until something happens in any window
+        int timeout = CPU_REPORT_INTERVAL;
+        for(const Grapher *view: views)
+        {
+            if(view->m_isRunning)
+                timeout = std::min(timeout, view->waitTimeout());
+        }
         SDL_Event e;
-
-        while(SDL_PollEvent(&e))
+        if(SDL_WaitEventTimeout(&e, timeout))
         {
-            switch(e.type)
+            do
             {
-                 case SDL_QUIT:
-                    done = true;
-                    break;
-                 case SDL_MOUSEBUTTONDOWN:
-                    isMoving = true;
-                    oldX = e.button.x;
-                    oldY = e.button.y;
-                    break;
-                case SDL_MOUSEBUTTONUP:
-                    isMoving = false;
-                    break;
-                case SDL_MOUSEMOTION:
-                    if(isMoving)
-                    {
-                        x = e.button.x;
-                        y = e.button.y;
-                        move(x - oldX, y - oldY);
-                        oldX = e.button.x;
-                        oldY = e.button.y;
-                    }
+                for(Grapher *view: views)
+                {
+                    if(!view->m_isRunning || !view->isEventFor(e))
+                        continue;
+                    ProfileScope scope(view->m_profiler, "events");
+                    view->userInputPhase(e);
+                }
+            }
+            while(SDL_PollEvent(&e));
+        }
+        for(Grapher *view: views)
+        {
+            if(!view->m_isRunning)
+                continue;
+            view->pollStartupTasks();
+            if(view->m_isDirty &&
+               int(SDL_GetTicks() - view->m_lastFrameTime) >= view->frameInterval())
+            {
+                view->drawingPhase();
+                view->m_profiler.endFrame();
+                if(view->m_recorder)
+                    view->m_recorder->frame(SDL_GetTicks());
+            }
+            view->reportCpuUsage();
+        }
+    }
+    for(Grapher *view: views)
+        view->m_profiler.stopTrace();
+}
+
+bool Grapher::isEventFor(const SDL_Event &e) const
+{
+    //Events without a window (quit, user events) go to every view
+    Uint32 windowID = 0;
+    switch(e.type)
+    {
+        case SDL_WINDOWEVENT:
+            windowID = e.window.windowID;
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            windowID = e.key.windowID;
+            break;
+        case SDL_MOUSEMOTION:
+            windowID = e.motion.windowID;
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            windowID = e.button.windowID;
+            break;
+        case SDL_MOUSEWHEEL:
+            windowID = e.wheel.windowID;
+            break;
+    }
+    return windowID == 0 || !m_window || windowID == SDL_GetWindowID(m_window);
+}
+
+int Grapher::waitTimeout() const
+{
+    //When a redraw is pending wake up no later than the frame cap allows it
+    int timeout = CPU_REPORT_INTERVAL;
+    if(m_isDirty)
+    {
+        int sinceLastFrame = SDL_GetTicks() - m_lastFrameTime;
+        timeout = std::max(0, frameInterval() - sinceLastFrame);
+    }
+    if(isLoading())
+        timeout = std::min(timeout, int(STARTUP_POLL_INTERVAL));
+    return timeout;
+}
+
+void Grapher::userInputPhase(const SDL_Event &e)
+{
+    if(m_recorder)
+        m_recorder->event(e, SDL_GetTicks());
+    if(m_streamEvent != 0 && e.type == m_streamEvent)
+    {
+        drainStreams();
+        return;
+    }
+    if(m_reloadEvent != 0 && e.type == m_reloadEvent)
+    {
+        if(e.user.code == RELOAD_SETTINGS)
+            reloadSettings();
+        else
+            reloadEquations();
+        return;
+    }
+    switch(e.type)
+    {
+        case SDL_QUIT:
+            m_isRunning = false;
+            break;
+        case SDL_WINDOWEVENT:
+            switch(e.window.event)
+            {
+                case SDL_WINDOWEVENT_SHOWN:
+                case SDL_WINDOWEVENT_EXPOSED:
+                case SDL_WINDOWEVENT_RESIZED:
+                case SDL_WINDOWEVENT_SIZE_CHANGED:
+                case SDL_WINDOWEVENT_RESTORED:
+                    m_isDirty = true;
                     break;
-                case SDL_MOUSEWHEEL:
-                     if(e.wheel.y < 0)
-                         zoomOut();
-                     else if(e.wheel.y > 0)
-                         zoomIn();
+                case SDL_WINDOWEVENT_LEAVE:
+                    m_hasCursor = false;
+                    if(m_hoveredCurve >= 0)
+                        m_isDirty = true;
+                    m_hoveredCurve = -1;
                     break;
-                case SDL_KEYDOWN:
-                    if(keys[SDL_SCANCODE_KP_MINUS])
-                    {
-                        zoomOut();
-                    }
-                    else if(keys[SDL_SCANCODE_KP_PLUS])
-                    {
-                        zoomIn();
-                    }
-                    else if(keys[SDL_SCANCODE_LEFT])
-                    {
-                        move(Grapher::Direction::LEFT, 0.25);
-                    }
-                    else if(keys[SDL_SCANCODE_RIGHT])
-                    {
-                        move(Grapher::Direction::RIGHT, 0.25);
-                    }
-                    else if(keys[SDL_SCANCODE_UP])
-                    {
-                        move(Grapher::Direction::UP, 0.25);
-                    }
-                    else if(keys[SDL_SCANCODE_DOWN])
-                    {
-                        move(Grapher::Direction::DOWN, 0.25);
-                    }
-
+                //With several windows only the last one closed quits
+                case SDL_WINDOWEVENT_CLOSE:
+                    m_isRunning = false;
+                    SDL_HideWindow(m_window);
                     break;
             }
+            break;
+        case SDL_RENDER_TARGETS_RESET:
+        case SDL_RENDER_DEVICE_RESET:
+            m_isBackgroundDirty = true;
+            for(const auto &heatmap: m_heatmaps)
+            {
+                if(heatmap)
+                    heatmap->invalidate();
+            }
+            m_isDirty = true;
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+            m_draggedParameter = sliderAt(e.button.x, e.button.y);
+            if(m_draggedParameter >= 0)
+            {
+                m_selectedParameter = m_draggedParameter;
+                dragSlider(e.button.x);
+                break;
+            }
+            //Dragging looks back in time, so stop following the stream
+            m_followStreams = false;
+            m_isMoving = true;
+            m_mouseX = m_pressX = e.button.x;
+            m_mouseY = m_pressY = e.button.y;
+            break;
+        case SDL_MOUSEBUTTONUP:
+            if(m_isMoving && std::abs(e.button.x - m_pressX) < CLICK_SLOP &&
+               std::abs(e.button.y - m_pressY) < CLICK_SLOP)
+            {
+                //A click selects the curve under it, or clears the selection
+                double x, y;
+                m_selectedCurve = pickCurve(e.button.x, e.button.y, x, y);
+                m_isDirty = true;
+            }
+            m_isMoving = false;
+            if(m_draggedParameter >= 0)
+            {
+                //The last position is drawn at full resolution
+                m_draggedParameter = -1;
+                if(!(m_isPlaying && isAnimated()))
+                    setAnimationStride(1);
+            }
+            break;
+        case SDL_MOUSEMOTION:
+            m_hasCursor = true;
+            m_cursorX = e.motion.x;
+            m_cursorY = e.motion.y;
+            if(m_draggedParameter >= 0)
+                dragSlider(e.motion.x);
+            else if(m_isMoving)
+            {
+                int x = e.button.x;
+                int y = e.button.y;
+                move(x - m_mouseX, y - m_mouseY);
+                m_mouseX = x;
+                m_mouseY = y;
+            }
+            else
+            {
+                //The readout follows the cursor; away from the curves
+                //nothing has to be drawn again
+                const int hovered = m_hoveredCurve;
+                updateHover();
+                if(hovered >= 0 || m_hoveredCurve >= 0)
+                    m_isDirty = true;
+            }
+            break;
+        case SDL_MOUSEWHEEL:
+             if(e.wheel.y < 0)
+                 zoomOut();
+             else if(e.wheel.y > 0)
+                 zoomIn();
+            break;
+        case SDL_KEYDOWN:
+        {
+            const SDL_Scancode key = e.key.keysym.scancode;
+            if(key == SDL_SCANCODE_KP_MINUS)
+            {
+                zoomOut();
+            }
+            else if(key == SDL_SCANCODE_KP_PLUS)
+            {
+                zoomIn();
+            }
+            else if(key == SDL_SCANCODE_LEFT)
+            {
+                move(Grapher::Direction::LEFT, 0.25);
+            }
+            else if(key == SDL_SCANCODE_RIGHT)
+            {
+                move(Grapher::Direction::RIGHT, 0.25);
+            }
+            else if(key == SDL_SCANCODE_UP)
+            {
+                move(Grapher::Direction::UP, 0.25);
+            }
+            else if(key == SDL_SCANCODE_DOWN)
+            {
+                move(Grapher::Direction::DOWN, 0.25);
+            }
+            else if(key >= SDL_SCANCODE_1 && key <= SDL_SCANCODE_0)
+            {
+                //1..9 and 0 show or hide the first ten equations
+                toggleCurve(key - SDL_SCANCODE_1);
+            }
+            else if(key == SDL_SCANCODE_F)
+            {
+                m_followStreams = !m_followStreams;
+                drainStreams();
+            }
+            else if(key == SDL_SCANCODE_H)
+            {
+                m_showHud = !m_showHud;
+                m_profiler.setEnabled(m_showHud);
+                m_isDirty = true;
+            }
+            else if(key == SDL_SCANCODE_SPACE)
+            {
+                //A paused frame is drawn at full resolution
+                m_isPlaying = !m_isPlaying;
+                if(!m_isPlaying)
+                    setAnimationStride(1);
+                m_isDirty = true;
+            }
+            else if(key == SDL_SCANCODE_TAB && !m_parameters.empty())
+            {
+                m_selectedParameter = (m_selectedParameter + 1) % m_parameters.size();
+                m_isDirty = true;
+            }
+            else if((key == SDL_SCANCODE_PAGEUP || key == SDL_SCANCODE_PAGEDOWN) &&
+                    !m_parameters.empty())
+            {
+                const iat::Parameter &parameter = m_parameters[m_selectedParameter];
+                const double step = (parameter.max - parameter.min) / SLIDER_KEY_STEPS;
+                setParameter(m_selectedParameter, m_parameterValues[m_selectedParameter] +
+                             (key == SDL_SCANCODE_PAGEUP ? step : -step));
+            }
+            else if(key == SDL_SCANCODE_R)
+            {
+                m_showFeatures = !m_showFeatures;
+                m_isDirty = true;
+            }
+            else if(key == SDL_SCANCODE_T)
+            {
+                if(m_profiler.isTracing())
+                    m_profiler.stopTrace();
+                else
+                    m_profiler.startTrace(DEFAULT_TRACE_FILE);
+            }
+            break;
         }
-        SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 255);
-        SDL_RenderClear(m_renderer);
-        draw_all();
-        SDL_RenderPresent(m_renderer);
     }
 }
 
-void Grapher::userInputPhase()
+void Grapher::drawingPhase()
 {
-
+    //Curves keep their old (at startup no) lines until the worker is done,
+    //so a pan during startup never waits for it
+    ProfileScope scope(m_profiler, "frame");
+    advanceTime();
+    if(!m_pendingCurves.valid())
+    {
+        ProfileScope linesScope(m_profiler, "lines");
+        updateLinesData();
+    }
+    if(m_hasCursor)
+    {
+        //The curves under the cursor may have been resampled or moved
+        ProfileScope pickScope(m_profiler, "pick");
+        updateHover();
+    }
+    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 255);
+    SDL_RenderClear(m_renderer);
+    draw_all();
+    if(m_hoveredCurve >= 0)
+        draw_readout();
+    if(!m_parameters.empty())
+        draw_sliders();
+    if(m_showHud)
+        draw_hud();
+    {
+        ProfileScope presentScope(m_profiler, "present");
+        SDL_RenderPresent(m_renderer);
+    }
+    //Playing animations keep the loop drawing at the frame cap
+    m_isDirty = m_isPlaying && isAnimated();
+    m_lastFrameTime = SDL_GetTicks();
+    ++m_framesSinceReport;
+    if(!m_isStartupDone && !isLoading())
+        finishStartup();
 }
 
-void Grapher::drawingPhase()
+int Grapher::frameInterval() const
 {
+    //With vsync SDL_RenderPresent already paces the loop
+    if(m_vsync || m_maxFps <= 0)
+        return 0;
+    return 1000 / m_maxFps;
+}
 
+void Grapher::reportCpuUsage()
+{
+    Uint32 now = SDL_GetTicks();
+    Uint32 wallTime = now - m_reportTime;
+    if(wallTime < CPU_REPORT_INTERVAL)
+        return;
+    std::clock_t cpuTime = std::clock();
+    double cpuMs = 1000.0 * (cpuTime - m_reportCpuTime) / CLOCKS_PER_SEC;
+    m_cpuUsage = 100.0 * cpuMs / wallTime;
+    std::string title = WINDOW_TITLE + " [CPU: " + doubleToString(m_cpuUsage, 1) + "%, " +
+            std::to_string(m_framesSinceReport * 1000 / wallTime) + " fps]";
+    SDL_SetWindowTitle(m_window, title.c_str());
+    m_reportTime = now;
+    m_reportCpuTime = cpuTime;
+    m_framesSinceReport = 0;
 }
 
 void Grapher::loadSettings(const std::string &pathToFile)
@@ -148,6 +694,10 @@ void Grapher::loadSettings(const std::string &pathToFile)
         GRID_COLOR,
         GRID_STEP,
         FONT_PARS,
+        FRAME_RATE,
+        SAMPLE_CACHE,
+        ANIMATION,
+        HEATMAP,
         STOP
     };
     LoadState ls;
@@ -200,6 +750,22 @@ void Grapher::loadSettings(const std::string &pathToFile)
             {
                 ls = FONT_PARS;
             }
+            else if(line == "[Frame rate(max fps, vsync Yes/No)]")
+            {
+                ls = FRAME_RATE;
+            }
+            else if(line == "[Sample cache(directory or None)]")
+            {
+                ls = SAMPLE_CACHE;
+            }
+            else if(line == "[Animation(time speed, frame budget ms)]")
+            {
+                ls = ANIMATION;
+            }
+            else if(line == "[Heatmap(colormap zmin zmax)]")
+            {
+                ls = HEATMAP;
+            }
             else
             {
                 ls = STOP;
@@ -218,8 +784,17 @@ void Grapher::loadSettings(const std::string &pathToFile)
                 case AREA_LIMITS:
                     ss.clear();
                     ss << line;
-                    ss >> m_Xmin >> m_Xmax >> m_Ymin >> m_Ymax;
+                {
+                    //Read in long double, so a deep zoom view keeps its digits
+                    long double Xmin, Xmax;
+                    ss >> Xmin >> Xmax >> m_Ymin >> m_Ymax;
+                    setXRange(Xmin, Xmax);
+                    m_settingsXmin = Xmin;
+                    m_settingsXmax = Xmax;
+                    m_settingsYmin = m_Ymin;
+                    m_settingsYmax = m_Ymax;
                     break;
+                }
                 case ARGUMENT_STEP:
                     m_dX = std::atof(line.c_str());
                     break;
@@ -257,6 +832,37 @@ void Grapher::loadSettings(const std::string &pathToFile)
                     std::getline(ss, tmp, ' ');
                     m_fontSize = std::atoi(tmp.c_str());
                     break;
+                case FRAME_RATE:
+                    ss.clear();
+                    ss << line;
+                    ss >> m_maxFps >> tmp;
+                    std::transform(tmp.begin(), tmp.end(), tmp.begin(), ::tolower);
+                    m_vsync = tmp == "yes";
+                    break;
+                case SAMPLE_CACHE:
+                    tmp = line;
+                    std::transform(tmp.begin(), tmp.end(), tmp.begin(), ::tolower);
+                    m_pathToSampleCache = tmp == "none" ? "" : line;
+                    break;
+                case ANIMATION:
+                    ss.clear();
+                    ss << line;
+                    ss >> m_timeSpeed >> m_frameBudget;
+                    break;
+                case HEATMAP:
+                    ss.clear();
+                    ss << line;
+                    ss >> tmp >> m_heatmapZmin >> m_heatmapZmax;
+                    //An unknown name keeps the colormap in use
+                    try
+                    {
+                        m_colormap = Colormap(tmp);
+                    }
+                    catch(std::exception &ex)
+                    {
+                        std::cerr << ex.what() << std::endl;
+                    }
+                    break;
                 case STOP:
                     break;
                 default:
@@ -272,10 +878,13 @@ void Grapher::loadSettings(const std::string &pathToFile)
         m_pathToEquationFile = "equations.dat";
         m_windowWidth = 1200;
         m_windowHeight = 600;
-        m_Xmin = -10;
-        m_Xmax = 10;
+        setXRange(-10, 10);
         m_Ymin = -5;
         m_Ymax = 5;
+        m_settingsXmin = -10;
+        m_settingsXmax = 10;
+        m_settingsYmin = m_Ymin;
+        m_settingsYmax = m_Ymax;
         m_dX = 0.1;
         m_drawAxis = true;
         m_colorAxis = {0, 0, 0, 255};
@@ -285,24 +894,41 @@ void Grapher::loadSettings(const std::string &pathToFile)
         m_gridStepY = 1;
         m_pathToFontFile = "orbitron-bold.otf";
         m_fontSize = 28;
+        m_maxFps = DEFAULT_MAX_FPS;
+        m_vsync = false;
     }
 }
 
-void Grapher::loadData(const std::string &pathToFile)
+void Grapher::loadData(const std::string &pathToFile, bool writesBundle)
 {
+    //A bundle, given instead of the text or written next to it on an
+    //earlier load, replaces reading and compiling the text
+    if(loadBundle(pathToFile, "") || loadBundle(pathToFile + BUNDLE_SUFFIX, pathToFile))
+        return;
+    if(!MappedFile::stat(pathToFile, m_equationsSize, m_equationsMtime))
+        m_equationsSize = m_equationsMtime = 0;
     std::ifstream fi(pathToFile);
     if(fi.is_open())
     {
+        std::vector<std::pair<std::string, SDL_Color>> exprList = m_exprList;
+        std::vector<std::string> definitions = m_definitions;
         std::string line;
         std::getline(fi, line);
         if(line == "[begin]")
         {
-            m_exprList.clear();
+            exprList.clear();
+            definitions.clear();
             while(!fi.eof())
             {
                 std::string equation, colorData;
                 std::getline(fi, equation);
-                if(equation != "[end]")
+                //Definitions and parameters have no color line
+                if(iat::Compiler::isParameter(equation) ||
+                   iat::Compiler::isDefinition(equation))
+                {
+                    definitions.push_back(equation);
+                }
+                else if(equation != "[end]")
                 {
                     std::getline(fi, colorData);
                     std::stringstream ss;
@@ -314,13 +940,32 @@ void Grapher::loadData(const std::string &pathToFile)
                     color.g = green;
                     color.b = blue;
                     color.a = alpha;
-                    m_exprList.push_back(std::make_pair(equation, color));
+                    exprList.push_back(std::make_pair(equation, color));
                 }
                 else
                     break;
             }
         }
         fi.close();
+        if(m_sampleCache)
+            m_sampleCache->setEquationsFile(pathToFile);
+        prepareCurves(exprList, definitions);
+        //The bundle is only an accelerator, a sheet that cannot have one
+        //still loads. It is written only when missing or out of date, and
+        //not on hot reloads, as the next save of the sheet would make it out
+        //of date again; the next start writes it.
+        const std::string pathToBundle = pathToFile + BUNDLE_SUFFIX;
+        if(writesBundle && m_exprList.size() >= BUNDLE_MIN_EXPRESSIONS &&
+           !EquationBundle::isMadeFrom(pathToBundle, m_equationsSize, m_equationsMtime))
+        {
+            try
+            {
+                writeBundle(pathToBundle);
+            }
+            catch(std::exception &)
+            {
+            }
+        }
     }
     else
     {
@@ -328,63 +973,999 @@ void Grapher::loadData(const std::string &pathToFile)
     }
 }
 
-double Grapher::map(double min_val, double max_val, double mapped_min_val,
-                    double mapped_max_val, double val)
-{
-    return (val - min_val) / (max_val - min_val) * (mapped_max_val - mapped_min_val) +
-            mapped_min_val;
-}
-
-void Grapher::calculateLinesData()
+//With a source the bundle is used only if it was made from the current
+//version of it, and a damaged one is ignored; false if it is not used
+bool Grapher::loadBundle(const std::string &pathToBundle, const std::string &pathToSource)
 {
-    m_linesData.clear();
-    static const double esp = 0.000001;
-    for(const auto &expr: m_exprList)
+    if(!EquationBundle::isBundle(pathToBundle))
+        return false;
+    EquationBundle::Contents contents;
+    if(pathToSource.empty())
     {
-        Line line;
-        for(double x = m_Xmin; x <= m_Xmax; x += m_dX)
+        contents = EquationBundle::read(pathToBundle);
+    }
+    else
+    {
+        uint64_t size, mtime;
+        try
+        {
+            contents = EquationBundle::read(pathToBundle);
+        }
+        catch(std::exception &)
         {
-            std::vector<std::pair<char, double>> vars;
-            if(fabs(x) < esp) x = 0;
-            vars.emplace_back('X', x);
-            iat::Parser p(expr.first, vars);
-            double y = p.calculateExpression();
-            double mappedX = map(m_Xmin, m_Xmax, 0, m_windowWidth, x);
-            double mappedY = map(m_Ymin, m_Ymax, 0, m_windowHeight, -y);
-            line.emplace_back(mappedX,mappedY);
+            return false;
         }
-        m_linesData.emplace_back(line, expr.second);
+        if(!MappedFile::stat(pathToSource, size, mtime) || size != contents.sourceSize ||
+           mtime != contents.sourceMtime)
+            return false;
+    }
+    m_equationsSize = contents.sourceSize;
+    m_equationsMtime = contents.sourceMtime;
+    std::vector<std::pair<std::string, SDL_Color>> exprList;
+    std::vector<std::string> expressions;
+    std::vector<std::shared_ptr<const iat::Program>> programs;
+    for(size_t i = 0; i < contents.expressions.size(); ++i)
+    {
+        const auto &color = contents.colors[i];
+        exprList.emplace_back(contents.expressions[i],
+                              SDL_Color{color[0], color[1], color[2], color[3]});
+        if(!contents.programs[i])
+            continue;
+        expressions.push_back(expressionOf(contents.expressions[i]));
+        programs.push_back(contents.programs[i]);
     }
+    //Bytecode folded for another angle unit is not used; prepareCurves()
+    //then compiles the texts
+    if(contents.angleUnit == m_angleUnit)
+        m_programCache->insert(expressions, contents.definitions, m_angleUnit, programs);
+    if(m_sampleCache)
+        m_sampleCache->setEquationsFile(pathToSource.empty() ? pathToBundle : pathToSource);
+    prepareCurves(exprList, contents.definitions);
+    return true;
 }
 
-void Grapher::draw_all()
+//Text an entry is compiled from; a heatmap's without its prefix
+std::string Grapher::expressionOf(const std::string &entry) const
 {
-    if(m_drawGrid)
-        draw_grid();
-    if(m_drawAxis)
-        draw_axis();
-    draw_all_graphs();
-    draw_text_info();
+    if(entry.compare(0, HEATMAP_PREFIX.size(), HEATMAP_PREFIX) == 0)
+        return entry.substr(HEATMAP_PREFIX.size());
+    return entry;
 }
 
-void Grapher::zoomIn()
+void Grapher::writeBundle(const std::string &pathToBundle) const
 {
-    m_Xmin *= 0.9;
-    m_Xmax *= 0.9;
-    m_Ymin *= 0.9;
-    m_Ymax *= 0.9;
-    calculateLinesData();
-    reloadTextData();
+    EquationBundle::Contents contents;
+    contents.angleUnit = m_angleUnit;
+    contents.sourceSize = m_equationsSize;
+    contents.sourceMtime = m_equationsMtime;
+    for(size_t i = 0; i < m_exprList.size(); ++i)
+    {
+        const SDL_Color &color = m_exprList[i].second;
+        contents.expressions.push_back(m_exprList[i].first);
+        contents.colors.push_back({color.r, color.g, color.b, color.a});
+        contents.programs.push_back(m_heatmaps[i] ? m_heatmaps[i]->program() : m_programs[i]);
+    }
+    contents.definitions = m_definitions;
+    EquationBundle::write(pathToBundle, contents);
 }
 
-void Grapher::zoomOut()
+void Grapher::watchFiles()
 {
-    m_Xmin *= 1.1;
-    m_Xmax *= 1.1;
-    m_Ymin *= 1.1;
-    m_Ymax *= 1.1;
-    calculateLinesData();
-    reloadTextData();
+    const std::string pathToSettingsFile = m_pathToSettingsFile;
+    const Uint32 reloadEvent = m_reloadEvent;
+    if(!m_fileWatcher)
+    {
+        m_fileWatcher.reset(new FileWatcher([pathToSettingsFile, reloadEvent](const std::string &path)
+        {
+            if(reloadEvent == 0)
+                return;
+            SDL_Event e;
+            SDL_zero(e);
+            e.type = reloadEvent;
+            e.user.code = path == pathToSettingsFile ? RELOAD_SETTINGS : RELOAD_EQUATIONS;
+            SDL_PushEvent(&e);
+        }));
+    }
+    m_fileWatcher->unwatchAll();
+    m_fileWatcher->watch(m_pathToSettingsFile);
+    m_fileWatcher->watch(m_pathToEquationFile);
+}
+
+void Grapher::reloadSettings()
+{
+    //An editor may remove the file for a moment, and loadSettings() would
+    //then fall back to the defaults
+    uint64_t size, mtime;
+    if(!MappedFile::stat(m_pathToSettingsFile, size, mtime))
+        return;
+    const std::string pathToEquationFile = m_pathToEquationFile;
+    const std::string pathToFontFile = m_pathToFontFile;
+    const std::string pathToSampleCache = m_pathToSampleCache;
+    const int fontSize = m_fontSize;
+    const double windowWidth = m_windowWidth, windowHeight = m_windowHeight;
+    //The view as panned and zoomed, and the area it started from
+    const long double Xorigin = m_Xorigin;
+    const double Xmin = m_Xmin, Xmax = m_Xmax, Ymin = m_Ymin, Ymax = m_Ymax, dX = m_dX;
+    const long double settingsXmin = m_settingsXmin, settingsXmax = m_settingsXmax;
+    const double settingsYmin = m_settingsYmin, settingsYmax = m_settingsYmax;
+    const bool vsync = m_vsync;
+    loadSettings(m_pathToSettingsFile);
+    //The renderer is created with or without vsync once, at startup
+    if(vsync != m_vsync)
+    {
+        std::cerr << "The vsync setting takes effect on the next start" << std::endl;
+        m_vsync = vsync;
+    }
+    //Colors, grid steps and axis switches only affect the background
+    m_isBackgroundDirty = true;
+    m_isDirty = true;
+    const bool resized = windowWidth != m_windowWidth || windowHeight != m_windowHeight;
+    if(resized)
+        SDL_SetWindowSize(m_window, m_windowWidth, m_windowHeight);
+    //Saving other settings keeps the view where the user took it; a new
+    //area in the file goes the same way as panning and zooming
+    const bool moved = settingsXmin != m_settingsXmin || settingsXmax != m_settingsXmax ||
+            settingsYmin != m_settingsYmin || settingsYmax != m_settingsYmax;
+    if(!moved)
+    {
+        m_Xorigin = Xorigin;
+        m_Xmin = Xmin;
+        m_Xmax = Xmax;
+        m_Ymin = Ymin;
+        m_Ymax = Ymax;
+    }
+    if(resized || moved || dX != m_dX)
+    {
+        invalidateLinesData();
+        reloadTextData();
+    }
+    if(pathToFontFile != m_pathToFontFile || fontSize != m_fontSize)
+    {
+        if(m_pendingFonts.valid())
+            installFonts(m_pendingFonts.get());
+        closeFonts();
+        installFonts(loadFonts(m_pathToFontFile, m_fontSize));
+    }
+    if(pathToSampleCache != m_pathToSampleCache)
+    {
+        m_sampleCache.reset(new SampleCache(m_pathToSampleCache));
+        m_sampleCache->setEquationsFile(m_pathToEquationFile);
+    }
+    if(pathToEquationFile != m_pathToEquationFile)
+    {
+        watchFiles();
+        reloadEquations();
+    }
+}
+
+void Grapher::reloadEquations()
+{
+    //A sheet that does not load keeps the previous curves on screen; the
+    //next save is tried again. One that loads but fails to evaluate at some
+    //points shows gaps there, see SamplePool::sample().
+    try
+    {
+        loadData(m_pathToEquationFile, false);
+    }
+    catch(std::exception &ex)
+    {
+        std::cerr << "Could not reload " << m_pathToEquationFile << ": " << ex.what() << std::endl;
+    }
+}
+
+double Grapher::map(double min_val, double max_val, double mapped_min_val,
+                    double mapped_max_val, double val)
+{
+    return (val - min_val) / (max_val - min_val) * (mapped_max_val - mapped_min_val) +
+            mapped_min_val;
+}
+
+Grapher::Fonts Grapher::loadFonts(const std::string &pathToFontFile, int fontSize)
+{
+    Stopwatch stage;
+    Fonts fonts;
+    {
+        std::lock_guard<std::mutex> lock(SDLInitObject::mutex());
+        fonts.font = TTF_OpenFont(pathToFontFile.c_str(), fontSize);
+        fonts.tickFont = TTF_OpenFont(pathToFontFile.c_str(),
+                                      std::max(int(MIN_TICK_FONT_SIZE), fontSize / 2));
+    }
+    //Atlases are plain surfaces; their textures are created on first draw
+    if(fonts.font)
+        fonts.atlas.reset(new GlyphAtlas(fonts.font));
+    if(fonts.tickFont)
+        fonts.tickAtlas.reset(new GlyphAtlas(fonts.tickFont));
+    fonts.ms = stage.elapsed();
+    return fonts;
+}
+
+void Grapher::closeFonts()
+{
+    m_glyphAtlas.reset();
+    m_tickAtlas.reset();
+    std::lock_guard<std::mutex> lock(SDLInitObject::mutex());
+    if(m_font)
+        TTF_CloseFont(m_font);
+    if(m_tickFont)
+        TTF_CloseFont(m_tickFont);
+    m_font = nullptr;
+    m_tickFont = nullptr;
+}
+
+void Grapher::installFonts(Fonts fonts)
+{
+    m_font = fonts.font;
+    m_tickFont = fonts.tickFont;
+    m_glyphAtlas = std::move(fonts.atlas);
+    m_tickAtlas = std::move(fonts.tickAtlas);
+    //Tick labels are part of the cached background
+    m_isBackgroundDirty = true;
+    m_isDirty = true;
+}
+
+Grapher::CurveSamples Grapher::sampleCurves(
+        std::vector<std::pair<std::string, SDL_Color>> exprList,
+        std::vector<std::shared_ptr<const iat::Program>> programs, std::string angleUnit,
+        const SampleCache *cache, std::shared_ptr<SamplePool> pool, double Xmin, double Xmax,
+        double dX)
+{
+    Stopwatch stage;
+    CurveSamples samples;
+    samples.Xmin = Xmin;
+    samples.Xmax = Xmax;
+    samples.dX = dX;
+    samples.lines.resize(programs.size());
+    std::vector<std::shared_ptr<const iat::Program>> expressionPrograms;
+    std::vector<const std::string *> exprs;
+    std::vector<Line *> lines;
+    for(size_t i = 0; i < programs.size(); ++i)
+    {
+        //Animated curves and ones with parameters are sampled on the main
+        //thread
+        if(!programs[i] || (programs[i]->dependencies() & ~uint64_t(iat::DEPENDS_ON_X)))
+            continue;
+        expressionPrograms.push_back(programs[i]);
+        exprs.push_back(&exprList[i].first);
+        lines.push_back(&samples.lines[i]);
+    }
+    sampleExpressions(expressionPrograms, exprs, cache, *pool, angleUnit, Xmin, Xmax, dX, lines);
+    samples.programs = std::move(programs);
+    samples.ms = stage.elapsed();
+    return samples;
+}
+
+void Grapher::sampleExpressions(const std::vector<std::shared_ptr<const iat::Program>> &programs,
+                                const std::vector<const std::string *> &exprs,
+                                const SampleCache *cache, SamplePool &pool,
+                                const std::string &angleUnit, double Xmin, double Xmax,
+                                double dX, const std::vector<Line *> &lines)
+{
+    if(!cache)
+    {
+        pool.sample(programs, dX, Xmin, Xmax, lines);
+        return;
+    }
+    //Curves missing from the disk cache are sampled in one pass, so curves
+    //of one equations file compute their common subexpressions once
+    std::vector<std::shared_ptr<const iat::Program>> missing;
+    std::vector<Line *> missingLines;
+    std::vector<size_t> index;
+    for(size_t i = 0; i < programs.size(); ++i)
+    {
+        if(cache->load(*exprs[i], angleUnit, Xmin, Xmax, dX, *lines[i]))
+            continue;
+        missing.push_back(programs[i]);
+        missingLines.push_back(lines[i]);
+        index.push_back(i);
+    }
+    if(missing.empty())
+        return;
+    Stopwatch compute;
+    pool.sample(missing, dX, Xmin, Xmax, missingLines);
+    if(compute.elapsed() / missing.size() < CACHE_MIN_COMPUTE_MS)
+        return;
+    for(size_t i: index)
+        cache->store(*exprs[i], angleUnit, Xmin, Xmax, dX, *lines[i]);
+}
+
+bool Grapher::isLoading() const
+{
+    return m_pendingFonts.valid() || m_pendingCurves.valid();
+}
+
+void Grapher::pollStartupTasks()
+{
+    auto isReady = [](const auto &future)
+    {
+        return future.valid() &&
+                future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    if(isReady(m_pendingFonts))
+    {
+        Fonts fonts = m_pendingFonts.get();
+        m_stageTimings.emplace_back("font (background)", fonts.ms);
+        installFonts(std::move(fonts));
+    }
+    if(isReady(m_pendingCurves))
+    {
+        CurveSamples samples = m_pendingCurves.get();
+        m_stageTimings.emplace_back("curves (background)", samples.ms);
+        calculateLinesData(&samples);
+    }
+}
+
+void Grapher::finishStartup()
+{
+    m_isStartupDone = true;
+    SDL_SetWindowTitle(m_window, WINDOW_TITLE.c_str());
+    if(!m_startupTrace)
+        return;
+    std::cerr << "Startup trace:" << std::endl;
+    for(const auto &stage: m_stageTimings)
+        std::cerr << "  " << std::left << std::setw(24) << stage.first << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(10) << stage.second
+                  << " ms" << std::endl;
+    std::cerr << "  " << std::left << std::setw(24) << "time to first frame" << std::right
+              << std::setw(10) << m_timeToFirstFrame << " ms" << std::endl;
+    std::cerr << "  " << std::left << std::setw(24) << "time to complete frame"
+              << std::right << std::setw(10) << m_startupClock.elapsed() << " ms" << std::endl;
+}
+
+void Grapher::prepareCurves(const std::vector<std::pair<std::string, SDL_Color>> &exprList,
+                            const std::vector<std::string> &definitions)
+{
+    //Entries are matched with the current list by expression text. A match
+    //keeps its program, series or stream, its visibility and its sampled
+    //line, so a color-only edit evaluates nothing. Changed definitions may
+    //change any expression, so then nothing matches.
+    std::multimap<std::string, size_t> current;
+    for(size_t i = 0; i < m_exprList.size() && definitions == m_definitions; ++i)
+        current.emplace(m_exprList[i].first, i);
+    //All expressions of the file, heatmaps too, are compiled as one group
+    std::vector<std::string> expressions;
+    std::vector<bool> isHeatmapExpression;
+    for(const auto &expr: exprList)
+    {
+        if(expr.first.compare(0, DATA_SERIES_PREFIX.size(), DATA_SERIES_PREFIX) != 0 &&
+           expr.first.compare(0, STREAM_PREFIX.size(), STREAM_PREFIX) != 0)
+        {
+            expressions.push_back(expressionOf(expr.first));
+            isHeatmapExpression.push_back(expressions.back() != expr.first);
+        }
+    }
+    const auto compiled = m_programCache->get(expressions, definitions, m_angleUnit);
+    //A curve would see Y as 0
+    for(size_t k = 0; k < compiled.size(); ++k)
+    {
+        if(!isHeatmapExpression[k] && (compiled[k]->dependencies() & iat::DEPENDS_ON_Y))
+            throw std::runtime_error("Y is known only in " + HEATMAP_PREFIX + " entries: " +
+                                     expressions[k]);
+    }
+    std::vector<iat::Parameter> parameters;
+    for(const auto &definition: definitions)
+    {
+        if(iat::Compiler::isParameter(definition))
+            parameters.push_back(iat::Compiler::parseParameter(definition));
+    }
+    setParameters(parameters);
+    size_t nextCompiled = 0;
+    std::vector<std::shared_ptr<const iat::Program>> programs;
+    std::vector<std::shared_ptr<DataSeries>> series;
+    std::vector<std::shared_ptr<StreamSeries>> streams;
+    std::vector<std::shared_ptr<Heatmap>> heatmaps;
+    std::vector<LineData> linesData;
+    std::vector<SampleKey> sampleKeys;
+    std::vector<CurveBounds> bounds;
+    std::vector<SegmentIndex> segmentIndices;
+    std::vector<bool> visible;
+    int selectedCurve = -1;
+    //Reader threads only post a wake up event; the samples are moved over
+    //on this thread in drainStreams()
+    const Uint32 streamEvent = m_streamEvent;
+    auto onData = [streamEvent]()
+    {
+        if(streamEvent == 0)
+            return;
+        SDL_Event e;
+        SDL_zero(e);
+        e.type = streamEvent;
+        SDL_PushEvent(&e);
+    };
+    for(size_t j = 0; j < exprList.size(); ++j)
+    {
+        const auto &expr = exprList[j];
+        const bool isSeries =
+                expr.first.compare(0, DATA_SERIES_PREFIX.size(), DATA_SERIES_PREFIX) == 0;
+        const bool isStream = expr.first.compare(0, STREAM_PREFIX.size(), STREAM_PREFIX) == 0;
+        const bool isHeatmap =
+                expr.first.compare(0, HEATMAP_PREFIX.size(), HEATMAP_PREFIX) == 0;
+        const auto program = isSeries || isStream ? nullptr : compiled[nextCompiled++];
+        auto match = current.find(expr.first);
+        if(match != current.end())
+        {
+            const size_t i = match->second;
+            current.erase(match);
+            if(int(i) == m_selectedCurve)
+                selectedCurve = j;
+            //The old program is just as good; keeping it keeps its samples
+            programs.push_back(m_programs[i]);
+            series.push_back(m_series[i]);
+            streams.push_back(m_streams[i]);
+            heatmaps.push_back(m_heatmaps[i]);
+            visible.push_back(m_visible[i]);
+            linesData.emplace_back(std::move(m_linesData[i].first), expr.second);
+            sampleKeys.push_back(m_sampleKeys[i]);
+            bounds.push_back(std::move(m_bounds[i]));
+            segmentIndices.push_back(std::move(m_segmentIndices[i]));
+            continue;
+        }
+        programs.push_back(isHeatmap ? nullptr : program);
+        series.push_back(nullptr);
+        streams.push_back(nullptr);
+        heatmaps.push_back(nullptr);
+        if(isHeatmap)
+            heatmaps.back() = std::make_shared<Heatmap>(program);
+        else if(isSeries)
+            series.back() = std::make_shared<DataSeries>(
+                        expr.first.substr(DATA_SERIES_PREFIX.size()));
+        else if(isStream)
+            streams.back() = std::make_shared<StreamSeries>(
+                        expr.first.substr(STREAM_PREFIX.size()), onData);
+        visible.push_back(true);
+        linesData.emplace_back(Line(), expr.second);
+        sampleKeys.push_back({0, 0, 0, 0, false});
+        bounds.emplace_back();
+        segmentIndices.emplace_back();
+    }
+    m_exprList = exprList;
+    m_definitions = definitions;
+    m_programs.swap(programs);
+    m_series.swap(series);
+    m_streams.swap(streams);
+    m_heatmaps.swap(heatmaps);
+    m_linesData.swap(linesData);
+    m_sampleKeys.swap(sampleKeys);
+    m_bounds.swap(bounds);
+    m_segmentIndices.swap(segmentIndices);
+    m_visible.swap(visible);
+    m_selectedCurve = selectedCurve;
+    m_hoveredCurve = -1;
+    m_animations.clear();
+    m_animations.resize(m_exprList.size());
+    m_isFeaturesDirty = true;
+    invalidateLinesData();
+}
+
+void Grapher::drainStreams()
+{
+    bool hasSamples = false;
+    double newestX = 0;
+    for(size_t i = 0; i < m_streams.size(); ++i)
+    {
+        const auto &stream = m_streams[i];
+        if(!stream)
+            continue;
+        const size_t count = stream->drain();
+        if(count > 0)
+            resampleCurve(i);
+
+        if(!stream->empty())
+        {
+            newestX = hasSamples ? std::max(newestX, stream->lastX()) : stream->lastX();
+            hasSamples = true;
+        }
+    }
+    //Compared relative to the origin, as Xmax() rounds at deep zoom
+    const double shift = hasSamples ? viewX(newestX) - m_Xmax : 0;
+    if(m_followStreams && shift != 0)
+    {
+        //Keep the span and put the newest sample at the right edge
+        m_Xmin += shift;
+        m_Xmax += shift;
+        reloadTextData();
+        invalidateLinesData();
+    }
+}
+
+void Grapher::invalidateLinesData()
+{
+    m_isLinesDataDirty = true;
+    m_isDirty = true;
+}
+
+void Grapher::resampleCurve(size_t i)
+{
+    m_sampleKeys[i].valid = false;
+    invalidateLinesData();
+}
+
+bool Grapher::isSampled(size_t i) const
+{
+    const SampleKey &key = m_sampleKeys[i];
+    return key.valid && key.Xmin == m_Xmin && key.Xmax == m_Xmax && key.dX == m_dX &&
+            key.width == m_windowWidth;
+}
+
+void Grapher::toggleCurve(size_t i)
+{
+    if(i >= m_visible.size())
+        return;
+    m_visible[i] = !m_visible[i];
+    m_isFeaturesDirty = true;
+    invalidateLinesData();
+}
+
+void Grapher::updateLinesData()
+{
+    if(m_isLinesDataDirty)
+        calculateLinesData();
+}
+
+void Grapher::calculateLinesData(CurveSamples *precomputed)
+{
+    updateOrigin();
+    //Samples from the startup worker are used only if the viewport and the
+    //equations did not change in the meantime
+    if(precomputed && (precomputed->Xmin != m_Xmin || precomputed->Xmax != m_Xmax ||
+                       precomputed->dX != m_dX || precomputed->programs != m_programs))
+        precomputed = nullptr;
+    auto finishLine = [this](size_t i)
+    {
+        m_bounds[i].build(m_linesData[i].first);
+        m_segmentIndices[i].invalidate();
+        m_sampleKeys[i] = {m_Xmin, m_Xmax, m_dX, m_windowWidth, true};
+        m_isFeaturesDirty = true;
+    };
+    //Expression curves are sampled together after the loop
+    std::vector<size_t> &expressions = m_expressionCurves;
+    std::vector<size_t> &dynamic = m_dynamicCurves;
+    std::vector<size_t> &deep = m_deepCurves;
+    expressions.clear();
+    dynamic.clear();
+    deep.clear();
+    //A pan or zoom only moves curves that were shown before; their samples
+    //come from the pool, the disk cache is for curves shown the first time
+    bool isFirstSampling = false;
+    for(unsigned int i = 0; i < m_exprList.size(); ++i)
+    {
+        m_linesData[i].second = m_exprList[i].second;
+        if(!m_visible[i] || m_heatmaps[i] || isSampled(i))
+            continue;
+        Line &line = m_linesData[i].first;
+        if(isDeepZoom() && m_programs[i])
+        {
+            deep.push_back(i);
+            continue;
+        }
+        else if(isDynamic(i))
+        {
+            dynamic.push_back(i);
+            continue;
+        }
+        else if(precomputed && m_programs[i])
+        {
+            line.swap(precomputed->lines[i]);
+        }
+        else if(m_programs[i])
+        {
+            expressions.push_back(i);
+            isFirstSampling |= !m_sampleKeys[i].valid;
+            continue;
+        }
+        else
+        {
+            ProfileScope scope(m_profiler, "curve", i);
+            calculateLine(i, line);
+        }
+        finishLine(i);
+    }
+    if(!expressions.empty())
+    {
+        ProfileScope scope(m_profiler, "expressions");
+        m_scratchPrograms.clear();
+        m_scratchExprs.clear();
+        m_scratchLines.clear();
+        for(size_t i: expressions)
+        {
+            m_scratchPrograms.push_back(m_programs[i]);
+            m_scratchExprs.push_back(&m_exprList[i].first);
+            m_scratchLines.push_back(&m_linesData[i].first);
+        }
+        Profiler::count(Profiler::CURVES, expressions.size());
+        sampleExpressions(m_scratchPrograms, m_scratchExprs,
+                          isFirstSampling ? m_sampleCache.get() : nullptr, *m_samplePool,
+                          m_angleUnit, m_Xmin, m_Xmax, m_dX, m_scratchLines);
+        //The programs are not kept alive by the scratch list
+        m_scratchPrograms.clear();
+        for(size_t i: expressions)
+            finishLine(i);
+    }
+    if(!deep.empty())
+    {
+        ProfileScope scope(m_profiler, "deep");
+        for(size_t i: deep)
+        {
+            sampleDeep(i);
+            finishLine(i);
+        }
+    }
+    if(!dynamic.empty())
+    {
+        ProfileScope scope(m_profiler, "dynamic");
+        Stopwatch frame;
+        for(size_t i: dynamic)
+        {
+            sampleDynamic(i);
+            finishLine(i);
+        }
+        //Coarser while over budget, finer again once well under it
+        const double elapsed = frame.elapsed();
+        const bool isChanging = m_isPlaying || m_draggedParameter >= 0;
+        if(isChanging && m_timeStep == 0 && elapsed > m_frameBudget)
+            setAnimationStride(m_animationStride * 2);
+        else if(isChanging && m_timeStep == 0 && elapsed < m_frameBudget / 4)
+            setAnimationStride(m_animationStride / 2);
+    }
+    m_isLinesDataDirty = false;
+    m_isDirty = true;
+}
+
+bool Grapher::isAnimated(size_t i) const
+{
+    const auto &program = m_heatmaps[i] ? m_heatmaps[i]->program() : m_programs[i];
+    return program && program->dependsOnTime();
+}
+
+bool Grapher::isAnimated() const
+{
+    for(size_t i = 0; i < m_programs.size(); ++i)
+    {
+        if(m_visible[i] && isAnimated(i))
+            return true;
+    }
+    return false;
+}
+
+//Uses T or a parameter
+bool Grapher::isDynamic(size_t i) const
+{
+    return m_programs[i] &&
+            (m_programs[i]->dependencies() & ~uint64_t(iat::DEPENDS_ON_X));
+}
+
+bool Grapher::isDeepZoom() const
+{
+    return m_Xorigin != 0;
+}
+
+//Sets the X range in world coordinates, rebasing when it is too small for
+//double around its center
+void Grapher::setXRange(long double Xmin, long double Xmax)
+{
+    const long double center = (Xmin + Xmax) / 2;
+    const bool deep = Xmax - Xmin < std::fabs(center) * std::ldexp(1.0L, -DEEP_ZOOM_BITS);
+    m_Xorigin = deep ? center : 0;
+    m_Xmin = viewX(Xmin);
+    m_Xmax = viewX(Xmax);
+}
+
+//Zooming and panning change the view relative to the origin; once that
+//leaves or enters deep zoom, or drifts far from the origin, the view is
+//rebased. Every line is then sampled again.
+void Grapher::updateOrigin()
+{
+    const double span = m_Xmax - m_Xmin;
+    const long double center = worldX((m_Xmin + m_Xmax) / 2);
+    const bool deep = span < std::fabs(center) * std::ldexp(1.0L, -DEEP_ZOOM_BITS);
+    if(deep == isDeepZoom() &&
+       (!deep || std::fabs(m_Xmin + m_Xmax) / 2 < span * REBASE_SPANS))
+        return;
+    setXRange(worldX(m_Xmin), worldX(m_Xmax));
+    for(auto &key: m_sampleKeys)
+        key.valid = false;
+    for(auto &animation: m_animations)
+        animation.sampler.reset();
+    m_isBackgroundDirty = true;
+}
+
+long double Grapher::worldX(double x) const
+{
+    return m_Xorigin + x;
+}
+
+double Grapher::viewX(long double x) const
+{
+    return x - m_Xorigin;
+}
+
+//Deep zoom: sample k is at m_Xmin + k * step from the origin, so the
+//arguments stay apart however small the step, and are evaluated in long
+//double. Slower than the pool and uncached, so only used at deep zoom.
+void Grapher::sampleDeep(size_t i)
+{
+    const double step = std::min(m_dX, (m_Xmax - m_Xmin) / m_windowWidth);
+    Line &line = m_linesData[i].first;
+    if(!(step > 0))
+    {
+        line.clear();
+        return;
+    }
+    const size_t count = size_t((m_Xmax - m_Xmin) / step) + 1;
+    line.resize(count);
+    for(size_t k = 0; k < count; ++k)
+    {
+        const double x = m_Xmin + k * step;
+        line[k] = {x, curveValue(i, x)};
+    }
+    Profiler::count(Profiler::SAMPLES, count);
+    Profiler::count(Profiler::CURVES);
+}
+
+void Grapher::advanceTime()
+{
+    const Uint32 now = SDL_GetTicks();
+    if(m_isPlaying && m_timeStep > 0)
+        m_time += m_timeStep * m_timeSpeed;
+    else if(m_isPlaying && m_lastTimeTick != 0)
+        m_time += (now - m_lastTimeTick) / 1000.0 * m_timeSpeed;
+    m_lastTimeTick = now;
+    if(!m_isPlaying)
+        return;
+    for(size_t i = 0; i < m_programs.size(); ++i)
+    {
+        if(m_visible[i] && isAnimated(i))
+            resampleCurve(i);
+    }
+}
+
+void Grapher::sampleDynamic(size_t i)
+{
+    Animation &animation = m_animations[i];
+    const double step = m_dX * m_animationStride;
+    if(!animation.sampler || animation.sampler->program() != m_programs[i] ||
+       animation.Xmin != m_Xmin || animation.Xmax != m_Xmax || animation.step != step)
+    {
+        //Same grid as the sample pool, only coarser. A sampler of the same
+        //program keeps its buffers, so a pan does not allocate.
+        m_animationXs.clear();
+        for(double k = std::ceil(m_Xmin / step); k * step <= m_Xmax; ++k)
+            m_animationXs.push_back(k * step);
+        if(animation.sampler && animation.sampler->program() == m_programs[i])
+            animation.sampler->setXs(m_animationXs);
+        else
+            animation.sampler.reset(new iat::AnimationSampler(m_programs[i], m_animationXs));
+        animation.Xmin = m_Xmin;
+        animation.Xmax = m_Xmax;
+        animation.step = step;
+    }
+    animation.sampler->evaluate(m_time, m_parameterValues.data(), m_animationValues);
+    const auto &xs = animation.sampler->xs();
+    Line &line = m_linesData[i].first;
+    line.resize(xs.size());
+    for(size_t k = 0; k < xs.size(); ++k)
+        line[k] = {xs[k], m_animationValues[k]};
+    Profiler::count(Profiler::SAMPLES, xs.size());
+    Profiler::count(Profiler::CURVES);
+}
+
+void Grapher::setAnimationStride(int stride)
+{
+    stride = std::max(1, std::min(stride, int(MAX_ANIMATION_STRIDE)));
+    if(stride == m_animationStride)
+        return;
+    m_animationStride = stride;
+    for(size_t i = 0; i < m_programs.size(); ++i)
+    {
+        if(isDynamic(i))
+            resampleCurve(i);
+    }
+}
+
+void Grapher::setParameters(const std::vector<iat::Parameter> &parameters)
+{
+    std::vector<double> values;
+    for(const auto &parameter: parameters)
+    {
+        double value = parameter.value;
+        for(size_t j = 0; j < m_parameters.size(); ++j)
+        {
+            if(m_parameters[j].name == parameter.name)
+                value = std::max(parameter.min, std::min(m_parameterValues[j], parameter.max));
+        }
+        values.push_back(value);
+    }
+    m_parameters = parameters;
+    m_parameterValues.swap(values);
+    if(m_selectedParameter >= m_parameters.size())
+        m_selectedParameter = 0;
+    m_draggedParameter = -1;
+}
+
+//Only the curves that use parameter j are sampled again, and of those only
+//the instructions that use it are run
+void Grapher::setParameter(size_t j, double value)
+{
+    const iat::Parameter &parameter = m_parameters[j];
+    value = std::max(parameter.min, std::min(value, parameter.max));
+    if(value == m_parameterValues[j])
+        return;
+    m_parameterValues[j] = value;
+    const uint64_t bit = uint64_t(iat::DEPENDS_ON_PARAMETER) << j;
+    for(size_t i = 0; i < m_programs.size(); ++i)
+    {
+        if(m_programs[i] && (m_programs[i]->dependencies() & bit))
+            resampleCurve(i);
+    }
+    m_isDirty = true;
+}
+
+//Sliders are stacked in the bottom left corner, the last one lowest
+SDL_Rect Grapher::sliderRect(size_t j) const
+{
+    return {HUD_MARGIN, int(m_windowHeight) - HUD_MARGIN -
+                int(m_parameters.size() - j) * SLIDER_ROW_HEIGHT,
+            SLIDER_WIDTH, SLIDER_ROW_HEIGHT};
+}
+
+int Grapher::sliderAt(int x, int y) const
+{
+    for(size_t j = 0; j < m_parameters.size(); ++j)
+    {
+        const SDL_Rect rect = sliderRect(j);
+        if(x >= rect.x - SLIDER_KNOB_SIZE && x <= rect.x + rect.w + SLIDER_KNOB_SIZE &&
+           y >= rect.y && y < rect.y + rect.h)
+            return j;
+    }
+    return -1;
+}
+
+void Grapher::dragSlider(int x)
+{
+    const SDL_Rect rect = sliderRect(m_draggedParameter);
+    const iat::Parameter &parameter = m_parameters[m_draggedParameter];
+    const double fraction = std::max(0.0, std::min(double(x - rect.x) / rect.w, 1.0));
+    setParameter(m_draggedParameter, parameter.min + fraction * (parameter.max - parameter.min));
+}
+
+//Visible curves whose box misses the pick square are skipped, the others
+//are searched with their segment index, each with the distance of the
+//nearest curve so far as the radius
+int Grapher::pickCurve(int x, int y, double &curveX, double &curveY)
+{
+    const double scaleX = m_windowWidth / (m_Xmax - m_Xmin);
+    const double scaleY = m_windowHeight / (m_Ymax - m_Ymin);
+    //Window rows run along -Y
+    const double wx = m_Xmin + x / scaleX;
+    const double wy = -(m_Ymin + y / scaleY);
+    const double rx = PICK_RADIUS / scaleX, ry = PICK_RADIUS / scaleY;
+    int picked = -1;
+    double radius = PICK_RADIUS;
+    for(size_t i = 0; i < m_linesData.size(); ++i)
+    {
+        if(!m_visible[i] || !m_bounds[i].intersects(wx - rx, wx + rx, wy - ry, wy + ry))
+            continue;
+        const Line &line = m_linesData[i].first;
+        SegmentIndex &index = m_segmentIndices[i];
+        if(!index.isValid())
+            index.build(line);
+        SegmentIndex::Hit hit;
+        if(!index.nearest(line, wx, wy, scaleX, scaleY, radius, hit))
+            continue;
+        picked = i;
+        radius = hit.distance;
+        curveX = hit.x;
+        curveY = hit.y;
+    }
+    //The samples are joined by straight lines; an expression gives the
+    //value of the curve itself at that X
+    if(picked >= 0 && m_programs[picked])
+    {
+        const double value = curveValue(picked, curveX);
+        if(std::isfinite(value))
+            curveY = value;
+    }
+    return picked;
+}
+
+void Grapher::updateHover()
+{
+    //Nothing is read out while the view or a slider is dragged
+    if(!m_hasCursor || m_isMoving || m_draggedParameter >= 0)
+    {
+        m_hoveredCurve = -1;
+        return;
+    }
+    m_hoveredCurve = pickCurve(m_cursorX, m_cursorY, m_hoverX, m_hoverY);
+}
+
+double Grapher::curveValue(size_t i, double x) const
+{
+    try
+    {
+        if(m_Xorigin != 0)
+            return m_programs[i]->evaluateExtended(worldX(x), m_time, m_parameterValues.data());
+        return m_programs[i]->evaluate(x, m_time, m_parameterValues.data());
+    }
+    catch(std::exception &)
+    {
+        return NAN;
+    }
+}
+
+//Data and stream series; expressions go through sampleExpressions()
+void Grapher::calculateLine(size_t i, Line &line)
+{
+    Profiler::count(Profiler::CURVES);
+    if(m_series[i])
+        m_series[i]->sample(Xmin(), Xmax(), m_windowWidth, line);
+    else if(m_streams[i])
+        m_streams[i]->sample(Xmin(), Xmax(), m_windowWidth, line);
+    //Series are sampled in world X, lines are kept relative to the origin
+    if(m_Xorigin != 0)
+    {
+        for(auto &point: line)
+            point.first = viewX(point.first);
+    }
+}
+
+void Grapher::draw_all()
+{
+    {
+        ProfileScope scope(m_profiler, "background");
+        if(!m_softRenderer && SDL_RenderTargetSupported(m_renderer))
+        {
+            updateBackground();
+            SDL_RenderCopy(m_renderer, m_backgroundTexture, NULL, NULL);
+        }
+        else
+        {
+            draw_background();
+        }
+    }
+    {
+        ProfileScope scope(m_profiler, "heatmaps");
+        draw_heatmaps();
+    }
+    {
+        ProfileScope scope(m_profiler, "curves");
+        draw_all_graphs();
+    }
+    if(m_showFeatures)
+    {
+        ProfileScope scope(m_profiler, "features");
+        updateFeatures();
+        draw_features();
+    }
+    ProfileScope scope(m_profiler, "labels");
+    draw_text_info();
+}
+
+//Scales about X = 0 of the view, which at deep zoom is the origin
+//Refused once the next step would make grid lines and samples one span
+//apart indistinguishable in long double X or double Y
+void Grapher::zoomIn()
+{
+    const long double centerX = worldX((m_Xmin + m_Xmax) / 2);
+    const double centerY = (m_Ymin + m_Ymax) / 2;
+    if(0.9 * (m_Xmax - m_Xmin) < std::fabs(centerX) * std::ldexp(1.0L, -MAX_ZOOM_BITS_X) ||
+       0.9 * (m_Ymax - m_Ymin) < std::fabs(centerY) * std::ldexp(1.0, -MAX_ZOOM_BITS_Y))
+        return;
+    m_Xmin *= 0.9;
+    m_Xmax *= 0.9;
+    m_Ymin *= 0.9;
+    m_Ymax *= 0.9;
+    invalidateLinesData();
+    reloadTextData();
+}
+
+void Grapher::zoomOut()
+{
+    m_Xmin *= 1.1;
+    m_Xmax *= 1.1;
+    m_Ymin *= 1.1;
+    m_Ymax *= 1.1;
+    invalidateLinesData();
+    reloadTextData();
 }
 
 void Grapher::move(Direction dir, double vel)
@@ -407,7 +1988,7 @@ void Grapher::move(Direction dir, double vel)
             m_Xmax -= vel;
         break;
     }
-    calculateLinesData();
+    invalidateLinesData();
     reloadTextData();
 }
 
@@ -419,76 +2000,81 @@ void Grapher::move(int dx, int dy)
     m_Ymax -= 0.01 * sin_;
     m_Xmin -= 0.01 * cos_;
     m_Xmax -= 0.01 * cos_;
-    calculateLinesData();
+    invalidateLinesData();
     reloadTextData();
 }
 
 void Grapher::setXmin(double Xmin)
 {
-    m_Xmin = Xmin;
-    calculateLinesData();
+    m_Xmin = viewX(Xmin);
+    invalidateLinesData();
     reloadTextData();
 }
 
 void Grapher::setXmax(double Xmax)
 {
-    m_Xmax = Xmax;
-    calculateLinesData();
+    m_Xmax = viewX(Xmax);
+    invalidateLinesData();
     reloadTextData();
 }
 
 void Grapher::setYmin(double Ymin)
 {
     m_Ymin = Ymin;
-    calculateLinesData();
+    invalidateLinesData();
     reloadTextData();
 }
 
 void Grapher::setYmax(double Ymax)
 {
     m_Ymax = Ymax;
-    calculateLinesData();
+    invalidateLinesData();
     reloadTextData();
 }
 
 void Grapher::setDX(double dX)
 {
     m_dX = dX;
-    calculateLinesData();
+    invalidateLinesData();
 }
 
 void Grapher::setDrawAxis(bool drawAxis)
 {
     m_drawAxis = drawAxis;
-    calculateLinesData();
+    m_isBackgroundDirty = true;
+    invalidateLinesData();
     reloadTextData();
 }
 
 void Grapher::setDrawGrid(bool drawGrid)
 {
     m_drawGrid = drawGrid;
+    m_isBackgroundDirty = true;
+    m_isDirty = true;
 }
 
 void Grapher::setColorAxis(const SDL_Color &colorAxis)
 {
     m_colorAxis = colorAxis;
-    calculateLinesData();
+    m_isBackgroundDirty = true;
+    m_isDirty = true;
 }
 
 void Grapher::setColorGrid(const SDL_Color &colorGrid)
 {
     m_colorGrid = colorGrid;
-    calculateLinesData();
+    m_isBackgroundDirty = true;
+    m_isDirty = true;
 }
 
 double Grapher::Xmin() const
 {
-    return m_Xmin;
+    return worldX(m_Xmin);
 }
 
 double Grapher::Xmax() const
 {
-    return m_Xmax;
+    return worldX(m_Xmax);
 }
 
 double Grapher::Ymin() const
@@ -528,55 +2114,217 @@ SDL_Color Grapher::colorGrid() const
 
 void Grapher::fillTextData()
 {
-    std::setprecision(1);
-    m_labels.push_back(std::make_tuple(doubleToString(m_Xmin, 1), 20, m_windowHeight / 2 - 40));
-    m_labels.push_back(std::make_tuple(doubleToString(m_Xmax, 1), m_windowWidth - 100, m_windowHeight / 2 - 40));
+    m_labels.push_back(std::make_tuple(doubleToString(Xmin(), 1), 20, m_windowHeight / 2 - 40));
+    m_labels.push_back(std::make_tuple(doubleToString(Xmax(), 1), m_windowWidth - 100, m_windowHeight / 2 - 40));
     m_labels.push_back(std::make_tuple(doubleToString(m_Ymin, 1), m_windowWidth / 2 + 20, m_windowHeight - 40));
     m_labels.push_back(std::make_tuple(doubleToString(m_Ymax, 1), m_windowWidth / 2 + 20, 20));
+}
+
+void Grapher::reloadTextData()
+{
+    ProfileScope scope(m_profiler, "text");
+    m_labels.clear();
+    fillTextData();
+    m_isDirty = true;
+}
 
-    for(unsigned short int i {0}; i < m_labels.size(); ++i)
+void Grapher::updateBackground()
+{
+    int width, height;
+    SDL_GetRendererOutputSize(m_renderer, &width, &height);
+    if(m_backgroundTexture)
+    {
+        int texWidth, texHeight;
+        SDL_QueryTexture(m_backgroundTexture, NULL, NULL, &texWidth, &texHeight);
+        if(texWidth != width || texHeight != height)
+        {
+            SDL_DestroyTexture(m_backgroundTexture);
+            SDL_DestroyTexture(m_backgroundScratch);
+            m_backgroundTexture = m_backgroundScratch = nullptr;
+        }
+    }
+    if(!m_backgroundTexture)
+    {
+        m_backgroundTexture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888,
+                                                SDL_TEXTUREACCESS_TARGET, width, height);
+        m_backgroundScratch = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888,
+                                                SDL_TEXTUREACCESS_TARGET, width, height);
+        m_isBackgroundDirty = true;
+    }
+    if(!m_isBackgroundDirty && m_bgXmin == m_Xmin && m_bgXmax == m_Xmax &&
+       m_bgYmin == m_Ymin && m_bgYmax == m_Ymax)
+        return;
+    //A pure pan keeps the scale, so the old picture can be shifted and only
+    //the exposed strips have to be drawn again
+    static const double eps = 0.001;
+    double bgWidth = map(m_Xmin, m_Xmax, 0, m_windowWidth, m_bgXmax) -
+            map(m_Xmin, m_Xmax, 0, m_windowWidth, m_bgXmin);
+    double bgHeight = map(m_Ymin, m_Ymax, 0, m_windowHeight, m_bgYmax) -
+            map(m_Ymin, m_Ymax, 0, m_windowHeight, m_bgYmin);
+    //Tick labels pinned to a window edge do not move with the world, so
+    //they can only be scrolled while they sit next to the axes
+    if(!m_isBackgroundDirty && fabs(bgWidth - m_windowWidth) < eps &&
+       fabs(bgHeight - m_windowHeight) < eps && m_bgTicksAnchored && tickLabelsAnchored())
     {
-        SDL_Surface *textSurface = TTF_RenderText_Solid(m_font,
-                                   std::get<TEXT>(m_labels.at(i)).c_str(),
-                                                  m_colorText);
-        SDL_Texture *texture = SDL_CreateTextureFromSurface(m_renderer, textSurface);
-        SDL_FreeSurface(textSurface);
-        SDL_Rect textRect;
-        textRect.x = std::get<TEXT_X>(m_labels.at(i));
-        textRect.y = std::get<TEXT_Y>(m_labels.at(i));
-        SDL_QueryTexture(texture, NULL, NULL, &textRect.w, &textRect.h);
-        m_textData.push_back(std::make_pair(texture, textRect));
+        double dx = map(m_Xmin, m_Xmax, 0, m_windowWidth, m_bgXmin);
+        double dy = map(m_Ymin, m_Ymax, 0, m_windowHeight, m_bgYmin);
+        if(fabs(dx - round(dx)) < eps && fabs(dy - round(dy)) < eps &&
+           scrollBackground(round(dx), round(dy)))
+            return;
     }
+    rebuildBackground();
+}
 
+void Grapher::rebuildBackground()
+{
+    Profiler::count(Profiler::BACKGROUNDS);
+    SDL_SetRenderTarget(m_renderer, m_backgroundTexture);
+    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 255);
+    SDL_RenderClear(m_renderer);
+    draw_background();
+    SDL_SetRenderTarget(m_renderer, NULL);
+    m_bgTicksAnchored = tickLabelsAnchored();
+    m_bgXmin = m_Xmin;
+    m_bgXmax = m_Xmax;
+    m_bgYmin = m_Ymin;
+    m_bgYmax = m_Ymax;
+    m_isBackgroundDirty = false;
 }
 
-void Grapher::reloadTextData()
+bool Grapher::scrollBackground(int dx, int dy)
 {
-    for(auto &d: m_textData)
-        SDL_DestroyTexture(d.first);
-    m_textData.clear();
-    m_labels.clear();
-    fillTextData();
+    int width, height;
+    SDL_QueryTexture(m_backgroundTexture, NULL, NULL, &width, &height);
+    if(abs(dx) >= width || abs(dy) >= height)
+        return false;
+    SDL_SetRenderTarget(m_renderer, m_backgroundScratch);
+    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 255);
+    SDL_RenderClear(m_renderer);
+    SDL_Rect shifted {dx, dy, width, height};
+    SDL_SetTextureBlendMode(m_backgroundTexture, SDL_BLENDMODE_NONE);
+    SDL_RenderCopy(m_renderer, m_backgroundTexture, NULL, &shifted);
+    SDL_Rect exposed[2];
+    int strips = 0;
+    if(dx > 0)
+        exposed[strips++] = {0, 0, dx, height};
+    else if(dx < 0)
+        exposed[strips++] = {width + dx, 0, -dx, height};
+    if(dy > 0)
+        exposed[strips++] = {0, 0, width, dy};
+    else if(dy < 0)
+        exposed[strips++] = {0, height + dy, width, -dy};
+    for(int k = 0; k < strips; ++k)
+    {
+        SDL_RenderSetClipRect(m_renderer, &exposed[k]);
+        draw_background();
+    }
+    SDL_RenderSetClipRect(m_renderer, NULL);
+    SDL_SetRenderTarget(m_renderer, NULL);
+    std::swap(m_backgroundTexture, m_backgroundScratch);
+    m_bgXmin = m_Xmin;
+    m_bgXmax = m_Xmax;
+    m_bgYmin = m_Ymin;
+    m_bgYmax = m_Ymax;
+    return true;
 }
 
 void Grapher::draw_axis()
 {
     if(m_drawAxis)
     {
-        SDL_SetRenderDrawColor(m_renderer,  m_colorAxis.r, m_colorAxis.g, m_colorAxis.b,
-                               m_colorAxis.a);
+        setDrawColor(m_colorAxis);
         //Horizontal
-        SDL_RenderDrawLine(m_renderer, map(m_Xmin, m_Xmax, 0, m_windowWidth, m_Xmin),
-                           map(m_Ymin, m_Ymax, 0, m_windowHeight, 0),
-                           map(m_Xmin, m_Xmax, 0, m_windowWidth, m_Xmax),
-                           map(m_Ymin, m_Ymax, 0, m_windowHeight, 0)
-                          );
+        drawLine(map(m_Xmin, m_Xmax, 0, m_windowWidth, m_Xmin),
+                 map(m_Ymin, m_Ymax, 0, m_windowHeight, 0),
+                 map(m_Xmin, m_Xmax, 0, m_windowWidth, m_Xmax),
+                 map(m_Ymin, m_Ymax, 0, m_windowHeight, 0)
+                );
          //Vertical
-        SDL_RenderDrawLine(m_renderer, map(m_Xmin, m_Xmax, 0, m_windowWidth, 0),
-                            map(m_Ymin, m_Ymax, 0, m_windowHeight, m_Ymin),
-                            map(m_Xmin, m_Xmax, 0, m_windowWidth, 0),
-                            map(m_Ymin, m_Ymax, 0, m_windowHeight, m_Ymax)
-                            );
+        drawLine(map(m_Xmin, m_Xmax, 0, m_windowWidth, viewX(0)),
+                 map(m_Ymin, m_Ymax, 0, m_windowHeight, m_Ymin),
+                 map(m_Xmin, m_Xmax, 0, m_windowWidth, viewX(0)),
+                 map(m_Ymin, m_Ymax, 0, m_windowHeight, m_Ymax)
+                );
+    }
+}
+
+void Grapher::draw_background()
+{
+    if(m_drawGrid)
+        draw_grid();
+    if(m_drawAxis)
+    {
+        draw_axis();
+        draw_ticks();
+    }
+}
+
+void Grapher::gridSteps(double span, double pixels, double baseStep, double &major,
+                        double &minor, double &minorWeight)
+{
+    //Smallest step of the form baseStep * {1, 2, 5} * 10^k whose lines are
+    //at least MIN_MAJOR_SPACING pixels apart
+    double unit = span / pixels * MIN_MAJOR_SPACING / baseStep;
+    double magnitude = pow(10, floor(log10(unit)));
+    double mantissa = 10;
+    for(double m: {1.0, 2.0, 5.0})
+    {
+        if(m * magnitude >= unit)
+        {
+            mantissa = m;
+            break;
+        }
+    }
+    major = mantissa * magnitude * baseStep;
+    minor = major / (mantissa == 2 ? 4 : 5);
+    //Minor lines fade in between MIN_MINOR_SPACING and FULL_MINOR_SPACING
+    double minorSpacing = minor / span * pixels;
+    minorWeight = (minorSpacing - MIN_MINOR_SPACING) / (FULL_MINOR_SPACING - MIN_MINOR_SPACING);
+    minorWeight = std::min(1.0, std::max(0.0, minorWeight));
+}
+
+SDL_Color Grapher::fadeColor(const SDL_Color &color, double weight)
+{
+    //The background is white, so fading is mixing with white
+    SDL_Color faded;
+    faded.r = 255 - (255 - color.r) * weight;
+    faded.g = 255 - (255 - color.g) * weight;
+    faded.b = 255 - (255 - color.b) * weight;
+    faded.a = 255;
+    return faded;
+}
+
+void Grapher::draw_grid_lines(bool vertical, double step, double skipStep)
+{
+    //Vertical lines are at multiples of the step in world X, which at deep
+    //zoom is far from the view's origin
+    const long double from = vertical ? worldX(m_Xmin) : m_Ymin;
+    const long double to = vertical ? worldX(m_Xmax) : m_Ymax;
+    const long double first = std::ceil(from / step), last = std::floor(to / step);
+    //Also rejects NaN steps of a degenerate viewport
+    if(!(last - first < MAX_GRID_LINES))
+        return;
+    const int skipEvery = skipStep > 0 ? round(skipStep / step) : 0;
+    //Counted by offset, as far from zero ++k may not change k
+    const long long count = (long long)(last - first);
+    for(long long j = 0; j <= count; ++j)
+    {
+        const long double k = first + j;
+        if(k == 0 || (skipEvery && std::fmod(k, (long double)skipEvery) == 0))
+            continue;
+        double v = vertical ? viewX(k * step) : double(k * step);
+        if(vertical)
+            drawLine(map(m_Xmin, m_Xmax, 0, m_windowWidth, v),
+                     map(m_Ymin, m_Ymax, 0, m_windowHeight, m_Ymin),
+                     map(m_Xmin, m_Xmax, 0, m_windowWidth, v),
+                     map(m_Ymin, m_Ymax, 0, m_windowHeight, m_Ymax)
+                    );
+        else
+            drawLine(map(m_Xmin, m_Xmax, 0, m_windowWidth, m_Xmin),
+                     map(m_Ymin, m_Ymax, 0, m_windowHeight, v),
+                     map(m_Xmin, m_Xmax, 0, m_windowWidth, m_Xmax),
+                     map(m_Ymin, m_Ymax, 0, m_windowHeight, v)
+                    );
     }
 }
 
@@ -584,67 +2332,429 @@ void Grapher::draw_grid()
 {
     if(m_drawGrid)
     {
-        SDL_SetRenderDrawColor(m_renderer, m_colorGrid.r, m_colorGrid.g, m_colorGrid.b,
-                               m_colorGrid.a);
-        //Vertical lines
-        for(double x = m_Xmin; x < m_Xmax; x += m_gridStepX)
+        //Level of detail: the steps follow the zoom, so the number of lines
+        //stays the same at every zoom level. Lines are anchored to multiples
+        //of the step so that a scrolled background matches a redrawn one
+        double majorX, minorX, weightX, majorY, minorY, weightY;
+        gridSteps(m_Xmax - m_Xmin, m_windowWidth, m_gridStepX, majorX, minorX, weightX);
+        gridSteps(m_Ymax - m_Ymin, m_windowHeight, m_gridStepY, majorY, minorY, weightY);
+        if(weightX > 0)
         {
-            if(x == 0) continue;
-            SDL_RenderDrawLine(m_renderer, map(m_Xmin, m_Xmax, 0, m_windowWidth, x),
-                               map(m_Ymin, m_Ymax, 0, m_windowHeight, m_Ymin),
-                               map(m_Xmin, m_Xmax, 0, m_windowWidth, x),
-                               map(m_Ymin, m_Ymax, 0, m_windowHeight, m_Ymax)
-                              );
+            setDrawColor(fadeColor(m_colorGrid, MINOR_LINE_WEIGHT * weightX));
+            draw_grid_lines(true, minorX, majorX);
         }
-        //Horizontal lines
-        for(double y = m_Ymin; y < m_Ymax; y += m_gridStepY)
+        if(weightY > 0)
         {
-            if(y == 0) continue;
-            SDL_RenderDrawLine(m_renderer, map(m_Xmin, m_Xmax, 0, m_windowWidth, m_Xmin),
-                               map(m_Ymin, m_Ymax, 0, m_windowHeight, y),
-                               map(m_Xmin, m_Xmax, 0, m_windowWidth, m_Xmax),
-                               map(m_Ymin, m_Ymax, 0, m_windowHeight, y)
-                              );
+            setDrawColor(fadeColor(m_colorGrid, MINOR_LINE_WEIGHT * weightY));
+            draw_grid_lines(false, minorY, majorY);
         }
+        setDrawColor(m_colorGrid);
+        draw_grid_lines(true, majorX, 0);
+        draw_grid_lines(false, majorY, 0);
+    }
+}
+
+std::string Grapher::tickLabel(long double value, double step)
+{
+    if(fabs(step) >= 1e6 || fabs(step) < 1e-6)
+    {
+        //At deep zoom neighbouring ticks differ only in late digits
+        int digits = 4;
+        if(value != 0)
+            digits = std::max(digits, int(std::ceil(std::log10(std::fabs(value) / fabs(step)))) + 2);
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.*Lg", std::min(digits, int(LDBL_DIG) + 2), value);
+        return buffer;
+    }
+    int prec = 0;
+    while(prec < PREC && fabs(step * pow(10, prec) - round(step * pow(10, prec))) > 1e-6)
+        ++prec;
+    //Avoids printing -0.0 for values rounded to zero
+    if(fabs(value) < step / 2)
+        value = 0;
+    return doubleToString(value, prec);
+}
+
+bool Grapher::tickLabelsAnchored()
+{
+    const int lineHeight = m_tickAtlas ? m_tickAtlas->lineHeight() : 0;
+    double axisX = map(m_Xmin, m_Xmax, 0, m_windowWidth, viewX(0));
+    double axisY = map(m_Ymin, m_Ymax, 0, m_windowHeight, 0);
+    return axisX >= 0 && axisX <= m_windowWidth / 2 &&
+            axisY >= 0 && axisY + TICK_LABEL_MARGIN + lineHeight <= m_windowHeight;
+}
+
+void Grapher::draw_ticks()
+{
+    double majorX, minorX, weightX, majorY, minorY, weightY;
+    gridSteps(m_Xmax - m_Xmin, m_windowWidth, m_gridStepX, majorX, minorX, weightX);
+    gridSteps(m_Ymax - m_Ymin, m_windowHeight, m_gridStepY, majorY, minorY, weightY);
+    const int lineHeight = m_tickAtlas ? m_tickAtlas->lineHeight() : 0;
+    //Labels stay next to the axes and are pinned to the window edge when an
+    //axis leaves the window
+    double axisX = map(m_Xmin, m_Xmax, 0, m_windowWidth, viewX(0));
+    double axisY = map(m_Ymin, m_Ymax, 0, m_windowHeight, 0);
+    int labelY = std::min(std::max(axisY, 0.0),
+                          m_windowHeight - TICK_LABEL_MARGIN - lineHeight) + TICK_LABEL_MARGIN;
+
+    setDrawColor(m_colorAxis);
+    long double firstX = std::ceil(worldX(m_Xmin) / majorX);
+    long double lastX = std::floor(worldX(m_Xmax) / majorX);
+    int lastLabelEnd = INT_MIN;
+    //Both loops count by offset, see draw_grid_lines
+    const long long countX = lastX - firstX < MAX_GRID_LINES ? (long long)(lastX - firstX) : -1;
+    for(long long j = 0; j <= countX; ++j)
+    {
+        const long double k = firstX + j;
+        if(k == 0) continue;
+        double x = map(m_Xmin, m_Xmax, 0, m_windowWidth, viewX(k * majorX));
+        drawLine(x, axisY - TICK_SIZE, x, axisY + TICK_SIZE);
+        if(!m_tickAtlas) continue;
+        std::string label = tickLabel(k * majorX, majorX);
+        int width = m_tickAtlas->textWidth(label);
+        int left = round(x) - width / 2;
+        if(left <= lastLabelEnd) continue;
+        drawText(*m_tickAtlas, label, left, labelY, m_colorText);
+        lastLabelEnd = left + width + TICK_LABEL_MARGIN;
+    }
+    //Screen rows run along -Y, see calculateLinesData
+    double first = ceil(m_Ymin / majorY), last = floor(m_Ymax / majorY);
+    int lastLabelBottom = INT_MIN;
+    const long long countY = last - first < MAX_GRID_LINES ? (long long)(last - first) : -1;
+    for(long long j = 0; j <= countY; ++j)
+    {
+        const double k = first + j;
+        if(k == 0) continue;
+        double y = map(m_Ymin, m_Ymax, 0, m_windowHeight, k * majorY);
+        drawLine(axisX - TICK_SIZE, y, axisX + TICK_SIZE, y);
+        if(!m_tickAtlas) continue;
+        int top = round(y) - lineHeight / 2;
+        if(top <= lastLabelBottom) continue;
+        std::string label = tickLabel(-k * majorY, majorY);
+        int left = axisX + TICK_LABEL_MARGIN;
+        if(axisX < 0)
+            left = TICK_LABEL_MARGIN;
+        else if(axisX > m_windowWidth / 2)
+            left = m_windowWidth - TICK_LABEL_MARGIN - m_tickAtlas->textWidth(label);
+        drawText(*m_tickAtlas, label, left, top, m_colorText);
+        lastLabelBottom = top + lineHeight;
+    }
+    if(m_tickAtlas)
+        flushText(*m_tickAtlas);
+}
+
+void Grapher::drawText(GlyphAtlas &atlas, const std::string &text, int x, int y,
+                       const SDL_Color &color)
+{
+    if(m_softRenderer)
+    {
+        m_softRenderer->setDrawColor(color);
+        m_softRenderer->drawText(atlas, text, x, y);
+    }
+    else
+    {
+        atlas.queueText(text, x, y, color);
     }
 }
 
-void Grapher::draw_graph(const Line &line, const SDL_Color &color)
+void Grapher::flushText(GlyphAtlas &atlas)
 {
-    SDL_SetRenderDrawColor(m_renderer, color.r, color.g, color.b, color.a);
-    auto oldX = line.at(0).first;
-    auto oldY = line.at(0).second;
-    for(int i = 1; i < line.size(); ++i)
+    if(!m_softRenderer)
+        atlas.flush(m_renderer);
+}
+
+void Grapher::setDrawColor(const SDL_Color &color)
+{
+    if(m_softRenderer)
+        m_softRenderer->setDrawColor(color);
+    else
+        SDL_SetRenderDrawColor(m_renderer, color.r, color.g, color.b, color.a);
+}
+
+void Grapher::drawLine(double x1, double y1, double x2, double y2)
+{
+    Profiler::count(Profiler::SEGMENTS);
+    if(m_softRenderer)
+        m_softRenderer->drawLine(x1, y1, x2, y2);
+    else
+        SDL_RenderDrawLine(m_renderer, x1, y1, x2, y2);
+}
+
+void Grapher::draw_graph(const Line &line, const SDL_Color &color, const CurveBounds &bounds,
+                         double offset)
+{
+    if(line.empty())
+        return;
+    setDrawColor(color);
+    //Same transform as map(), with Y pointing down
+    const double scaleX = m_windowWidth / (m_Xmax - m_Xmin);
+    const double scaleY = m_windowHeight / (m_Ymax - m_Ymin);
+    bounds.visibleRanges(m_Xmin, m_Xmax, -m_Ymax, -m_Ymin, m_visibleRanges);
+    for(const auto &range: m_visibleRanges)
     {
-        auto newX = line.at(i).first;
-        auto newY = line.at(i).second;
-        //lineRGBA(m_renderer, oldX, oldY, newX, newY, color.r, color.g, color.b, color.a);
-        SDL_RenderDrawLine(m_renderer, oldX, oldY, newX, newY);
-        oldX = newX;
-        oldY = newY;
+        auto oldX = (line[range.first].first - m_Xmin) * scaleX;
+        auto oldY = (-line[range.first].second - m_Ymin) * scaleY + offset;
+        for(size_t i = range.first + 1; i < range.second; ++i)
+        {
+            auto newX = (line[i].first - m_Xmin) * scaleX;
+            auto newY = (-line[i].second - m_Ymin) * scaleY + offset;
+            //lineRGBA(m_renderer, oldX, oldY, newX, newY, color.r, color.g, color.b, color.a);
+            //A point that failed to evaluate breaks the curve
+            if(std::isfinite(oldX) && std::isfinite(oldY) && std::isfinite(newX) &&
+               std::isfinite(newY))
+                drawLine(oldX, oldY, newX, newY);
+            oldX = newX;
+            oldY = newY;
+        }
     }
 }
 
 void Grapher::draw_text_info()
 {
-    for(const auto &t: m_textData)
+    if(!m_glyphAtlas)
+        return;
+    for(const auto &label: m_labels)
+    {
+        drawText(*m_glyphAtlas, std::get<TEXT>(label), std::get<TEXT_X>(label),
+                 std::get<TEXT_Y>(label), m_colorText);
+    }
+    flushText(*m_glyphAtlas);
+}
+
+void Grapher::draw_hud()
+{
+    ProfileScope scope(m_profiler, "hud");
+    GlyphAtlas *atlas = m_tickAtlas ? m_tickAtlas.get() : m_glyphAtlas.get();
+    if(!atlas)
+        return;
+    std::vector<std::string> lines;
+    lines.push_back("frame " + doubleToString(m_profiler.lastFrameTime(), 2) + " ms  p50 " +
+                    doubleToString(m_profiler.frameTimePercentile(50), 2) + "  p95 " +
+                    doubleToString(m_profiler.frameTimePercentile(95), 2) + "  p99 " +
+                    doubleToString(m_profiler.frameTimePercentile(99), 2) + "  (" +
+                    std::to_string(m_profiler.framesRecorded()) + " frames)");
+    std::string counters;
+    for(int i = 0; i < Profiler::COUNTER_COUNT; ++i)
+        counters += std::string(i ? "  " : "") + Profiler::counterName(Profiler::Counter(i)) +
+                " " + std::to_string(m_profiler.lastFrameCount(Profiler::Counter(i)));
+    lines.push_back(counters);
+    lines.push_back("sample pool " + std::to_string(m_samplePool->blocks()) + " blocks  " +
+                    doubleToString(m_samplePool->bytes() / 1048576.0, 1) + " MB");
+    for(const auto &s: m_profiler.lastFrame())
     {
-        SDL_RenderCopy(m_renderer, t.first, NULL, &t.second);
+        std::string name = std::string(2 * s.depth, ' ') + s.name;
+        if(s.index >= 0)
+            name += " " + std::to_string(s.index);
+        lines.push_back(name + "  " + doubleToString(s.duration, 3) + " ms");
     }
+    if(isAnimated())
+        lines.push_back("T " + doubleToString(m_time, 2) + (m_isPlaying ? "" : " (paused)") +
+                        "  stride " + std::to_string(m_animationStride) + " dX");
+    if(isDeepZoom())
+        lines.push_back("deep zoom  origin " + tickLabel(m_Xorigin, m_Xmax - m_Xmin) +
+                        "  long double");
+    if(m_profiler.isTracing())
+        lines.push_back("tracing (T to stop)");
+    int width = 0;
+    for(const auto &line: lines)
+        width = std::max(width, atlas->textWidth(line));
+    SDL_Rect box {HUD_MARGIN / 2, HUD_MARGIN / 2, width + HUD_MARGIN,
+                  int(lines.size()) * atlas->lineHeight() + HUD_MARGIN};
+    SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 220);
+    SDL_RenderFillRect(m_renderer, &box);
+    SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_NONE);
+    for(size_t i = 0; i < lines.size(); ++i)
+        drawText(*atlas, lines[i], HUD_MARGIN, HUD_MARGIN + i * atlas->lineHeight(), m_colorText);
+    flushText(*atlas);
 }
 
 void Grapher::draw_all_graphs()
 {
-    for(const auto &ld: m_linesData)
+    //Curves are drawn at the row of -y, so the visible world Y range is
+    //[-Ymax, -Ymin]
+    for(size_t i = 0; i < m_linesData.size(); ++i)
     {
-        draw_graph(ld.first, ld.second);
+        if(m_visible[i] && m_bounds[i].intersects(m_Xmin, m_Xmax, -m_Ymax, -m_Ymin))
+            draw_graph(m_linesData[i].first, m_linesData[i].second, m_bounds[i]);
     }
+    //The selected curve is drawn a second time one pixel lower, so it
+    //stands out in bold
+    const int i = m_selectedCurve;
+    if(i >= 0 && m_visible[i] && m_bounds[i].intersects(m_Xmin, m_Xmax, -m_Ymax, -m_Ymin))
+        draw_graph(m_linesData[i].first, m_linesData[i].second, m_bounds[i], 1);
+}
+
+//Over the grid and under the curves; the alpha of an entry's color is the
+//opacity of its field
+void Grapher::draw_heatmaps()
+{
+    const Heatmap::View view {m_Xorigin, m_Xmin, m_Xmax, m_Ymin, m_Ymax, int(m_windowWidth),
+                              int(m_windowHeight), m_time, &m_parameterValues};
+    for(size_t i = 0; i < m_heatmaps.size(); ++i)
+    {
+        if(!m_heatmaps[i] || !m_visible[i])
+            continue;
+        m_heatmaps[i]->setColors(m_colormap, m_heatmapZmin, m_heatmapZmax);
+        if(m_softRenderer)
+            m_heatmaps[i]->draw(*m_softRenderer, view, m_exprList[i].second.a);
+        else
+            m_heatmaps[i]->draw(m_renderer, view, m_exprList[i].second.a);
+    }
+}
+
+void Grapher::updateFeatures()
+{
+    if(!m_isFeaturesDirty)
+        return;
+    std::vector<FeatureFinder::Curve> curves;
+    for(size_t i = 0; i < m_linesData.size(); ++i)
+    {
+        if(m_visible[i] && !m_bounds[i].empty())
+            curves.push_back({int(i), m_programs[i].get(), &m_linesData[i].first, &m_bounds[i],
+                              m_time, m_parameterValues.data(), m_Xorigin});
+    }
+    m_features = m_featureFinder.find(curves);
+    m_isFeaturesDirty = false;
+}
+
+void Grapher::draw_features()
+{
+    //Roots are crosses, extrema squares and intersections diamonds, in the
+    //color of the (first) curve
+    const double scaleX = m_windowWidth / (m_Xmax - m_Xmin);
+    const double scaleY = m_windowHeight / (m_Ymax - m_Ymin);
+    const double s = FEATURE_MARKER_SIZE;
+    for(const auto &feature: m_features)
+    {
+        const double x = (feature.x - m_Xmin) * scaleX;
+        const double y = (-feature.y - m_Ymin) * scaleY;
+        if(x < -s || x > m_windowWidth + s || y < -s || y > m_windowHeight + s)
+            continue;
+        setDrawColor(m_linesData[feature.curve].second);
+        switch(feature.kind)
+        {
+        case FeatureFinder::Kind::ROOT:
+            drawLine(x - s, y - s, x + s, y + s);
+            drawLine(x - s, y + s, x + s, y - s);
+            break;
+        case FeatureFinder::Kind::MINIMUM:
+        case FeatureFinder::Kind::MAXIMUM:
+            drawLine(x - s, y - s, x + s, y - s);
+            drawLine(x + s, y - s, x + s, y + s);
+            drawLine(x + s, y + s, x - s, y + s);
+            drawLine(x - s, y + s, x - s, y - s);
+            break;
+        case FeatureFinder::Kind::INTERSECTION:
+            drawLine(x, y - s, x + s, y);
+            drawLine(x + s, y, x, y + s);
+            drawLine(x, y + s, x - s, y);
+            drawLine(x - s, y, x, y - s);
+            break;
+        }
+    }
+}
+
+void Grapher::draw_sliders()
+{
+    GlyphAtlas *atlas = m_tickAtlas ? m_tickAtlas.get() : m_glyphAtlas.get();
+    //Rewritten in place, so a slider drag does not allocate
+    std::vector<std::string> &labels = m_sliderLabels;
+    labels.resize(m_parameters.size());
+    int width = 0;
+    for(size_t j = 0; j < m_parameters.size(); ++j)
+    {
+        labels[j].assign(m_parameters[j].name);
+        labels[j] += " = ";
+        labels[j] += doubleToString(m_parameterValues[j], 3);
+        if(atlas)
+            width = std::max(width, atlas->textWidth(labels[j]));
+    }
+    const SDL_Rect first = sliderRect(0);
+    SDL_Rect box {first.x - HUD_MARGIN / 2, first.y - HUD_MARGIN / 2,
+                  SLIDER_WIDTH + 2 * SLIDER_KNOB_SIZE + width + HUD_MARGIN,
+                  int(m_parameters.size()) * SLIDER_ROW_HEIGHT + HUD_MARGIN};
+    SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 220);
+    SDL_RenderFillRect(m_renderer, &box);
+    SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_NONE);
+    //The selected parameter, the one the keys change, has a filled knob
+    setDrawColor(m_colorText);
+    for(size_t j = 0; j < m_parameters.size(); ++j)
+    {
+        const SDL_Rect rect = sliderRect(j);
+        const iat::Parameter &parameter = m_parameters[j];
+        const int middle = rect.y + rect.h / 2;
+        const int knob = rect.x + int((m_parameterValues[j] - parameter.min) /
+                                      (parameter.max - parameter.min) * rect.w);
+        SDL_RenderDrawLine(m_renderer, rect.x, middle, rect.x + rect.w, middle);
+        const SDL_Rect knobRect {knob - SLIDER_KNOB_SIZE / 2, middle - SLIDER_KNOB_SIZE,
+                                 SLIDER_KNOB_SIZE, 2 * SLIDER_KNOB_SIZE};
+        if(j == m_selectedParameter)
+            SDL_RenderFillRect(m_renderer, &knobRect);
+        else
+            SDL_RenderDrawRect(m_renderer, &knobRect);
+        if(atlas)
+            drawText(*atlas, labels[j], rect.x + rect.w + 2 * SLIDER_KNOB_SIZE,
+                     middle - atlas->lineHeight() / 2, m_colorText);
+    }
+    if(atlas)
+        flushText(*atlas);
+}
+
+void Grapher::draw_readout()
+{
+    //A marker on the curve and, next to the cursor, its equation and the
+    //point, with as many digits as a pixel needs
+    const double scaleX = m_windowWidth / (m_Xmax - m_Xmin);
+    const double scaleY = m_windowHeight / (m_Ymax - m_Ymin);
+    const double x = (m_hoverX - m_Xmin) * scaleX;
+    const double y = (-m_hoverY - m_Ymin) * scaleY;
+    const double s = FEATURE_MARKER_SIZE;
+    setDrawColor(m_linesData[m_hoveredCurve].second);
+    drawLine(x - s, y - s, x + s, y - s);
+    drawLine(x + s, y - s, x + s, y + s);
+    drawLine(x + s, y + s, x - s, y + s);
+    drawLine(x - s, y + s, x - s, y - s);
+    GlyphAtlas *atlas = m_tickAtlas ? m_tickAtlas.get() : m_glyphAtlas.get();
+    if(!atlas)
+        return;
+    //Appended to a kept string, so moving the cursor does not allocate
+    m_readoutText.assign("x = ");
+    m_readoutText += tickLabel(worldX(m_hoverX), 1 / scaleX);
+    m_readoutText += "  y = ";
+    m_readoutText += tickLabel(m_hoverY, 1 / scaleY);
+    const std::string *lines[] {&m_exprList[m_hoveredCurve].first, &m_readoutText};
+    const int width = std::max(atlas->textWidth(*lines[0]), atlas->textWidth(*lines[1]));
+    const int height = 2 * atlas->lineHeight();
+    //Below and right of the cursor, flipped at the window edges
+    int left = m_cursorX + 2 * HUD_MARGIN;
+    int top = m_cursorY + 2 * HUD_MARGIN;
+    if(left + width + HUD_MARGIN > m_windowWidth)
+        left = m_cursorX - 2 * HUD_MARGIN - width;
+    if(top + height + HUD_MARGIN > m_windowHeight)
+        top = m_cursorY - 2 * HUD_MARGIN - height;
+    SDL_Rect box {left - HUD_MARGIN / 2, top - HUD_MARGIN / 2, width + HUD_MARGIN,
+                  height + HUD_MARGIN};
+    SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 220);
+    SDL_RenderFillRect(m_renderer, &box);
+    SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_NONE);
+    for(int i = 0; i < 2; ++i)
+        drawText(*atlas, *lines[i], left, top + i * atlas->lineHeight(), m_colorText);
+    flushText(*atlas);
 }
 
 std::string Grapher::doubleToString(double val, int prec)
 {
-    std::stringstream ss;
-    ss << std::fixed << std::setprecision(prec) << val;
-    return ss.str();
+    //Formatted on the stack rather than through a stream, so the short
+    //labels of a pan or zoom do not allocate
+    char buffer[64];
+    const int size = snprintf(buffer, sizeof(buffer), "%.*f", prec, val);
+    if(size < int(sizeof(buffer)))
+        return buffer;
+    std::string text(size, '\0');
+    snprintf(&text[0], size + 1, "%.*f", prec, val);
+    return text;
 }
 
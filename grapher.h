@@ -5,10 +5,30 @@
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL2_gfxPrimitives.h>
 #include "parser.h"
+#include "compiler.h"
+#include "stopwatch.h"
+#include "glyphatlas.h"
+#include "softrenderer.h"
+#include "dataseries.h"
+#include "streamseries.h"
+#include "samplecache.h"
+#include "samplepool.h"
+#include "filewatcher.h"
+#include "profiler.h"
+#include "inputreplay.h"
+#include "curvebounds.h"
+#include "featurefinder.h"
+#include "segmentindex.h"
+#include "heatmap.h"
 
 #include <vector>
 #include <tuple>
 #include <string>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <ostream>
 
 
 using Point = std::pair<double, double>;
@@ -18,9 +38,16 @@ using LineData = std::pair<Line, SDL_Color>;
 class SDLInitObject
 {
 public:
-    explicit SDLInitObject();
+    explicit SDLInitObject(Uint32 flags = SDL_INIT_VIDEO);
     ~SDLInitObject();
+    //Serializes library setup and font loading between graphers running on
+    //different threads
+    static std::mutex &mutex();
 private:
+    //SDL and TTF are shut down with the last object, views of one process
+    //come and go independently
+    static int s_users;
+    Uint32 m_flags;
     enum
     {
         ERROR_SDL_INIT = 0,
@@ -39,9 +66,37 @@ class Grapher
 {
 public:
     enum class Direction {UP, DOWN, LEFT, RIGHT};
-    explicit Grapher(const std::string &pathToSettingsFile);
+    //Views of one process pass the same program cache and sample pool, so an
+    //expression is compiled and a region sampled once for all of them. A
+    //non-empty pathToEquationFile replaces the one named in the settings.
+    explicit Grapher(const std::string &pathToSettingsFile, bool headless = false,
+                     std::shared_ptr<iat::ProgramCache> programCache = nullptr,
+                     std::shared_ptr<SamplePool> samplePool = nullptr,
+                     const std::string &pathToEquationFile = "");
     ~Grapher();
     void run();
+    //One event loop for several windows; returns once all of them are closed
+    static void run(const std::vector<Grapher *> &views);
+    void setViewport(double Xmin, double Xmax, double Ymin, double Ymax);
+    void setEquationsFile(const std::string &pathToFile);
+    const StageTimings &stageTimings() const;
+    //Prints the startup phases to stderr once the first complete frame is shown
+    void setStartupTrace(bool startupTrace);
+    //Records every frame of run() into a Chrome trace-event JSON file
+    void setTraceFile(const std::string &pathToFile);
+    //Writes the input of run() to a log that replay() can play back
+    void setRecordFile(const std::string &pathToFile);
+    //Feeds a recorded log frame by frame and reports frame times, counters,
+    //the frames that allocated and the worst frame; with a golden image the
+    //final frame is compared with it. With warmupFrames >= 0 a heap
+    //allocation in any later frame fails the replay. Returns 0 on success.
+    int replay(const std::string &pathToLog, const std::string &pathToGolden,
+               std::ostream &report, int warmupFrames = -1);
+    //Renders the plot offscreen; a zero size means the window size from settings
+    void exportImage(const std::string &pathToImage, int width = 0, int height = 0,
+                     int threads = 0);
+    //Compiles the equations into an EquationBundle that loads without parsing
+    void writeBundle(const std::string &pathToBundle) const;
 private:
     enum
     {
@@ -49,15 +104,96 @@ private:
         WINDOW_HEIGHT = 600,
         WINDOW_X = 113,
         WINDOW_Y = 84,
-        PREC = 6
+        PREC = 6,
+        DEFAULT_MAX_FPS = 60,
+        CPU_REPORT_INTERVAL = 1000,
+        MIN_MAJOR_SPACING = 50,
+        MIN_MINOR_SPACING = 4,
+        FULL_MINOR_SPACING = 16,
+        MAX_GRID_LINES = 1000,
+        TICK_SIZE = 4,
+        TICK_LABEL_MARGIN = 4,
+        MIN_TICK_FONT_SIZE = 10,
+        //Curves computed faster than this are not worth a cache file
+        CACHE_MIN_COMPUTE_MS = 2,
+        //How often the event loop checks on the startup workers
+        STARTUP_POLL_INTERVAL = 10,
+        HUD_MARGIN = 8,
+        FEATURE_MARKER_SIZE = 4,
+        DEFAULT_FRAME_BUDGET_MS = 8,
+        //Animated curves are sampled at most this many dX apart
+        MAX_ANIMATION_STRIDE = 64,
+        SLIDER_WIDTH = 200,
+        SLIDER_ROW_HEIGHT = 24,
+        SLIDER_KNOB_SIZE = 6,
+        //PAGE UP and PAGE DOWN move a parameter this many steps per range
+        SLIDER_KEY_STEPS = 100,
+        //Deep zoom starts once the X span is below 2^-DEEP_ZOOM_BITS of the
+        //center, and the origin follows the view once it is more than
+        //REBASE_SPANS spans away
+        DEEP_ZOOM_BITS = 30,
+        REBASE_SPANS = 1024,
+        //zoomIn() stops at spans of 2^-MAX_ZOOM_BITS_* of the center, a
+        //few bits short of the long double and double mantissas
+        MAX_ZOOM_BITS_X = 60,
+        MAX_ZOOM_BITS_Y = 48,
+        //Text sheets with this many entries get a bundle next to them
+        BUNDLE_MIN_EXPRESSIONS = 1000,
+        //The cursor picks curves this many pixels away, and a button press
+        //that moves less than CLICK_SLOP pixels is a click, not a pan
+        PICK_RADIUS = 8,
+        CLICK_SLOP = 3
     };
+    //Fonts and their atlases, opened on a worker thread at startup
+    struct Fonts
+    {
+        TTF_Font *font{nullptr};
+        TTF_Font *tickFont{nullptr};
+        std::unique_ptr<GlyphAtlas> atlas;
+        std::unique_ptr<GlyphAtlas> tickAtlas;
+        double ms{0};
+    };
+    //World space samples of the expression curves, computed on a worker
+    //thread for the startup viewport
+    struct CurveSamples
+    {
+        double Xmin{0}, Xmax{0}, dX{0};
+        std::vector<std::shared_ptr<const iat::Program>> programs;
+        std::vector<Line> lines;
+        double ms{0};
+    };
+    //Minor grid lines at full weight are this much lighter than major ones
+    static constexpr double MINOR_LINE_WEIGHT = 0.5;
     const std::string WINDOW_TITLE{"2DGrapher"};
+    //Written when a trace started with the T key is stopped
+    const std::string DEFAULT_TRACE_FILE{"grapher_trace.json"};
+    //An equation line "data:<path>" plots a measured series instead
+    const std::string DATA_SERIES_PREFIX{"data:"};
+    //and "stream:<path>" follows a growing file, a FIFO or stdin ("-")
+    const std::string STREAM_PREFIX{"stream:"};
+    //and "heatmap:<expression>" colors every pixel by its value at (X, Y)
+    const std::string HEATMAP_PREFIX{"heatmap:"};
+    //Equations compiled on an earlier load, next to the text file
+    const std::string BUNDLE_SUFFIX{".bundle"};
+    //Started before SDL is initialized, so the startup trace includes it
+    Stopwatch m_startupClock;
     SDLInitObject m_sdl_initializer;
     SDL_Window *m_window;
     SDL_Renderer *m_renderer;
     std::string m_pathToSettingsFile, m_pathToEquationFile;
+    //Version of the equations text that was loaded last
+    uint64_t m_equationsSize{0}, m_equationsMtime{0};
     double m_windowWidth, m_windowHeight;
+    //m_Xmin, m_Xmax and the X of sampled lines are relative to m_Xorigin.
+    //It is 0 unless the X span is too small for double around its center;
+    //then the view is rebased to a long double origin near the center, see
+    //updateOrigin()
     double m_Xmin, m_Xmax, m_Ymin, m_Ymax, m_dX;
+    long double m_Xorigin{0};
+    //The area limits as last read from the settings file, X in world space;
+    //a reload moves the view only when they change
+    long double m_settingsXmin{0}, m_settingsXmax{0};
+    double m_settingsYmin{0}, m_settingsYmax{0};
     bool m_drawAxis;
     SDL_Color m_colorAxis;
     bool m_drawGrid;
@@ -65,18 +201,150 @@ private:
     double m_gridStepX, m_gridStepY;
     std::string m_pathToFontFile;
     int m_fontSize;
-    TTF_Font *m_font;
+    TTF_Font *m_font{nullptr};
+    std::unique_ptr<GlyphAtlas> m_glyphAtlas;
+    TTF_Font *m_tickFont{nullptr};
+    std::unique_ptr<GlyphAtlas> m_tickAtlas;
     SDL_Color m_colorText;
+    std::string m_angleUnit{"radian"};
     std::vector<std::pair<std::string, SDL_Color>> m_exprList;
+    //"name = ..." and "name(a, b) = ..." lines of the equations file, in order
+    std::vector<std::string> m_definitions;
+    std::shared_ptr<iat::ProgramCache> m_programCache;
+    std::shared_ptr<SamplePool> m_samplePool;
+    //Per entry of m_exprList either a compiled program, a data series, a
+    //stream or a heatmap
+    std::vector<std::shared_ptr<const iat::Program>> m_programs;
+    std::vector<std::shared_ptr<DataSeries>> m_series;
+    std::vector<std::shared_ptr<StreamSeries>> m_streams;
+    //Heatmap entries keep their program here, not in m_programs, so they
+    //are never sampled, picked or searched as curves
+    std::vector<std::shared_ptr<Heatmap>> m_heatmaps;
+    Colormap m_colormap;
+    double m_heatmapZmin{-1}, m_heatmapZmax{1};
+    //Pushed by stream reader threads to wake the event loop
+    Uint32 m_streamEvent{0};
+    //Pushed by the file watcher; the code tells which file changed
+    Uint32 m_reloadEvent{0};
+    enum {RELOAD_SETTINGS, RELOAD_EQUATIONS};
+    std::unique_ptr<FileWatcher> m_fileWatcher;
+    //While set the X window scrolls along with the newest streamed sample
+    bool m_followStreams{true};
+    //World space samples per entry of m_exprList, mapped to the window when drawn
     std::vector<LineData> m_linesData;
+    //Viewport a line was sampled for; a line is resampled only when its key
+    //no longer matches, so vertical pans and zooms evaluate nothing
+    struct SampleKey
+    {
+        double Xmin, Xmax, dX, width;
+        bool valid;
+    };
+    std::vector<SampleKey> m_sampleKeys;
+    std::vector<CurveBounds> m_bounds;
+    //Built when the cursor first looks for a curve after it was resampled
+    std::vector<SegmentIndex> m_segmentIndices;
+    //Hidden curves are neither sampled nor drawn
+    std::vector<bool> m_visible;
+    std::vector<std::pair<size_t, size_t>> m_visibleRanges;
+    //Curves that use T or parameters are sampled on the main thread,
+    //outside the sample pool, every frame while playing or after a
+    //parameter they use changed; their X-only parts are kept for the X set
+    //in use
+    struct Animation
+    {
+        std::unique_ptr<iat::AnimationSampler> sampler;
+        double Xmin, Xmax, step;
+    };
+    std::vector<Animation> m_animations;
+    std::vector<double> m_animationValues;
+    std::vector<double> m_animationXs;
+    double m_time{0};
+    double m_timeSpeed{1};
+    bool m_isPlaying{true};
+    Uint32 m_lastTimeTick{0};
+    //Set by replay(): T advances by this much per frame instead of with
+    //the clock, and the stride stays put, so replays draw the same frames
+    double m_timeStep{0};
+    //Sampling the animated curves of a frame should take no longer than
+    //this; beyond it they are sampled every m_animationStride-th dX
+    double m_frameBudget{DEFAULT_FRAME_BUDGET_MS};
+    int m_animationStride{1};
+    //Declared in the equations file; a reload keeps the values of the ones
+    //still declared. Programs read m_parameterValues by index.
+    std::vector<iat::Parameter> m_parameters;
+    std::vector<double> m_parameterValues;
+    size_t m_selectedParameter{0};
+    //Slider being dragged with the mouse, -1 if none
+    int m_draggedParameter{-1};
+    std::vector<std::string> m_sliderLabels;
+    //Roots, extrema and intersections of the sampled curves; found again
+    //only after a curve was resampled, shown or hidden
+    FeatureFinder m_featureFinder;
+    std::vector<FeatureFinder::Feature> m_features;
+    bool m_showFeatures{false};
+    bool m_isFeaturesDirty{true};
+    std::string m_pathToSampleCache{".grapher_cache"};
+    std::unique_ptr<SampleCache> m_sampleCache;
+    bool m_isLinesDataDirty{true};
+    //Lists of one recompute, kept so that pans and zooms do not allocate
+    //once they have grown to the sheet
+    std::vector<size_t> m_expressionCurves, m_dynamicCurves, m_deepCurves;
+    std::vector<std::shared_ptr<const iat::Program>> m_scratchPrograms;
+    std::vector<const std::string *> m_scratchExprs;
+    std::vector<Line *> m_scratchLines;
+    StageTimings m_stageTimings;
+    std::future<Fonts> m_pendingFonts;
+    std::future<CurveSamples> m_pendingCurves;
+    bool m_startupTrace{false};
+    bool m_isStartupDone{false};
+    double m_timeToFirstFrame{0};
     enum {TEXT, TEXT_X, TEXT_Y};
     std::vector<std::tuple<std::string,int,int>> m_labels;
-    std::vector<std::pair<SDL_Texture*, SDL_Rect>> m_textData;
+    int m_maxFps{DEFAULT_MAX_FPS};
+    bool m_vsync{false};
+    bool m_isRunning{false};
+    bool m_isDirty{true};
+    bool m_isMoving{false};
+    int m_mouseX{0}, m_mouseY{0};
+    //Curve under the cursor and the point on it, and the curve selected
+    //with a click; -1 if none
+    bool m_hasCursor{false};
+    int m_cursorX{0}, m_cursorY{0};
+    int m_pressX{0}, m_pressY{0};
+    int m_hoveredCurve{-1};
+    double m_hoverX{0}, m_hoverY{0};
+    std::string m_readoutText;
+    int m_selectedCurve{-1};
+    Uint32 m_lastFrameTime{0};
+    Uint32 m_reportTime{0};
+    std::clock_t m_reportCpuTime{0};
+    int m_framesSinceReport{0};
+    double m_cpuUsage{0};
+    Profiler m_profiler;
+    bool m_showHud{false};
+    std::unique_ptr<InputRecorder> m_recorder;
+    //Grid and axes are rendered into a target texture and reused until the
+    //viewport or their settings change
+    SDL_Texture *m_backgroundTexture{nullptr};
+    SDL_Texture *m_backgroundScratch{nullptr};
+    bool m_isBackgroundDirty{true};
+    double m_bgXmin{0}, m_bgXmax{0}, m_bgYmin{0}, m_bgYmax{0};
+    bool m_bgTicksAnchored{false};
+    //Set only while exportImage() draws into an offscreen framebuffer
+    std::unique_ptr<SoftRenderer> m_softRenderer;
 
-    void userInputPhase();
+    bool isEventFor(const SDL_Event &e) const;
+    int waitTimeout() const;
+    void userInputPhase(const SDL_Event &e);
     void drawingPhase();
+    int frameInterval() const;
+    void reportCpuUsage();
     void loadSettings(const std::string &pathToFile);
-    void loadData(const std::string &pathToFile);
+    //Without writesBundle a large sheet gets no bundle, see loadData()
+    void loadData(const std::string &pathToFile, bool writesBundle = true);
+    void watchFiles();
+    void reloadSettings();
+    void reloadEquations();
     void draw_all();
     void zoomIn();
     void zoomOut();
@@ -104,12 +372,83 @@ private:
     void reloadTextData();
     double map(double min_val, double max_val, double mapped_min_val,
                double mapped_max_val, double val);
-    void calculateLinesData();
+    std::string expressionOf(const std::string &entry) const;
+    bool loadBundle(const std::string &pathToBundle, const std::string &pathToSource);
+    void prepareCurves(const std::vector<std::pair<std::string, SDL_Color>> &exprList,
+                       const std::vector<std::string> &definitions);
+    static Fonts loadFonts(const std::string &pathToFontFile, int fontSize);
+    void installFonts(Fonts fonts);
+    void closeFonts();
+    static CurveSamples sampleCurves(std::vector<std::pair<std::string, SDL_Color>> exprList,
+                                     std::vector<std::shared_ptr<const iat::Program>> programs,
+                                     std::string angleUnit, const SampleCache *cache,
+                                     std::shared_ptr<SamplePool> pool, double Xmin,
+                                     double Xmax, double dX);
+    //Without a cache the samples come straight from the pool
+    static void sampleExpressions(const std::vector<std::shared_ptr<const iat::Program>> &programs,
+                                  const std::vector<const std::string *> &exprs,
+                                  const SampleCache *cache, SamplePool &pool,
+                                  const std::string &angleUnit, double Xmin, double Xmax,
+                                  double dX, const std::vector<Line *> &lines);
+    bool isLoading() const;
+    void pollStartupTasks();
+    void finishStartup();
+    void drainStreams();
+    void invalidateLinesData();
+    void resampleCurve(size_t i);
+    bool isSampled(size_t i) const;
+    void toggleCurve(size_t i);
+    void updateLinesData();
+    void calculateLinesData(CurveSamples *precomputed = nullptr);
+    void calculateLine(size_t i, Line &line);
+    bool isAnimated(size_t i) const;
+    bool isAnimated() const;
+    bool isDynamic(size_t i) const;
+    bool isDeepZoom() const;
+    void setXRange(long double Xmin, long double Xmax);
+    void updateOrigin();
+    long double worldX(double x) const;
+    double viewX(long double x) const;
+    void sampleDeep(size_t i);
+    void advanceTime();
+    void sampleDynamic(size_t i);
+    void setParameters(const std::vector<iat::Parameter> &parameters);
+    void setParameter(size_t j, double value);
+    SDL_Rect sliderRect(size_t j) const;
+    int sliderAt(int x, int y) const;
+    void dragSlider(int x);
+    void setAnimationStride(int stride);
+    int pickCurve(int x, int y, double &curveX, double &curveY);
+    void updateHover();
+    double curveValue(size_t i, double x) const;
+    void updateBackground();
+    void rebuildBackground();
+    bool scrollBackground(int dx, int dy);
+    void setDrawColor(const SDL_Color &color);
+    void drawLine(double x1, double y1, double x2, double y2);
+    void drawText(GlyphAtlas &atlas, const std::string &text, int x, int y,
+                  const SDL_Color &color);
+    void flushText(GlyphAtlas &atlas);
+    void draw_background();
     void draw_axis();
+    void gridSteps(double span, double pixels, double baseStep, double &major,
+                   double &minor, double &minorWeight);
+    SDL_Color fadeColor(const SDL_Color &color, double weight);
+    void draw_grid_lines(bool vertical, double step, double skipStep);
     void draw_grid();
-    void draw_graph(const Line &line, const SDL_Color &color);
+    std::string tickLabel(long double value, double step);
+    bool tickLabelsAnchored();
+    void draw_ticks();
+    void draw_graph(const Line &line, const SDL_Color &color, const CurveBounds &bounds,
+                    double offset = 0);
     void draw_text_info();
+    void draw_hud();
+    void updateFeatures();
+    void draw_features();
+    void draw_sliders();
+    void draw_readout();
     void draw_all_graphs();
+    void draw_heatmaps();
     std::string doubleToString(double val, int prec = PREC);
 };
 
@@ -0,0 +1,450 @@
+#include "heatmap.h"
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+    //Control points, evenly spaced from the low end to the high end
+    struct NamedMap
+    {
+        const char *name;
+        std::vector<SDL_Color> points;
+    };
+    const NamedMap COLORMAPS[] =
+    {
+        {"viridis", {{68, 1, 84, 255}, {71, 44, 122, 255}, {59, 81, 139, 255},
+                     {44, 113, 142, 255}, {33, 144, 141, 255}, {39, 173, 129, 255},
+                     {92, 200, 99, 255}, {170, 220, 50, 255}, {253, 231, 37, 255}}},
+        {"magma", {{0, 0, 4, 255}, {28, 16, 68, 255}, {79, 18, 123, 255},
+                   {129, 37, 129, 255}, {181, 54, 122, 255}, {229, 80, 100, 255},
+                   {251, 135, 97, 255}, {254, 194, 135, 255}, {252, 253, 191, 255}}},
+        {"grayscale", {{0, 0, 0, 255}, {255, 255, 255, 255}}},
+        {"coolwarm", {{59, 76, 192, 255}, {141, 176, 254, 255}, {221, 221, 221, 255},
+                      {244, 154, 123, 255}, {180, 4, 38, 255}}}
+    };
+    //Lattice coordinates beyond this are not told apart in double
+    const double MAX_LATTICE = 4e15;
+
+    int64_t floorDiv(int64_t a, int64_t b)
+    {
+        return a / b - (a % b != 0 && (a < 0) != (b < 0));
+    }
+
+    int floorMod(int64_t a, int64_t b)
+    {
+        return int(a - floorDiv(a, b) * b);
+    }
+}
+
+Colormap::Colormap(const std::string &name):
+    m_name(name)
+{
+    const NamedMap *map = nullptr;
+    for(const auto &candidate: COLORMAPS)
+    {
+        if(name == candidate.name)
+            map = &candidate;
+    }
+    if(!map)
+        throw std::runtime_error("Unknown colormap " + name +
+                                 ", expected viridis, magma, grayscale or coolwarm");
+    const auto &points = map->points;
+    for(int i = 0; i < TABLE_SIZE; ++i)
+    {
+        const double position = double(i) / (TABLE_SIZE - 1) * (points.size() - 1);
+        const size_t k = std::min(size_t(position), points.size() - 2);
+        const double f = position - k;
+        const SDL_Color &a = points[k], &b = points[k + 1];
+        auto mix = [f](Uint8 from, Uint8 to)
+        {
+            return Uint32(std::lround(from + f * (to - from)));
+        };
+        m_table[i] = mix(a.r, b.r) << 24 | mix(a.g, b.g) << 16 | mix(a.b, b.b) << 8 | 255;
+    }
+}
+
+const std::string &Colormap::name() const
+{
+    return m_name;
+}
+
+void Colormap::colors(const double *zs, size_t count, double zmin, double zmax,
+                      Uint32 *pixels) const
+{
+    //zmax below zmin reverses the map
+    const double scale = zmax != zmin ? (TABLE_SIZE - 1) / (zmax - zmin) : 0;
+    for(size_t k = 0; k < count; ++k)
+    {
+        if(!std::isfinite(zs[k]))
+        {
+            pixels[k] = 0;
+            continue;
+        }
+        const double index = (zs[k] - zmin) * scale;
+        pixels[k] = m_table[index <= 0 ? 0 : index >= TABLE_SIZE - 1 ? TABLE_SIZE - 1
+                                                                     : int(index + 0.5)];
+    }
+}
+
+Heatmap::Heatmap(std::shared_ptr<const iat::Program> program, int threads):
+    m_program(std::move(program)),
+    m_threads(threads)
+{
+    if(m_threads <= 0)
+        m_threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+Heatmap::~Heatmap()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for(auto &worker: m_workers)
+        worker.join();
+    if(m_texture)
+        SDL_DestroyTexture(m_texture);
+}
+
+const std::shared_ptr<const iat::Program> &Heatmap::program() const
+{
+    return m_program;
+}
+
+void Heatmap::setColors(const Colormap &colormap, double zmin, double zmax)
+{
+    if(colormap.name() == m_colormap.name() && zmin == m_zmin && zmax == m_zmax)
+        return;
+    m_colormap = colormap;
+    m_zmin = zmin;
+    m_zmax = zmax;
+    invalidate();
+}
+
+void Heatmap::invalidate()
+{
+    for(auto &slot: m_slots)
+        slot.valid = false;
+}
+
+void Heatmap::draw(SDL_Renderer *renderer, const View &view, Uint8 alpha)
+{
+    if(!prepare(renderer, view))
+        return;
+    findRegions(view);
+    for(const Region &region: m_regions)
+    {
+        const SDL_Rect rect {region.x0 * TILE_SIZE, region.y0 * TILE_SIZE,
+                             (region.x1 - region.x0) * TILE_SIZE,
+                             (region.y1 - region.y0) * TILE_SIZE};
+        void *pixels;
+        int pitch;
+        if(SDL_LockTexture(m_texture, &rect, &pixels, &pitch) != 0)
+        {
+            //Tried again on the next draw
+            for(int sy = region.y0; sy < region.y1; ++sy)
+            {
+                for(int sx = region.x0; sx < region.x1; ++sx)
+                    m_slots[size_t(sy) * m_columns + sx].valid = false;
+            }
+            continue;
+        }
+        evaluate(region, static_cast<Uint32*>(pixels), pitch);
+        SDL_UnlockTexture(m_texture);
+    }
+    SDL_SetTextureAlphaMod(m_texture, alpha);
+    SDL_Rect sources[4], targets[4];
+    const int count = pieces(view, sources, targets);
+    for(int k = 0; k < count; ++k)
+        SDL_RenderCopy(renderer, m_texture, &sources[k], &targets[k]);
+}
+
+void Heatmap::draw(SoftRenderer &renderer, const View &view, Uint8 alpha)
+{
+    if(!prepare(nullptr, view))
+        return;
+    findRegions(view);
+    const int textureWidth = m_columns * TILE_SIZE;
+    for(const Region &region: m_regions)
+        evaluate(region, &m_image[size_t(region.y0) * TILE_SIZE * textureWidth +
+                                  region.x0 * TILE_SIZE], int(textureWidth * sizeof(Uint32)));
+    SDL_Rect sources[4], targets[4];
+    const int count = pieces(view, sources, targets);
+    for(int k = 0; k < count; ++k)
+        renderer.drawImage(&m_image[size_t(sources[k].y) * textureWidth + sources[k].x],
+                           sources[k].w, sources[k].h, textureWidth, targets[k].x,
+                           targets[k].y, alpha);
+}
+
+//Lattice column gx is the pixel column [gx, gx + 1) / m_scaleX of the
+//view, row gy the rows from -gy / m_scaleY down; columns gx0 to gx0 + width
+//and rows gy0 to gy0 + height touch the window. Tiles among them that are
+//not in their slot yet are claimed and their slots grouped into regions:
+//runs of dirty slots in a row, joined with the same run of the row above,
+//so that a pan locks a strip or two and a new view four blocks.
+void Heatmap::findRegions(const View &view)
+{
+    const int64_t gx0 = int64_t(std::floor(view.Xmin * m_scaleX));
+    const int64_t gy0 = int64_t(std::floor(view.Ymin * m_scaleY));
+    const int64_t tx0 = floorDiv(gx0, TILE_SIZE), tx1 = floorDiv(gx0 + view.width, TILE_SIZE);
+    const int64_t ty0 = floorDiv(gy0, TILE_SIZE), ty1 = floorDiv(gy0 + view.height, TILE_SIZE);
+    m_dirty.assign(m_slots.size(), false);
+    for(int64_t ty = ty0; ty <= ty1; ++ty)
+    {
+        for(int64_t tx = tx0; tx <= tx1; ++tx)
+        {
+            const size_t s = size_t(floorMod(ty, m_rows)) * m_columns + floorMod(tx, m_columns);
+            Slot &slot = m_slots[s];
+            if(slot.valid && slot.tx == tx && slot.ty == ty)
+                continue;
+            slot = {tx, ty, true};
+            m_dirty[s] = true;
+        }
+    }
+    m_regions.clear();
+    for(int sy = 0; sy < m_rows; ++sy)
+    {
+        for(int sx = 0; sx < m_columns;)
+        {
+            if(!m_dirty[size_t(sy) * m_columns + sx])
+            {
+                ++sx;
+                continue;
+            }
+            int end = sx;
+            while(end < m_columns && m_dirty[size_t(sy) * m_columns + end])
+                ++end;
+            auto above = std::find_if(m_regions.begin(), m_regions.end(),
+                                      [sx, sy, end](const Region &region)
+            {
+                return region.y1 == sy && region.x0 == sx && region.x1 == end;
+            });
+            if(above != m_regions.end())
+                above->y1 = sy + 1;
+            else
+                m_regions.push_back({sx, end, sy, sy + 1});
+            sx = end;
+        }
+    }
+}
+
+//The lattice window wraps at the edges of the texture, so it is copied in
+//up to four pieces, shifted by the rounded fraction of a pixel the window
+//starts into column gx0 and row gy0
+int Heatmap::pieces(const View &view, SDL_Rect sources[4], SDL_Rect targets[4]) const
+{
+    const double fx = view.Xmin * m_scaleX, fy = view.Ymin * m_scaleY;
+    const int64_t gx0 = int64_t(std::floor(fx)), gy0 = int64_t(std::floor(fy));
+    const int textureWidth = m_columns * TILE_SIZE, textureHeight = m_rows * TILE_SIZE;
+    const int u0 = floorMod(gx0, textureWidth), v0 = floorMod(gy0, textureHeight);
+    const int spanX = view.width + 1, spanY = view.height + 1;
+    const int widths[2] = {std::min(spanX, textureWidth - u0), spanX - (textureWidth - u0)};
+    const int heights[2] = {std::min(spanY, textureHeight - v0), spanY - (textureHeight - v0)};
+    int count = 0;
+    int y = -int(std::lround(fy - gy0));
+    for(int j = 0; j < 2 && heights[j] > 0; ++j)
+    {
+        int x = -int(std::lround(fx - gx0));
+        for(int i = 0; i < 2 && widths[i] > 0; ++i)
+        {
+            sources[count] = {i == 0 ? u0 : 0, j == 0 ? v0 : 0, widths[i], heights[j]};
+            targets[count] = {x, y, widths[i], heights[j]};
+            ++count;
+            x += widths[i];
+        }
+        y += heights[j];
+    }
+    return count;
+}
+
+//Checks the texture and the tiles in it against the view; false if there
+//is nothing to draw
+bool Heatmap::prepare(SDL_Renderer *renderer, const View &view)
+{
+    if(view.width <= 0 || view.height <= 0 || !(view.Xmax > view.Xmin) ||
+       !(view.Ymax > view.Ymin))
+        return false;
+    const double scaleX = view.width / (view.Xmax - view.Xmin);
+    const double scaleY = view.height / (view.Ymax - view.Ymin);
+    if(!(std::fabs(view.Xmin * scaleX) < MAX_LATTICE) ||
+       !(std::fabs(view.Ymin * scaleY) < MAX_LATTICE))
+        return false;
+    //Enough tiles for the width + 1 lattice columns a window can touch
+    const int columns = (view.width + TILE_SIZE) / TILE_SIZE + 1;
+    const int rows = (view.height + TILE_SIZE) / TILE_SIZE + 1;
+    const bool hasTexture = renderer ? m_texture != nullptr : !m_image.empty();
+    if(!hasTexture || columns != m_columns || rows != m_rows)
+    {
+        m_columns = columns;
+        m_rows = rows;
+        m_slots.assign(size_t(columns) * rows, Slot{0, 0, false});
+        //Only one of the two is kept
+        if(m_texture)
+            SDL_DestroyTexture(m_texture);
+        m_texture = nullptr;
+        m_image.clear();
+        if(!renderer)
+        {
+            m_image.assign(size_t(columns) * TILE_SIZE * rows * TILE_SIZE, 0);
+        }
+        else
+        {
+            m_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                                          SDL_TEXTUREACCESS_STREAMING, columns * TILE_SIZE,
+                                          rows * TILE_SIZE);
+            if(!m_texture)
+                return false;
+            SDL_SetTextureBlendMode(m_texture, SDL_BLENDMODE_BLEND);
+        }
+        //Started with the first texture and kept, so pans neither start
+        //threads nor allocate; the last scratch buffer is the caller's
+        if(m_workers.empty())
+        {
+            m_scratch.assign(m_threads, std::vector<double>(3 * BAND_ROWS * TILE_SIZE));
+            for(int id = 0; id + 1 < m_threads; ++id)
+                m_workers.emplace_back(&Heatmap::workerLoop, this, size_t(id));
+        }
+    }
+    //A pan computes the scale again from the moved limits; it is kept
+    //unless it changed by more than rounding, so the lattice stays put
+    auto isSame = [](double a, double b)
+    {
+        return std::fabs(a - b) <= 1e-9 * std::fabs(b);
+    };
+    if(!isSame(scaleX, m_scaleX) || !isSame(scaleY, m_scaleY) || view.origin != m_origin)
+    {
+        m_scaleX = scaleX;
+        m_scaleY = scaleY;
+        m_origin = view.origin;
+        invalidate();
+    }
+    const uint64_t dependencies = m_program->dependencies();
+    if(view.t != m_time)
+    {
+        m_time = view.t;
+        if(dependencies & iat::DEPENDS_ON_T)
+            invalidate();
+    }
+    if(view.parameters && *view.parameters != m_parameters)
+    {
+        m_parameters = *view.parameters;
+        if(dependencies >= iat::DEPENDS_ON_PARAMETER)
+            invalidate();
+    }
+    return true;
+}
+
+//Tiles of the region are cut into bands of BAND_ROWS rows, which the
+//workers and the calling thread take one after the other; pixels is the
+//locked region
+void Heatmap::evaluate(const Region &region, Uint32 *pixels, int pitch)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_region = region;
+        m_pixels = pixels;
+        m_pitch = pitch;
+        m_tasks = size_t(region.x1 - region.x0) * (region.y1 - region.y0) *
+                (TILE_SIZE / BAND_ROWS);
+        m_next = 0;
+        m_busy = int(m_workers.size());
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    work(m_workers.size());
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_busy == 0; });
+}
+
+void Heatmap::workerLoop(size_t id)
+{
+    uint64_t generation = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this, generation]()
+            {
+                return m_stop || m_generation != generation;
+            });
+            if(m_stop)
+                return;
+            generation = m_generation;
+        }
+        work(id);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(--m_busy == 0)
+            m_done.notify_one();
+    }
+}
+
+//Takes bands of the current region until none are left, with scratch
+//buffer id
+void Heatmap::work(size_t id)
+{
+    const Region &region = m_region;
+    const int regionColumns = region.x1 - region.x0;
+    const int bands = TILE_SIZE / BAND_ROWS;
+    double *xs = m_scratch[id].data();
+    for(size_t task = m_next++; task < m_tasks; task = m_next++)
+    {
+        const int band = int(task % bands);
+        const int sx = region.x0 + int(task / bands % regionColumns);
+        const int sy = region.y0 + int(task / bands / regionColumns);
+        const Slot &slot = m_slots[size_t(sy) * m_columns + sx];
+        const int row = (sy - region.y0) * TILE_SIZE + band * BAND_ROWS;
+        Uint32 *first = reinterpret_cast<Uint32*>(reinterpret_cast<char*>(m_pixels) +
+                                                  size_t(row) * m_pitch) +
+                (sx - region.x0) * TILE_SIZE;
+        evaluateBand(slot.tx * TILE_SIZE, slot.ty * TILE_SIZE + band * BAND_ROWS, xs,
+                     xs + BAND_ROWS * TILE_SIZE, xs + 2 * BAND_ROWS * TILE_SIZE, first,
+                     m_pitch);
+    }
+}
+
+//BAND_ROWS rows of TILE_SIZE pixels from lattice column gx and row gy,
+//evaluated at the pixel centers in one batch
+void Heatmap::evaluateBand(int64_t gx, int64_t gy, double *xs, double *ys, double *zs,
+                           Uint32 *pixels, int pitch) const
+{
+    const size_t count = size_t(BAND_ROWS) * TILE_SIZE;
+    for(int c = 0; c < TILE_SIZE; ++c)
+        xs[c] = double(m_origin + (gx + c + 0.5L) / m_scaleX);
+    for(int r = 0; r < BAND_ROWS; ++r)
+    {
+        std::copy(xs, xs + TILE_SIZE, xs + r * TILE_SIZE);
+        std::fill(ys + r * TILE_SIZE, ys + (r + 1) * TILE_SIZE, -((gy + r + 0.5) / m_scaleY));
+    }
+    const double *parameters = m_parameters.empty() ? nullptr : m_parameters.data();
+    try
+    {
+        m_program->evaluate(xs, ys, count, &zs, m_time, parameters);
+    }
+    catch(std::exception &)
+    {
+        //One division by zero or argument out of range fails the batch;
+        //then each pixel is evaluated alone and the failing ones are left
+        //transparent
+        for(size_t k = 0; k < count; ++k)
+        {
+            try
+            {
+                zs[k] = m_program->evaluateAt(xs[k], ys[k], m_time, parameters);
+            }
+            catch(std::exception &)
+            {
+                zs[k] = NAN;
+            }
+        }
+    }
+    Profiler::count(Profiler::SAMPLES, count);
+    for(int r = 0; r < BAND_ROWS; ++r)
+        m_colormap.colors(zs + r * TILE_SIZE, TILE_SIZE, m_zmin, m_zmax,
+                          reinterpret_cast<Uint32*>(reinterpret_cast<char*>(pixels) +
+                                                    size_t(r) * pitch));
+}
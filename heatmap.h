@@ -0,0 +1,141 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <SDL2/SDL.h>
+#include "compiler.h"
+#include "softrenderer.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+//Maps values between a low and a high end to colors, through a table of
+//TABLE_SIZE entries interpolated between the control points of a named map
+class Colormap
+{
+public:
+    //viridis, magma, grayscale or coolwarm; throws std::runtime_error for
+    //any other name
+    explicit Colormap(const std::string &name = "viridis");
+    const std::string &name() const;
+    //Writes count RGBA8888 pixels; values that are not finite are transparent
+    void colors(const double *zs, size_t count, double zmin, double zmax,
+                Uint32 *pixels) const;
+private:
+    enum
+    {
+        TABLE_SIZE = 256
+    };
+    std::string m_name;
+    std::array<Uint32, TABLE_SIZE> m_table;
+};
+
+//The field of a "heatmap:" entry: every pixel colored by f(X, Y) at its
+//center. The pixels form a lattice anchored in world space, cut into tiles
+//of TILE_SIZE, and are evaluated tile by tile on worker threads straight
+//into a streaming texture a little larger than the window. The texture
+//wraps around in both directions, tile (tx, ty) living in slot (tx, ty)
+//modulo its size, so a pan evaluates only the tiles that came into view and
+//the others stay where they are. Without a render device the texture is an
+//image in memory, and the same pixels are blended by a SoftRenderer.
+class Heatmap
+{
+public:
+    //View X is relative to origin, see Grapher::updateOrigin(). Window rows
+    //run along -Y.
+    struct View
+    {
+        long double origin;
+        double Xmin, Xmax, Ymin, Ymax;
+        int width, height;
+        double t;
+        const std::vector<double> *parameters;
+    };
+    //A zero or negative thread count means one per hardware thread
+    explicit Heatmap(std::shared_ptr<const iat::Program> program, int threads = 0);
+    ~Heatmap();
+    Heatmap(const Heatmap &) = delete;
+    Heatmap &operator=(const Heatmap &) = delete;
+    const std::shared_ptr<const iat::Program> &program() const;
+    void setColors(const Colormap &colormap, double zmin, double zmax);
+    //Every tile is evaluated again on the next draw(), e.g. after the
+    //texture was lost with the render device
+    void invalidate();
+    //Evaluates the tiles of the view missing from the texture, then copies
+    //the field to the window with alpha as its opacity
+    void draw(SDL_Renderer *renderer, const View &view, Uint8 alpha);
+    //The same into an exported image; the field must stay unchanged until
+    //the renderer's render()
+    void draw(SoftRenderer &renderer, const View &view, Uint8 alpha);
+private:
+    enum
+    {
+        TILE_SIZE = 64,
+        //Rows of a tile evaluated in one batch
+        BAND_ROWS = 16
+    };
+    //Tile coordinates are pixel lattice coordinates divided by TILE_SIZE
+    struct Slot
+    {
+        int64_t tx, ty;
+        bool valid;
+    };
+    //Slots [x0, x1) x [y0, y1), locked and written as one
+    struct Region
+    {
+        int x0, x1, y0, y1;
+    };
+    std::shared_ptr<const iat::Program> m_program;
+    int m_threads;
+    Colormap m_colormap;
+    double m_zmin{-1}, m_zmax{1};
+    SDL_Texture *m_texture{nullptr};
+    //The texture of draw(SoftRenderer &), RGBA8888 as well
+    std::vector<Uint32> m_image;
+    //In slots; the texture is m_columns x m_rows tiles
+    int m_columns{0}, m_rows{0};
+    std::vector<Slot> m_slots;
+    //What the tiles in the texture were evaluated for
+    double m_scaleX{0}, m_scaleY{0};
+    long double m_origin{0};
+    double m_time{0};
+    std::vector<double> m_parameters;
+    //Lists of one draw(), kept so that pans do not allocate for them
+    std::vector<bool> m_dirty;
+    std::vector<Region> m_regions;
+    //m_threads - 1 workers, woken for every locked region; each thread has
+    //a scratch buffer for the X, Y and values of one band
+    std::vector<std::thread> m_workers;
+    std::vector<std::vector<double>> m_scratch;
+    std::mutex m_mutex;
+    std::condition_variable m_wake, m_done;
+    uint64_t m_generation{0};
+    int m_busy{0};
+    bool m_stop{false};
+    //The region being evaluated and the next of its m_tasks bands
+    Region m_region{0, 0, 0, 0};
+    Uint32 *m_pixels{nullptr};
+    int m_pitch{0};
+    size_t m_tasks{0};
+    std::atomic<size_t> m_next{0};
+
+    //A null renderer prepares m_image instead of m_texture
+    bool prepare(SDL_Renderer *renderer, const View &view);
+    void findRegions(const View &view);
+    //Parts of the texture showing the view and where they go in the window;
+    //returns how many of the up to four there are
+    int pieces(const View &view, SDL_Rect sources[4], SDL_Rect targets[4]) const;
+    void evaluate(const Region &region, Uint32 *pixels, int pitch);
+    void workerLoop(size_t id);
+    void work(size_t id);
+    void evaluateBand(int64_t gx, int64_t gy, double *xs, double *ys, double *zs,
+                      Uint32 *pixels, int pitch) const;
+};
+
+#endif // HEATMAP_H
@@ -0,0 +1,150 @@
+#include "inputreplay.h"
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+
+InputRecorder::InputRecorder(const std::string &pathToFile):
+    m_fo(pathToFile)
+{
+    if(!m_fo.is_open())
+        throw std::runtime_error("Could not write input log " + pathToFile);
+}
+
+void InputRecorder::event(const SDL_Event &e, Uint32 time)
+{
+    switch(e.type)
+    {
+        case SDL_MOUSEBUTTONDOWN:
+            m_fo << "down " << time << ' ' << e.button.x << ' ' << e.button.y << '\n';
+            break;
+        case SDL_MOUSEBUTTONUP:
+            m_fo << "up " << time << ' ' << e.button.x << ' ' << e.button.y << '\n';
+            break;
+        case SDL_MOUSEMOTION:
+            m_fo << "motion " << time << ' ' << e.motion.x << ' ' << e.motion.y << '\n';
+            break;
+        case SDL_MOUSEWHEEL:
+            m_fo << "wheel " << time << ' ' << e.wheel.y << '\n';
+            break;
+        case SDL_KEYDOWN:
+            m_fo << "key " << time << ' ' << int(e.key.keysym.scancode) << '\n';
+            break;
+        case SDL_QUIT:
+            m_fo << "quit " << time << '\n';
+            break;
+    }
+}
+
+void InputRecorder::frame(Uint32 time)
+{
+    m_fo << "frame " << time << '\n';
+}
+
+InputReplay::InputReplay(const std::string &pathToFile):
+    m_fi(pathToFile)
+{
+    if(!m_fi.is_open())
+        throw std::runtime_error("Could not find input log " + pathToFile);
+}
+
+bool InputReplay::nextFrame(std::vector<SDL_Event> &events)
+{
+    events.clear();
+    std::string line, kind;
+    Uint32 time;
+    while(std::getline(m_fi, line))
+    {
+        std::stringstream ss(line);
+        if(!(ss >> kind >> time))
+            continue;
+        if(kind == "frame")
+            return true;
+        SDL_Event e;
+        SDL_zero(e);
+        int a = 0, b = 0;
+        ss >> a >> b;
+        if(kind == "down" || kind == "up")
+        {
+            e.type = kind == "down" ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+            e.button.button = SDL_BUTTON_LEFT;
+            e.button.x = a;
+            e.button.y = b;
+        }
+        else if(kind == "motion")
+        {
+            e.type = SDL_MOUSEMOTION;
+            e.motion.x = a;
+            e.motion.y = b;
+        }
+        else if(kind == "wheel")
+        {
+            e.type = SDL_MOUSEWHEEL;
+            e.wheel.y = a;
+        }
+        else if(kind == "key")
+        {
+            e.type = SDL_KEYDOWN;
+            e.key.keysym.scancode = SDL_Scancode(a);
+        }
+        else if(kind == "quit")
+        {
+            e.type = SDL_QUIT;
+        }
+        else
+        {
+            throw std::runtime_error("Unknown input log entry: " + line);
+        }
+        events.push_back(e);
+    }
+    //Events after the last frame marker still get a final frame
+    return !events.empty();
+}
+
+bool InputReplay::checkGolden(const std::string &pathToGolden, const std::vector<uint8_t> &rgba,
+                              int width, int height, std::string &message)
+{
+    std::ifstream fi(pathToGolden, std::ios::binary);
+    if(!fi.is_open())
+    {
+        std::ofstream fo(pathToGolden, std::ios::binary);
+        if(!fo.is_open())
+            throw std::runtime_error("Could not write image " + pathToGolden);
+        fo << "P6\n" << width << " " << height << "\n255\n";
+        for(size_t i = 0; i < rgba.size(); i += 4)
+            fo.write(reinterpret_cast<const char*>(&rgba[i]), 3);
+        message = "golden image written to " + pathToGolden;
+        return true;
+    }
+    std::string magic;
+    int goldenWidth, goldenHeight, maxValue;
+    fi >> magic >> goldenWidth >> goldenHeight >> maxValue;
+    fi.get();
+    if(magic != "P6" || maxValue != 255)
+        throw std::runtime_error("Golden image is not a binary PPM: " + pathToGolden);
+    if(goldenWidth != width || goldenHeight != height)
+    {
+        message = "size " + std::to_string(width) + "x" + std::to_string(height) +
+                " differs from golden " + std::to_string(goldenWidth) + "x" +
+                std::to_string(goldenHeight);
+        return false;
+    }
+    std::vector<uint8_t> rgb(size_t(width) * height * 3);
+    fi.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+    if(!fi)
+        throw std::runtime_error("Golden image is truncated: " + pathToGolden);
+    size_t mismatches = 0;
+    for(size_t i = 0, j = 0; j < rgb.size(); i += 4, j += 3)
+    {
+        for(int c = 0; c < 3; ++c)
+        {
+            if(std::abs(int(rgba[i + c]) - int(rgb[j + c])) > GOLDEN_TOLERANCE)
+            {
+                ++mismatches;
+                break;
+            }
+        }
+    }
+    message = std::to_string(mismatches) + " of " + std::to_string(size_t(width) * height) +
+            " pixels differ from " + pathToGolden;
+    return mismatches == 0;
+}
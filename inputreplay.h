@@ -0,0 +1,46 @@
+#ifndef INPUTREPLAY_H
+#define INPUTREPLAY_H
+
+#include <SDL2/SDL.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Interactive input written as text, one entry per line:
+//  down <ms> <x> <y>, up <ms> <x> <y>, motion <ms> <x> <y>,
+//  wheel <ms> <dy>, key <ms> <scancode>, quit <ms>, frame <ms>
+//A frame entry marks where a frame was drawn, so a replay hands the same
+//events to every frame no matter how fast it runs. The times are kept for
+//reference only.
+class InputRecorder
+{
+public:
+    explicit InputRecorder(const std::string &pathToFile);
+    void event(const SDL_Event &e, Uint32 time);
+    void frame(Uint32 time);
+private:
+    std::ofstream m_fo;
+};
+
+class InputReplay
+{
+public:
+    explicit InputReplay(const std::string &pathToFile);
+    //Events up to the next frame marker; false at the end of the log
+    bool nextFrame(std::vector<SDL_Event> &events);
+    //Compares an RGBA frame with a binary PPM. A missing golden file is
+    //written from the frame instead, which is how goldens are created.
+    static bool checkGolden(const std::string &pathToGolden, const std::vector<uint8_t> &rgba,
+                            int width, int height, std::string &message);
+private:
+    enum
+    {
+        //Per channel difference still counted as equal
+        GOLDEN_TOLERANCE = 2
+    };
+    std::ifstream m_fi;
+};
+
+#endif // INPUTREPLAY_H
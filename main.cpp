@@ -1,13 +1,189 @@
 #include "grapher.h"
+#include "batchrenderer.h"
 
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
 
-int main(void)
+//Usage:
+//  TeSDL_2D_Grapher [--startup-trace] [--trace <trace.json>] [--record <input.log>]
+//                   [--view <settings file>]... [--sample-budget <MB>] [settings file]
+//  TeSDL_2D_Grapher --replay <input.log> [--golden <frame.ppm>] [--warmup <frames>]
+//                   [settings file]
+//  TeSDL_2D_Grapher --export <image.png|image.ppm> [width height] [settings file]
+//  TeSDL_2D_Grapher --batch <jobs file|-> [--threads N]
+//  TeSDL_2D_Grapher --compile-bundle <bundle file> [settings file]
+//--export renders one plot offscreen, --batch renders every job of a job list
+//(see BatchRenderer::readJobs); neither opens a window. --startup-trace
+//prints how long each startup phase took once the first complete frame is up;
+//--trace records every frame as Chrome trace-event JSON, written on exit.
+//--record logs the input of a session; --replay plays it back with SDL's
+//dummy video driver (unless SDL_VIDEODRIVER says otherwise) and reports frame
+//times, and with --golden compares the final frame with an image, writing it
+//if it does not exist yet. With --warmup the replay fails if any frame after
+//the first <frames> allocates on the heap. Every --view opens one more window with its own
+//settings (viewport, size, colors); all windows share compiled expressions and
+//samples, which together stay within --sample-budget megabytes.
+//--compile-bundle compiles the equations file of the settings, with their
+//angle unit, into a bundle; an equations path naming a bundle loads it
+//without parsing.
+int main(int argc, char *argv[])
 {
+    std::string pathToSettings {"settings.dat"};
+    std::string pathToImage, pathToJobs, pathToTrace, pathToRecord, pathToReplay, pathToGolden;
+    std::string pathToBundle;
+    std::vector<std::string> pathsToViews;
+    int width {0}, height {0}, threads {0}, warmupFrames {-1};
+    size_t sampleBudget {SamplePool::DEFAULT_BUDGET_MB};
+    bool startupTrace {false};
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--export") == 0 && i + 1 < argc)
+        {
+            pathToImage = argv[++i];
+            if(i + 2 < argc && isdigit(argv[i + 1][0]) && isdigit(argv[i + 2][0]))
+            {
+                width = std::atoi(argv[++i]);
+                height = std::atoi(argv[++i]);
+            }
+        }
+        else if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            pathToJobs = argv[++i];
+        }
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = std::atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            pathToTrace = argv[++i];
+        }
+        else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            pathToRecord = argv[++i];
+        }
+        else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            pathToReplay = argv[++i];
+        }
+        else if(strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+        {
+            pathToGolden = argv[++i];
+        }
+        else if(strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            warmupFrames = std::atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--view") == 0 && i + 1 < argc)
+        {
+            pathsToViews.push_back(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--sample-budget") == 0 && i + 1 < argc)
+        {
+            sampleBudget = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if(strcmp(argv[i], "--compile-bundle") == 0 && i + 1 < argc)
+        {
+            pathToBundle = argv[++i];
+        }
+        else if(strcmp(argv[i], "--startup-trace") == 0)
+        {
+            startupTrace = true;
+        }
+        else
+        {
+            pathToSettings = argv[i];
+        }
+    }
+    if(!pathToJobs.empty())
+    {
+        try
+        {
+            std::vector<BatchJob> jobs;
+            if(pathToJobs == "-")
+            {
+                jobs = BatchRenderer::readJobs(std::cin);
+            }
+            else
+            {
+                std::ifstream fi(pathToJobs);
+                if(!fi.is_open())
+                    throw std::runtime_error("Could not find file with jobs");
+                jobs = BatchRenderer::readJobs(fi);
+            }
+            BatchRenderer renderer(threads);
+            return renderer.run(jobs, std::cout) == 0 ? 0 : 1;
+        }
+        catch(std::exception &ex)
+        {
+            std::cerr << "Error occurs! " << ex.what() << std::endl;
+            return 1;
+        }
+    }
+    if(!pathToBundle.empty())
+    {
+        try
+        {
+            Grapher g(pathToSettings, true);
+            g.writeBundle(pathToBundle);
+        }
+        catch(std::exception &ex)
+        {
+            std::cerr << "Error occurs! " << ex.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if(!pathToImage.empty())
+    {
+        try
+        {
+            Grapher g(pathToSettings, true);
+            g.exportImage(pathToImage, width, height, threads);
+        }
+        catch(std::exception &ex)
+        {
+            std::cerr << "Error occurs! " << ex.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if(!pathToReplay.empty())
+    {
+        //The software renderer draws the same pixels on every machine
+        setenv("SDL_VIDEODRIVER", "dummy", 0);
+        setenv("SDL_RENDER_DRIVER", "software", 0);
+        try
+        {
+            Grapher g(pathToSettings);
+            return g.replay(pathToReplay, pathToGolden, std::cout, warmupFrames);
+        }
+        catch(std::exception &ex)
+        {
+            std::cerr << "Error occurs! " << ex.what() << std::endl;
+            return 1;
+        }
+    }
     try
     {
-        Grapher g("settings.dat");
-        g.run();
+        auto programCache = std::make_shared<iat::ProgramCache>();
+        auto samplePool = std::make_shared<SamplePool>(sampleBudget << 20);
+        Grapher g(pathToSettings, false, programCache, samplePool);
+        g.setStartupTrace(startupTrace);
+        if(!pathToRecord.empty())
+            g.setRecordFile(pathToRecord);
+        if(!pathToTrace.empty())
+            g.setTraceFile(pathToTrace);
+        std::vector<std::unique_ptr<Grapher>> views;
+        std::vector<Grapher *> running {&g};
+        for(const auto &pathToView: pathsToViews)
+        {
+            views.emplace_back(new Grapher(pathToView, false, programCache, samplePool));
+            running.push_back(views.back().get());
+        }
+        Grapher::run(running);
     }
     catch(std::exception &ex)
     {
@@ -0,0 +1,118 @@
+#include "mappedfile.h"
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const std::string &pathToFile)
+{
+    int fd = ::open(pathToFile.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Could not open file " + pathToFile);
+    struct ::stat st;
+    if(fstat(fd, &st) < 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Could not read file " + pathToFile);
+    }
+    m_size = st.st_size;
+    if(m_size > 0)
+    {
+        m_data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(m_data == MAP_FAILED)
+        {
+            m_data = nullptr;
+            m_size = 0;
+            ::close(fd);
+            throw std::runtime_error("Could not map file " + pathToFile);
+        }
+    }
+    //The mapping stays valid after the descriptor is closed
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other):
+    m_data(other.m_data), m_size(other.m_size)
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other)
+{
+    if(this != &other)
+    {
+        close();
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+    }
+    return *this;
+}
+
+const void *MappedFile::data() const
+{
+    return m_data;
+}
+
+size_t MappedFile::size() const
+{
+    return m_size;
+}
+
+bool MappedFile::stat(const std::string &pathToFile, uint64_t &size, uint64_t &mtime)
+{
+    struct ::stat st;
+    if(::stat(pathToFile.c_str(), &st) < 0)
+        return false;
+    size = st.st_size;
+    mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(m_data)
+        munmap(m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+AtomicFileWriter::AtomicFileWriter(const std::string &pathToFile):
+    m_pathToFile(pathToFile),
+    m_pathToTemp(pathToFile + ".tmp"),
+    m_stream(m_pathToTemp, std::ios::binary | std::ios::trunc)
+{
+}
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    if(m_isCommitted)
+        return;
+    m_stream.close();
+    std::remove(m_pathToTemp.c_str());
+}
+
+bool AtomicFileWriter::isOpen() const
+{
+    return m_stream.is_open();
+}
+
+std::ofstream &AtomicFileWriter::stream()
+{
+    return m_stream;
+}
+
+bool AtomicFileWriter::commit()
+{
+    m_stream.close();
+    m_isCommitted = m_stream && std::rename(m_pathToTemp.c_str(), m_pathToFile.c_str()) == 0;
+    return m_isCommitted;
+}
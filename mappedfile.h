@@ -0,0 +1,52 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <fstream>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+//Read-only memory mapping of a whole file. Pages are loaded by the OS on
+//first access, so opening does not depend on the file size.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &pathToFile);
+    ~MappedFile();
+    MappedFile(MappedFile &&other);
+    MappedFile &operator=(MappedFile &&other);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    const void *data() const;
+    size_t size() const;
+    //Size and modification time in nanoseconds, or false if there is no such file
+    static bool stat(const std::string &pathToFile, uint64_t &size, uint64_t &mtime);
+private:
+    void *m_data{nullptr};
+    size_t m_size{0};
+    void close();
+};
+
+//Binary output written under a temporary name and renamed over the file by
+//commit(), so a reader, mapping it or not, sees the old file or the whole
+//new one, never half of it. Without a successful commit() the temporary
+//file is removed.
+class AtomicFileWriter
+{
+public:
+    explicit AtomicFileWriter(const std::string &pathToFile);
+    ~AtomicFileWriter();
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter &operator=(const AtomicFileWriter&) = delete;
+    bool isOpen() const;
+    std::ofstream &stream();
+    //False if a write or the rename failed
+    bool commit();
+private:
+    std::string m_pathToFile, m_pathToTemp;
+    std::ofstream m_stream;
+    bool m_isCommitted{false};
+};
+
+#endif // MAPPEDFILE_H
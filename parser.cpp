@@ -32,6 +32,8 @@ std::map<iat::ParserErrorCode, std::string> iat::ErrorParser::createMap()
     map[ParserErrorCode::UNKNOWN_UNARY_OPERATOR] = "Unknown unary operator";
     map[ParserErrorCode::UNKNOW_EXPRESSION_TYPE] = "Unknown expression type";
     map[ParserErrorCode::UNBALANCED_PARENTHESIS] = "Unbalanced parentethises";
+    map[ParserErrorCode::INVALID_DEFINITION] = "Invalid definition";
+    map[ParserErrorCode::ARGUMENT_COUNT_MISMATCH] = "Wrong number of arguments";
     map[ParserErrorCode:: UNKNOWN_ERROR] = "Unknown error";
     return map;
 }
@@ -94,6 +96,11 @@ iat::Parser::Parser(const std::string &inputString, std::vector<std::pair<char,d
 
 const iat::Parser::MyTokens iat::Parser::m_tokens;
 
+const std::vector<std::string> &iat::Parser::tokens()
+{
+    return m_tokens.tokens;
+}
+
 std::string iat::Parser::parseToken()
 {
     //std::cout << "input= " << input << std::endl;
@@ -133,7 +140,7 @@ iat::Parser::Expression iat::Parser::parseUnaryExpression() {
     return Expression(token, parseUnaryExpression());
 }
 
-int getPriority(const std::string& binaryOperation) {
+int iat::getPriority(const std::string& binaryOperation) {
     if (binaryOperation == "+" || binaryOperation == "-") return 1;
     if (binaryOperation == "*" || binaryOperation == "/" || binaryOperation == "mod" ||
         binaryOperation == "e") return 2;
@@ -19,6 +19,8 @@ namespace iat {
         UNKNOWN_UNARY_OPERATOR = 105,      //105"Unknown unary operator"
         UNKNOW_EXPRESSION_TYPE = 106,      //106"Unknown expression type"
         UNBALANCED_PARENTHESIS = 107,      //107"Unbalanced parentethises"
+        INVALID_DEFINITION = 108,          //108"Invalid definition"
+        ARGUMENT_COUNT_MISMATCH = 109,     //109"Wrong number of arguments"
         UNKNOWN_ERROR = 200                //200"Unknown error"
     };
 
@@ -36,12 +38,15 @@ namespace iat {
         static std::map<ParserErrorCode, std::string> createMap();
     };
 
+    int getPriority(const std::string& binaryOperation);
+
     class Parser {
 
     public:
         explicit Parser(const std::string &inputString, std::vector<std::pair<char,double>> vars);
         explicit Parser(const std::string &inputString, std::vector<std::pair<char,double>> vars, std::string m_angleUnit);
         double calculateExpression();
+        static const std::vector<std::string> &tokens();
     private:
 
         const char* m_input;
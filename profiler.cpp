@@ -0,0 +1,194 @@
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+
+std::atomic<uint64_t> Profiler::s_counters[COUNTER_COUNT];
+
+Profiler::Profiler():
+    m_origin(std::chrono::steady_clock::now())
+{
+    for(int i = 0; i < COUNTER_COUNT; ++i)
+        m_frameStartCounts[i] = m_lastFrameCounts[i] = total(Counter(i));
+    m_frameTimes.reserve(FRAME_HISTORY);
+    m_sortedFrameTimes.reserve(FRAME_HISTORY);
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool Profiler::enabled() const
+{
+    return m_enabled || isTracing();
+}
+
+void Profiler::beginScope(const char *name, int index)
+{
+    if(!enabled())
+        return;
+    m_open.push_back(m_scopes.size());
+    m_scopes.push_back({name, index, int(m_open.size()) - 1, now(), 0});
+}
+
+void Profiler::endScope()
+{
+    //A scope opened before profiling was switched on has nothing to close
+    if(m_open.empty())
+        return;
+    Scope &scope = m_scopes[m_open.back()];
+    scope.duration = now() - scope.start;
+    m_open.pop_back();
+}
+
+void Profiler::endFrame()
+{
+    uint64_t counts[COUNTER_COUNT];
+    for(int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        const uint64_t current = total(Counter(i));
+        counts[i] = current - m_frameStartCounts[i];
+        m_frameStartCounts[i] = current;
+        m_lastFrameCounts[i] = counts[i];
+    }
+    if(!enabled() || !m_open.empty())
+    {
+        m_scopes.clear();
+        return;
+    }
+    double frameTime = 0;
+    for(const auto &scope: m_scopes)
+    {
+        if(scope.depth == 0)
+            frameTime += scope.duration;
+    }
+    m_lastFrameTime = frameTime;
+    if(frameTime > m_worstFrameTime)
+    {
+        m_worstFrameTime = frameTime;
+        m_worstFrame = m_scopes;
+    }
+    if(m_frameTimes.size() < FRAME_HISTORY)
+        m_frameTimes.push_back(frameTime);
+    else
+        m_frameTimes[m_nextFrame] = frameTime;
+    m_nextFrame = (m_nextFrame + 1) % FRAME_HISTORY;
+    if(isTracing() && m_trace.size() < MAX_TRACE_FRAMES)
+    {
+        m_trace.push_back({m_scopes, {}});
+        std::copy(counts, counts + COUNTER_COUNT, m_trace.back().counts);
+    }
+    m_lastFrame.swap(m_scopes);
+    m_scopes.clear();
+}
+
+void Profiler::count(Counter counter, uint64_t n)
+{
+    s_counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::total(Counter counter)
+{
+    return s_counters[counter].load(std::memory_order_relaxed);
+}
+
+const char *Profiler::counterName(Counter counter)
+{
+    static const char *names[COUNTER_COUNT] = {"samples", "segments", "allocations",
+                                                 "curves", "backgrounds"};
+    return names[counter];
+}
+
+double Profiler::frameTimePercentile(double p) const
+{
+    if(m_frameTimes.empty())
+        return 0;
+    //Asked for every frame the overlay is on, so the copy is not allocated
+    std::vector<double> &sorted = m_sortedFrameTimes;
+    sorted.assign(m_frameTimes.begin(), m_frameTimes.end());
+    const size_t rank = std::min(sorted.size() - 1, size_t(p / 100 * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+size_t Profiler::framesRecorded() const
+{
+    return m_frameTimes.size();
+}
+
+double Profiler::lastFrameTime() const
+{
+    return m_lastFrameTime;
+}
+
+const std::vector<Profiler::Scope> &Profiler::lastFrame() const
+{
+    return m_lastFrame;
+}
+
+double Profiler::worstFrameTime() const
+{
+    return m_worstFrameTime;
+}
+
+const std::vector<Profiler::Scope> &Profiler::worstFrame() const
+{
+    return m_worstFrame;
+}
+
+uint64_t Profiler::lastFrameCount(Counter counter) const
+{
+    return m_lastFrameCounts[counter];
+}
+
+void Profiler::startTrace(const std::string &pathToFile)
+{
+    m_pathToTrace = pathToFile;
+    m_trace.clear();
+}
+
+bool Profiler::isTracing() const
+{
+    return !m_pathToTrace.empty();
+}
+
+void Profiler::stopTrace()
+{
+    if(!isTracing())
+        return;
+    std::ofstream fo(m_pathToTrace);
+    m_pathToTrace.clear();
+    if(!fo.is_open())
+        return;
+    //Complete events ("X") per scope and one counter event ("C") per frame;
+    //timestamps are in microseconds
+    fo << "{\"traceEvents\":[";
+    bool first = true;
+    for(const auto &frame: m_trace)
+    {
+        for(const auto &scope: frame.scopes)
+        {
+            fo << (first ? "\n" : ",\n") << "{\"name\":\"" << scope.name;
+            if(scope.index >= 0)
+                fo << ' ' << scope.index;
+            fo << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << scope.start * 1000
+               << ",\"dur\":" << scope.duration * 1000 << "}";
+            first = false;
+        }
+        if(frame.scopes.empty())
+            continue;
+        fo << ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":"
+           << frame.scopes.front().start * 1000 << ",\"args\":{";
+        for(int i = 0; i < COUNTER_COUNT; ++i)
+            fo << (i ? "," : "") << '"' << counterName(Counter(i)) << "\":" << frame.counts[i];
+        fo << "}}";
+    }
+    fo << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    m_trace.clear();
+}
+
+double Profiler::now() const
+{
+    return std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - m_origin).count();
+}
@@ -0,0 +1,109 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Scoped timings and counters per frame. Scopes are recorded only while the
+//overlay or a trace needs them; the counters are always kept, they are a
+//single relaxed atomic add. A frame's time is the sum of its top level
+//scopes, so the time spent sleeping in the event queue is not included.
+//ALLOCATIONS is counted by the global operator new of allocationcounter.cpp.
+class Profiler
+{
+public:
+    enum Counter
+    {
+        SAMPLES,
+        SEGMENTS,
+        ALLOCATIONS,
+        CURVES,
+        BACKGROUNDS,
+        COUNTER_COUNT
+    };
+    struct Scope
+    {
+        //Names are string literals; index is -1 or, say, the curve number
+        const char *name;
+        int index;
+        int depth;
+        double start;
+        double duration;
+    };
+    Profiler();
+    void setEnabled(bool enabled);
+    bool enabled() const;
+    void beginScope(const char *name, int index = -1);
+    void endScope();
+    //Closes the frame that the scopes since the previous call belong to
+    void endFrame();
+    static void count(Counter counter, uint64_t n = 1);
+    static uint64_t total(Counter counter);
+    static const char *counterName(Counter counter);
+    //Percentile p (0..100) of the recent frame times in ms
+    double frameTimePercentile(double p) const;
+    size_t framesRecorded() const;
+    double lastFrameTime() const;
+    const std::vector<Scope> &lastFrame() const;
+    double worstFrameTime() const;
+    const std::vector<Scope> &worstFrame() const;
+    uint64_t lastFrameCount(Counter counter) const;
+    //Trace events are buffered until stopTrace() writes them as Chrome
+    //trace-event JSON (chrome://tracing, Perfetto)
+    void startTrace(const std::string &pathToFile);
+    bool isTracing() const;
+    void stopTrace();
+private:
+    enum
+    {
+        FRAME_HISTORY = 240,
+        MAX_TRACE_FRAMES = 100000
+    };
+    struct TraceFrame
+    {
+        std::vector<Scope> scopes;
+        uint64_t counts[COUNTER_COUNT];
+    };
+    static std::atomic<uint64_t> s_counters[COUNTER_COUNT];
+    std::chrono::steady_clock::time_point m_origin;
+    bool m_enabled{false};
+    std::vector<Scope> m_scopes;
+    std::vector<size_t> m_open;
+    std::vector<Scope> m_lastFrame;
+    uint64_t m_frameStartCounts[COUNTER_COUNT];
+    uint64_t m_lastFrameCounts[COUNTER_COUNT];
+    std::vector<double> m_frameTimes;
+    //Scratch of frameTimePercentile()
+    mutable std::vector<double> m_sortedFrameTimes;
+    size_t m_nextFrame{0};
+    double m_lastFrameTime{0};
+    double m_worstFrameTime{0};
+    std::vector<Scope> m_worstFrame;
+    std::string m_pathToTrace;
+    std::vector<TraceFrame> m_trace;
+
+    double now() const;
+};
+
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler &profiler, const char *name, int index = -1):
+        m_profiler(profiler)
+    {
+        m_profiler.beginScope(name, index);
+    }
+    ~ProfileScope()
+    {
+        m_profiler.endScope();
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope &operator=(const ProfileScope&) = delete;
+private:
+    Profiler &m_profiler;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,137 @@
+#include "samplecache.h"
+#include "mappedfile.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace
+{
+    const char ENTRY_MAGIC[8] = {'T', 'E', 'S', 'A', 'M', 'P', 'L', 'E'};
+
+    //FNV-1a
+    uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+    {
+        const unsigned char *p = static_cast<const unsigned char*>(data);
+        for(size_t i = 0; i < size; ++i)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    //Points follow the header and the key, aligned for direct use from the mapping
+    size_t pointsOffset(size_t keySize, size_t headerSize)
+    {
+        return (headerSize + keySize + 7) / 8 * 8;
+    }
+}
+
+SampleCache::SampleCache(const std::string &directory):
+    m_directory(directory)
+{
+    if(!m_directory.empty())
+        mkdir(m_directory.c_str(), 0755);
+}
+
+bool SampleCache::enabled() const
+{
+    return !m_directory.empty();
+}
+
+void SampleCache::setEquationsFile(const std::string &pathToFile)
+{
+    if(!MappedFile::stat(pathToFile, m_equationsSize, m_equationsMtime))
+        m_equationsSize = m_equationsMtime = 0;
+}
+
+bool SampleCache::load(const std::string &expr, const std::string &angleUnit, double Xmin,
+                       double Xmax, double dX,
+                       std::vector<std::pair<double, double>> &samples) const
+{
+    if(!enabled())
+        return false;
+    const std::string entryKey = key(expr, angleUnit);
+    const std::string pathToFile = pathToEntry(entryKey, Xmin, Xmax, dX);
+    uint64_t size, mtime;
+    if(!MappedFile::stat(pathToFile, size, mtime) || size < sizeof(EntryHeader))
+        return false;
+    try
+    {
+        MappedFile entry(pathToFile);
+        const char *base = static_cast<const char*>(entry.data());
+        const EntryHeader *header = reinterpret_cast<const EntryHeader*>(base);
+        const size_t offset = pointsOffset(header->keySize, sizeof(EntryHeader));
+        if(memcmp(header->magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0 ||
+           header->version != VERSION || header->keySize != entryKey.size() ||
+           header->equationsSize != m_equationsSize ||
+           header->equationsMtime != m_equationsMtime || header->Xmin != Xmin ||
+           header->Xmax != Xmax || header->dX != dX ||
+           offset + header->count * 2 * sizeof(double) > size ||
+           memcmp(base + sizeof(EntryHeader), entryKey.data(), entryKey.size()) != 0)
+            return false;
+        const double *points = reinterpret_cast<const double*>(base + offset);
+        samples.resize(header->count);
+        for(size_t i = 0; i < samples.size(); ++i)
+            samples[i] = {points[2 * i], points[2 * i + 1]};
+        return true;
+    }
+    catch(std::exception &)
+    {
+        return false;
+    }
+}
+
+void SampleCache::store(const std::string &expr, const std::string &angleUnit, double Xmin,
+                        double Xmax, double dX,
+                        const std::vector<std::pair<double, double>> &samples) const
+{
+    if(!enabled())
+        return;
+    const std::string entryKey = key(expr, angleUnit);
+    const std::string pathToFile = pathToEntry(entryKey, Xmin, Xmax, dX);
+    AtomicFileWriter file(pathToFile);
+    if(!file.isOpen())
+        return;
+    std::ofstream &fo = file.stream();
+    EntryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+    header.version = VERSION;
+    header.keySize = entryKey.size();
+    header.equationsSize = m_equationsSize;
+    header.equationsMtime = m_equationsMtime;
+    header.Xmin = Xmin;
+    header.Xmax = Xmax;
+    header.dX = dX;
+    header.count = samples.size();
+    fo.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    fo.write(entryKey.data(), entryKey.size());
+    const size_t padding = pointsOffset(entryKey.size(), sizeof(header)) -
+            sizeof(header) - entryKey.size();
+    const char zeros[8] = {0};
+    fo.write(zeros, padding);
+    //std::pair<double, double> is laid out as two doubles
+    fo.write(reinterpret_cast<const char*>(samples.data()),
+             samples.size() * 2 * sizeof(double));
+    file.commit();
+}
+
+std::string SampleCache::key(const std::string &expr, const std::string &angleUnit)
+{
+    return expr + '\n' + angleUnit;
+}
+
+std::string SampleCache::pathToEntry(const std::string &key, double Xmin, double Xmax,
+                                     double dX) const
+{
+    uint64_t hash = hashBytes(key.data(), key.size());
+    hash = hashBytes(&Xmin, sizeof(Xmin), hash);
+    hash = hashBytes(&Xmax, sizeof(Xmax), hash);
+    hash = hashBytes(&dX, sizeof(dX), hash);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.samples", (unsigned long long)hash);
+    return m_directory + "/" + name;
+}
@@ -0,0 +1,49 @@
+#ifndef SAMPLECACHE_H
+#define SAMPLECACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Computed curve samples kept in a directory between runs, one file per curve
+//and sampling. The file name is a hash of the expression text, angle unit,
+//X range and step; the header repeats the full key, so a hash collision is
+//only a miss. Entries written for another version of the equations file
+//(size or modification time) are misses as well and get overwritten.
+class SampleCache
+{
+public:
+    //An empty directory disables the cache
+    explicit SampleCache(const std::string &directory);
+    bool enabled() const;
+    void setEquationsFile(const std::string &pathToFile);
+    //World space (x, y) samples, or false on a miss
+    bool load(const std::string &expr, const std::string &angleUnit, double Xmin,
+              double Xmax, double dX, std::vector<std::pair<double, double>> &samples) const;
+    //Failures to write are ignored, the cache is only an accelerator
+    void store(const std::string &expr, const std::string &angleUnit, double Xmin,
+               double Xmax, double dX,
+               const std::vector<std::pair<double, double>> &samples) const;
+private:
+    enum
+    {
+        VERSION = 2
+    };
+    struct EntryHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t keySize;
+        uint64_t equationsSize;
+        uint64_t equationsMtime;
+        double Xmin, Xmax, dX;
+        uint64_t count;
+    };
+    std::string m_directory;
+    uint64_t m_equationsSize{0}, m_equationsMtime{0};
+
+    static std::string key(const std::string &expr, const std::string &angleUnit);
+    std::string pathToEntry(const std::string &key, double Xmin, double Xmax, double dX) const;
+};
+
+#endif // SAMPLECACHE_H
@@ -0,0 +1,236 @@
+#include "samplepool.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+namespace
+{
+    //Block of a grid index, rounding towards minus infinity
+    int64_t blockOf(int64_t k)
+    {
+        return k >= 0 ? k / SamplePool::BLOCK_SIZE :
+                        -((-k - 1) / SamplePool::BLOCK_SIZE) - 1;
+    }
+    //Grid indices beyond this are not exact in a double
+    const double MAX_GRID_INDEX = 4503599627370496.0;
+}
+
+bool SamplePool::Key::operator<(const Key &other) const
+{
+    return std::tie(program, dX, block) < std::tie(other.program, other.dX, other.block);
+}
+
+SamplePool::SamplePool(size_t budgetBytes):
+    m_budget(budgetBytes)
+{
+}
+
+void SamplePool::sample(const std::shared_ptr<const iat::Program> &program, double dX,
+                        double Xmin, double Xmax, std::vector<std::pair<double, double>> &line)
+{
+    sample(std::vector<std::shared_ptr<const iat::Program>>{program}, dX, Xmin, Xmax, {&line});
+}
+
+void SamplePool::sample(const std::vector<std::shared_ptr<const iat::Program>> &programs,
+                        double dX, double Xmin, double Xmax,
+                        const std::vector<std::vector<std::pair<double, double>> *> &lines)
+{
+    for(auto line: lines)
+        line->clear();
+    if(!(dX > 0) || !(Xmin <= Xmax))
+        return;
+    const double first = std::ceil(Xmin / dX), last = std::floor(Xmax / dX);
+    if(!(fabs(first) < MAX_GRID_INDEX && fabs(last) < MAX_GRID_INDEX) || first > last)
+        return;
+    const int64_t kFirst = int64_t(first), kLast = int64_t(last);
+    for(size_t i = 0; i < programs.size(); ++i)
+    {
+        if(programs[i])
+            lines[i]->reserve(size_t(kLast - kFirst + 1));
+    }
+    //Per thread and kept, so copying blocks that are already in the pool
+    //does not allocate
+    thread_local std::vector<std::shared_ptr<const Block>> blocks;
+    thread_local std::vector<size_t> missing;
+    blocks.assign(programs.size(), nullptr);
+    for(int64_t block = blockOf(kFirst); block <= blockOf(kLast); ++block)
+    {
+        missing.clear();
+        for(size_t i = 0; i < programs.size(); ++i)
+        {
+            blocks[i] = programs[i] ? find(programs[i], dX, block) : nullptr;
+            if(programs[i] && !blocks[i])
+                missing.push_back(i);
+        }
+        if(!missing.empty())
+            compute(programs, missing, dX, block, blocks);
+        const int64_t start = block * BLOCK_SIZE;
+        const int64_t from = std::max(kFirst, start), to = std::min(kLast, start + BLOCK_SIZE - 1);
+        for(size_t i = 0; i < programs.size(); ++i)
+        {
+            if(!blocks[i])
+                continue;
+            for(int64_t k = from; k <= to; ++k)
+                lines[i]->emplace_back(k * dX, blocks[i]->y[size_t(k - start)]);
+        }
+    }
+    blocks.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    trim();
+}
+
+void SamplePool::setBudget(size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = budgetBytes;
+    trim();
+}
+
+size_t SamplePool::bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+size_t SamplePool::blocks() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_blocks.size();
+}
+
+std::shared_ptr<const SamplePool::Block> SamplePool::find(
+        const std::shared_ptr<const iat::Program> &program, double dX, int64_t block)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_blocks.find(Key {program.get(), dX, block});
+    //A dead program's address may be reused by a new one
+    if(it == m_blocks.end() || it->second->program.lock() != program)
+        return nullptr;
+    m_ages.splice(m_ages.begin(), m_ages, it->second->age);
+    return it->second;
+}
+
+void SamplePool::compute(const std::vector<std::shared_ptr<const iat::Program>> &programs,
+                         const std::vector<size_t> &missing, double dX, int64_t block,
+                         std::vector<std::shared_ptr<const Block>> &blocks)
+{
+    //Evaluated without the lock, so views on other threads are not held up
+    double xs[BLOCK_SIZE];
+    for(int64_t i = 0; i < BLOCK_SIZE; ++i)
+        xs[i] = (block * BLOCK_SIZE + i) * dX;
+    auto newBlock = [](const std::shared_ptr<const iat::Program> &program)
+    {
+        auto data = std::make_shared<Block>();
+        data->program = program;
+        data->y.resize(BLOCK_SIZE);
+        return data;
+    };
+    std::vector<bool> done(missing.size(), false);
+    for(size_t m = 0; m < missing.size(); ++m)
+    {
+        if(done[m])
+            continue;
+        const auto &program = programs[missing[m]];
+        const auto &group = program->group();
+        if(group)
+        {
+            //Every missing member of the group in one pass; if any of them
+            //fails they are retried on their own below, so only the failing
+            //one pays for evaluating point by point
+            std::vector<double *> outputs(group->outputs(), nullptr);
+            std::vector<std::pair<size_t, std::shared_ptr<Block>>> members;
+            for(size_t n = m; n < missing.size(); ++n)
+            {
+                const auto &member = programs[missing[n]];
+                if(done[n] || member->group() != group)
+                    continue;
+                members.emplace_back(n, newBlock(member));
+                outputs[member->groupOutput()] = members.back().second->y.data();
+            }
+            try
+            {
+                group->evaluate(xs, BLOCK_SIZE, outputs.data());
+                for(auto &member: members)
+                {
+                    done[member.first] = true;
+                    blocks[missing[member.first]] = member.second;
+                }
+                Profiler::count(Profiler::SAMPLES, BLOCK_SIZE * members.size());
+                continue;
+            }
+            catch(std::exception &)
+            {
+            }
+        }
+        auto data = newBlock(program);
+        double *output = data->y.data();
+        try
+        {
+            program->evaluate(xs, BLOCK_SIZE, &output);
+        }
+        catch(std::exception &)
+        {
+            //A division by zero or argument out of range anywhere fails the
+            //whole block, even outside the view; then each point is
+            //evaluated alone and the failing ones become gaps in the curve
+            for(size_t k = 0; k < BLOCK_SIZE; ++k)
+            {
+                try
+                {
+                    output[k] = program->evaluate(xs[k]);
+                }
+                catch(std::exception &)
+                {
+                    output[k] = NAN;
+                }
+            }
+        }
+        Profiler::count(Profiler::SAMPLES, BLOCK_SIZE);
+        done[m] = true;
+        blocks[missing[m]] = data;
+    }
+    for(size_t i: missing)
+        insert(programs[i], dX, block, blocks[i]);
+}
+
+//Two views racing for the same block keep whichever arrives first
+void SamplePool::insert(const std::shared_ptr<const iat::Program> &program, double dX,
+                        int64_t block, std::shared_ptr<const Block> &data)
+{
+    const Key key {program.get(), dX, block};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_blocks.find(key);
+    if(it != m_blocks.end())
+    {
+        if(it->second->program.lock() == program)
+        {
+            m_ages.splice(m_ages.begin(), m_ages, it->second->age);
+            data = it->second;
+            return;
+        }
+        m_ages.erase(it->second->age);
+        m_bytes -= it->second->y.size() * sizeof(double);
+        m_blocks.erase(it);
+    }
+    m_ages.push_front(key);
+    data->age = m_ages.begin();
+    m_bytes += data->y.size() * sizeof(double);
+    m_blocks.emplace(key, data);
+}
+
+void SamplePool::trim()
+{
+    //Blocks still being copied by another call are skipped
+    auto age = m_ages.end();
+    while(m_bytes > m_budget && age != m_ages.begin())
+    {
+        --age;
+        auto it = m_blocks.find(*age);
+        if(it->second.use_count() > 1)
+            continue;
+        m_bytes -= it->second->y.size() * sizeof(double);
+        age = m_ages.erase(age);
+        m_blocks.erase(it);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef SAMPLEPOOL_H
+#define SAMPLEPOOL_H
+
+#include "compiler.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+//World space samples of compiled expressions shared by every view of a
+//process. Samples lie on the global grid x = k * dX and are kept in blocks
+//of BLOCK_SIZE points, so a region evaluated for one view is only copied
+//for another view or after a pan. Blocks not in use are dropped least
+//recently used first once the pool outgrows its memory budget. Blocks do
+//not keep their program alive; those of a removed equation simply age out.
+//Missing blocks of programs compiled as one group are computed together
+//by the group program, so shared subexpressions are evaluated once.
+class SamplePool
+{
+public:
+    enum
+    {
+        BLOCK_SIZE = 128,
+        DEFAULT_BUDGET_MB = 256
+    };
+    explicit SamplePool(size_t budgetBytes = size_t(DEFAULT_BUDGET_MB) << 20);
+    //Grid points in [Xmin, Xmax]; safe to call from several threads.
+    //Points where the evaluation fails are NaN.
+    void sample(const std::shared_ptr<const iat::Program> &program, double dX, double Xmin,
+                double Xmax, std::vector<std::pair<double, double>> &line);
+    //Several curves over the same range, lines[i] for programs[i]
+    void sample(const std::vector<std::shared_ptr<const iat::Program>> &programs, double dX,
+                double Xmin, double Xmax,
+                const std::vector<std::vector<std::pair<double, double>> *> &lines);
+    void setBudget(size_t budgetBytes);
+    size_t bytes() const;
+    size_t blocks() const;
+private:
+    struct Key
+    {
+        const iat::Program *program;
+        double dX;
+        int64_t block;
+        bool operator<(const Key &other) const;
+    };
+    struct Block
+    {
+        std::weak_ptr<const iat::Program> program;
+        std::vector<double> y;
+        mutable std::list<Key>::iterator age;
+    };
+    mutable std::mutex m_mutex;
+    size_t m_budget;
+    size_t m_bytes{0};
+    std::map<Key, std::shared_ptr<const Block>> m_blocks;
+    //Most recently used first
+    std::list<Key> m_ages;
+
+    std::shared_ptr<const Block> find(const std::shared_ptr<const iat::Program> &program,
+                                      double dX, int64_t block);
+    void compute(const std::vector<std::shared_ptr<const iat::Program>> &programs,
+                 const std::vector<size_t> &missing, double dX, int64_t block,
+                 std::vector<std::shared_ptr<const Block>> &blocks);
+    void insert(const std::shared_ptr<const iat::Program> &program, double dX, int64_t block,
+                std::shared_ptr<const Block> &data);
+    void trim();
+};
+
+#endif // SAMPLEPOOL_H
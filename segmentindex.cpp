@@ -0,0 +1,143 @@
+#include "segmentindex.h"
+#include <algorithm>
+#include <cmath>
+
+void SegmentIndex::build(const std::vector<std::pair<double, double>> &line)
+{
+    m_offsets.clear();
+    m_entries.clear();
+    m_columnHeight.clear();
+    m_wideSegments.clear();
+    m_isValid = true;
+    double xmin = INFINITY, xmax = -INFINITY;
+    for(const auto &point: line)
+    {
+        if(!std::isfinite(point.first) || !std::isfinite(point.second))
+            continue;
+        xmin = std::min(xmin, point.first);
+        xmax = std::max(xmax, point.first);
+    }
+    //Segments are numbered with 32 bits
+    if(line.size() < 2 || line.size() > UINT32_MAX || !(xmin <= xmax))
+        return;
+    const size_t count = std::max<size_t>(1, std::min<size_t>(
+            (line.size() - 1) / SEGMENTS_PER_COLUMN, MAX_COLUMNS));
+    m_Xmin = xmin;
+    m_columnWidth = (xmax - xmin) / count;
+    //All samples at one X
+    if(!(m_columnWidth > 0))
+        m_columnWidth = 1;
+    m_offsets.assign(count + 1, 0);
+    m_columnHeight.assign(count, 0);
+    //Segments with a sample that is not finite are not drawn, so not picked
+    auto segmentColumns = [&](size_t k, size_t &first, size_t &last)
+    {
+        const auto &a = line[k], &b = line[k + 1];
+        if(!std::isfinite(a.first) || !std::isfinite(a.second) ||
+           !std::isfinite(b.first) || !std::isfinite(b.second))
+            return false;
+        columns(std::min(a.first, b.first), std::max(a.first, b.first), first, last);
+        return true;
+    };
+    //Counted first, so the lists of all columns fit in one array
+    size_t first, last;
+    for(size_t k = 0; k + 1 < line.size(); ++k)
+    {
+        if(!segmentColumns(k, first, last))
+            continue;
+        if(last - first > MAX_SEGMENT_COLUMNS)
+        {
+            m_wideSegments.push_back(uint32_t(k));
+            continue;
+        }
+        const double height = std::fabs(line[k + 1].second - line[k].second);
+        for(size_t c = first; c < last; ++c)
+        {
+            ++m_offsets[c + 1];
+            m_columnHeight[c] = std::max(m_columnHeight[c], height);
+        }
+    }
+    for(size_t c = 0; c < count; ++c)
+        m_offsets[c + 1] += m_offsets[c];
+    m_entries.resize(m_offsets.back());
+    //Filled through m_offsets[c + 1], which ends up at the end of column c,
+    //so that rebuilding needs no other buffer
+    for(size_t c = count; c > 0; --c)
+        m_offsets[c] = m_offsets[c - 1];
+    for(size_t k = 0; k + 1 < line.size(); ++k)
+    {
+        if(!segmentColumns(k, first, last) || last - first > MAX_SEGMENT_COLUMNS)
+            continue;
+        const double ymin = std::min(line[k].second, line[k + 1].second);
+        for(size_t c = first; c < last; ++c)
+            m_entries[m_offsets[c + 1]++] = {ymin, uint32_t(k)};
+    }
+    for(size_t c = 0; c < count; ++c)
+        std::sort(m_entries.begin() + m_offsets[c], m_entries.begin() + m_offsets[c + 1],
+                  [](const Entry &a, const Entry &b) { return a.ymin < b.ymin; });
+}
+
+void SegmentIndex::invalidate()
+{
+    m_isValid = false;
+}
+
+bool SegmentIndex::isValid() const
+{
+    return m_isValid;
+}
+
+bool SegmentIndex::nearest(const std::vector<std::pair<double, double>> &line, double x,
+                           double y, double scaleX, double scaleY, double radius,
+                           Hit &hit) const
+{
+    if(!m_isValid || m_offsets.size() < 2)
+        return false;
+    bool isFound = false;
+    hit.distance = radius;
+    //In pixels around (x, y)
+    auto test = [&](size_t k)
+    {
+        const auto &a = line[k], &b = line[k + 1];
+        const double ax = (a.first - x) * scaleX, ay = (a.second - y) * scaleY;
+        const double dx = (b.first - a.first) * scaleX, dy = (b.second - a.second) * scaleY;
+        const double length2 = dx * dx + dy * dy;
+        const double t = length2 > 0 ? std::min(1.0, std::max(0.0, -(ax * dx + ay * dy) / length2))
+                                     : 0.0;
+        const double distance = std::hypot(ax + t * dx, ay + t * dy);
+        if(distance > hit.distance || (isFound && distance == hit.distance))
+            return;
+        hit = {a.first + t * (b.first - a.first), a.second + t * (b.second - a.second),
+               distance, k};
+        isFound = true;
+    };
+    const double rx = radius / scaleX, ry = radius / scaleY;
+    const double xmax = m_Xmin + m_columnWidth * (m_offsets.size() - 1);
+    if(x + rx >= m_Xmin && x - rx <= xmax)
+    {
+        size_t first, last;
+        columns(x - rx, x + rx, first, last);
+        //A segment can reach the point only if its lowest Y is in
+        //[y - ry - height, y + ry], height being the tallest of the column
+        auto below = [](const Entry &entry, double value) { return entry.ymin < value; };
+        for(size_t c = first; c < last; ++c)
+        {
+            const auto end = m_entries.begin() + m_offsets[c + 1];
+            for(auto e = std::lower_bound(m_entries.begin() + m_offsets[c], end,
+                                          y - ry - m_columnHeight[c], below);
+                e != end && e->ymin <= y + ry; ++e)
+                test(e->segment);
+        }
+    }
+    for(uint32_t k: m_wideSegments)
+        test(k);
+    return isFound;
+}
+
+void SegmentIndex::columns(double xmin, double xmax, size_t &first, size_t &last) const
+{
+    //Clamped as doubles, so X far outside cannot overflow the conversion
+    const double top = double(m_offsets.size() - 2);
+    first = size_t(std::min(top, std::max(0.0, std::floor((xmin - m_Xmin) / m_columnWidth))));
+    last = size_t(std::min(top, std::max(0.0, std::floor((xmax - m_Xmin) / m_columnWidth)))) + 1;
+}
@@ -0,0 +1,64 @@
+#ifndef SEGMENTINDEX_H
+#define SEGMENTINDEX_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+//Finds the segment of a sampled curve nearest to a point. The X range of
+//the samples is cut into columns, about SEGMENTS_PER_COLUMN segments wide,
+//and every column lists the segments that cross it ordered by their lowest
+//Y. A query looks only at the columns within the pick radius, and there
+//binary searches for the segments that can reach the point, so its cost
+//grows with the logarithm of the number of samples. The columns are in world
+//space, so pans and zooms keep the index; it is built again only after
+//the curve was resampled.
+class SegmentIndex
+{
+public:
+    struct Hit
+    {
+        //Nearest point on the curve, in world space
+        double x, y;
+        //In pixels
+        double distance;
+        //Index of the first point of the segment
+        size_t segment;
+    };
+    void build(const std::vector<std::pair<double, double>> &line);
+    //Marks the samples as changed; build() has to be called before nearest()
+    void invalidate();
+    bool isValid() const;
+    //Distances are measured in pixels, scaleX and scaleY are pixels per
+    //world unit. Returns false if no segment is within radius pixels of
+    //(x, y), otherwise fills hit.
+    bool nearest(const std::vector<std::pair<double, double>> &line, double x, double y,
+                 double scaleX, double scaleY, double radius, Hit &hit) const;
+private:
+    enum
+    {
+        SEGMENTS_PER_COLUMN = 4,
+        MAX_COLUMNS = 1 << 16,
+        //Segments crossing more columns than this, as parametric curves and
+        //sparse series have, are kept in a list of their own instead
+        MAX_SEGMENT_COLUMNS = 64
+    };
+    struct Entry
+    {
+        double ymin;
+        uint32_t segment;
+    };
+    double m_Xmin{0}, m_columnWidth{1};
+    //Entries of column c are m_entries[m_offsets[c]] .. m_entries[m_offsets[c + 1]],
+    //none of them more than m_columnHeight[c] tall
+    std::vector<uint32_t> m_offsets;
+    std::vector<Entry> m_entries;
+    std::vector<double> m_columnHeight;
+    std::vector<uint32_t> m_wideSegments;
+    bool m_isValid{false};
+
+    void columns(double xmin, double xmax, size_t &first, size_t &last) const;
+};
+
+#endif // SEGMENTINDEX_H
@@ -0,0 +1,426 @@
+#include "softrenderer.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <zlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    inline double fpart(double x)
+    {
+        return x - floor(x);
+    }
+
+    inline double rfpart(double x)
+    {
+        return 1 - fpart(x);
+    }
+
+    //Coverage in [0, 1] combined with the color alpha, scaled to [0, 256]
+    inline int blendFactor(const SDL_Color &color, double coverage)
+    {
+        return int(coverage * color.a * 256 / 255 + 0.5);
+    }
+
+    inline void blend(uint8_t *dst, const SDL_Color &color, int alpha)
+    {
+        dst[0] = (dst[0] * (256 - alpha) + color.r * alpha) >> 8;
+        dst[1] = (dst[1] * (256 - alpha) + color.g * alpha) >> 8;
+        dst[2] = (dst[2] * (256 - alpha) + color.b * alpha) >> 8;
+        dst[3] = (dst[3] * (256 - alpha) + color.a * alpha) >> 8;
+    }
+
+    //Both pixels of one Wu step are blended in a single SSE2 operation
+    inline void blendPair(uint8_t *dst1, uint8_t *dst2, const SDL_Color &color,
+                          int alpha1, int alpha2)
+    {
+#ifdef __SSE2__
+        int32_t d1, d2;
+        memcpy(&d1, dst1, 4);
+        memcpy(&d2, dst2, 4);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i dst = _mm_unpacklo_epi32(_mm_cvtsi32_si128(d1), _mm_cvtsi32_si128(d2));
+        dst = _mm_unpacklo_epi8(dst, zero);
+        const __m128i src = _mm_set_epi16(color.a, color.b, color.g, color.r,
+                                          color.a, color.b, color.g, color.r);
+        const __m128i a = _mm_set_epi16(alpha2, alpha2, alpha2, alpha2,
+                                        alpha1, alpha1, alpha1, alpha1);
+        const __m128i na = _mm_sub_epi16(_mm_set1_epi16(256), a);
+        __m128i res = _mm_add_epi16(_mm_mullo_epi16(dst, na), _mm_mullo_epi16(src, a));
+        res = _mm_packus_epi16(_mm_srli_epi16(res, 8), zero);
+        d1 = _mm_cvtsi128_si32(res);
+        d2 = _mm_cvtsi128_si32(_mm_srli_si128(res, 4));
+        memcpy(dst1, &d1, 4);
+        memcpy(dst2, &d2, 4);
+#else
+        blend(dst1, color, alpha1);
+        blend(dst2, color, alpha2);
+#endif
+    }
+
+    //Liang-Barsky clipping against [xmin, xmax] x [ymin, ymax]
+    bool clipLine(double &x1, double &y1, double &x2, double &y2,
+                  double xmin, double ymin, double xmax, double ymax)
+    {
+        double t0 = 0, t1 = 1;
+        const double dx = x2 - x1, dy = y2 - y1;
+        const double p[4] = {-dx, dx, -dy, dy};
+        const double q[4] = {x1 - xmin, xmax - x1, y1 - ymin, ymax - y1};
+        for(int i = 0; i < 4; ++i)
+        {
+            if(p[i] == 0)
+            {
+                if(q[i] < 0)
+                    return false;
+                continue;
+            }
+            const double t = q[i] / p[i];
+            if(p[i] < 0)
+                t0 = std::max(t0, t);
+            else
+                t1 = std::min(t1, t);
+            if(t0 > t1)
+                return false;
+        }
+        x2 = x1 + t1 * dx;
+        y2 = y1 + t1 * dy;
+        x1 = x1 + t0 * dx;
+        y1 = y1 + t0 * dy;
+        return true;
+    }
+
+    void writeChunk(std::ofstream &fo, const char *type, const std::vector<uint8_t> &data)
+    {
+        const uint32_t length = data.size();
+        const uint8_t header[8] = {uint8_t(length >> 24), uint8_t(length >> 16),
+                                   uint8_t(length >> 8), uint8_t(length),
+                                   uint8_t(type[0]), uint8_t(type[1]),
+                                   uint8_t(type[2]), uint8_t(type[3])};
+        uLong crc = crc32(0, header + 4, 4);
+        if(!data.empty())
+            crc = crc32(crc, data.data(), data.size());
+        const uint8_t footer[4] = {uint8_t(crc >> 24), uint8_t(crc >> 16),
+                                   uint8_t(crc >> 8), uint8_t(crc)};
+        fo.write(reinterpret_cast<const char*>(header), 8);
+        fo.write(reinterpret_cast<const char*>(data.data()), data.size());
+        fo.write(reinterpret_cast<const char*>(footer), 4);
+    }
+}
+
+SoftRenderer::SoftRenderer(int width, int height):
+    m_width(width), m_height(height), m_pixels(width * height, 0)
+{
+    if(width <= 0 || height <= 0)
+        throw std::runtime_error("Invalid framebuffer size");
+}
+
+int SoftRenderer::width() const
+{
+    return m_width;
+}
+
+int SoftRenderer::height() const
+{
+    return m_height;
+}
+
+const std::vector<uint32_t> &SoftRenderer::pixels() const
+{
+    return m_pixels;
+}
+
+void SoftRenderer::setDrawColor(const SDL_Color &color)
+{
+    m_color = color;
+}
+
+void SoftRenderer::clear()
+{
+    Command c{};
+    c.type = CommandType::CLEAR;
+    c.color = m_color;
+    m_commands.push_back(c);
+}
+
+void SoftRenderer::drawLine(double x1, double y1, double x2, double y2)
+{
+    Command c{};
+    c.type = CommandType::LINE;
+    c.color = m_color;
+    c.x1 = x1;
+    c.y1 = y1;
+    c.x2 = x2;
+    c.y2 = y2;
+    m_commands.push_back(c);
+}
+
+void SoftRenderer::drawText(const GlyphAtlas &atlas, const std::string &text, int x, int y)
+{
+    for(char ch: text)
+    {
+        const GlyphAtlas::Glyph *g = atlas.glyph(ch);
+        if(!g)
+            continue;
+        Command c{};
+        c.type = CommandType::GLYPH;
+        c.color = m_color;
+        c.x1 = x;
+        c.y1 = y;
+        c.source = atlas.surface();
+        c.sourceRect = g->rect;
+        m_commands.push_back(c);
+        x += g->advance;
+    }
+}
+
+void SoftRenderer::drawImage(const uint32_t *pixels, int width, int height, int pitch, int x,
+                             int y, Uint8 alpha)
+{
+    Command c{};
+    c.type = CommandType::IMAGE;
+    c.color = {255, 255, 255, alpha};
+    c.x1 = x;
+    c.y1 = y;
+    c.sourceRect = {0, 0, width, height};
+    c.image = pixels;
+    c.imagePitch = pitch;
+    m_commands.push_back(c);
+}
+
+void SoftRenderer::render(int threads)
+{
+    if(threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    const int tiles = (m_height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    threads = std::min(threads, tiles);
+    std::atomic<int> nextTile{0};
+    auto worker = [&]()
+    {
+        for(int tile = nextTile++; tile < tiles; tile = nextTile++)
+            rasterizeTile(tile * TILE_HEIGHT, std::min(m_height, (tile + 1) * TILE_HEIGHT));
+    };
+    std::vector<std::thread> pool;
+    for(int i = 1; i < threads; ++i)
+        pool.emplace_back(worker);
+    worker();
+    for(auto &t: pool)
+        t.join();
+    m_commands.clear();
+}
+
+void SoftRenderer::rasterizeTile(int rowBegin, int rowEnd)
+{
+    for(const auto &c: m_commands)
+    {
+        switch(c.type)
+        {
+            case CommandType::CLEAR:
+            {
+                uint32_t value;
+                const uint8_t rgba[4] = {c.color.r, c.color.g, c.color.b, c.color.a};
+                memcpy(&value, rgba, 4);
+                std::fill(m_pixels.begin() + rowBegin * m_width,
+                          m_pixels.begin() + rowEnd * m_width, value);
+                break;
+            }
+            case CommandType::LINE:
+                rasterizeLine(c, rowBegin, rowEnd);
+                break;
+            case CommandType::GLYPH:
+                rasterizeGlyph(c, rowBegin, rowEnd);
+                break;
+            case CommandType::IMAGE:
+                rasterizeImage(c, rowBegin, rowEnd);
+                break;
+        }
+    }
+}
+
+void SoftRenderer::rasterizeLine(const Command &c, int rowBegin, int rowEnd)
+{
+    double x1 = c.x1, y1 = c.y1, x2 = c.x2, y2 = c.y2;
+    if(!std::isfinite(x1) || !std::isfinite(y1) || !std::isfinite(x2) || !std::isfinite(y2))
+        return;
+    //Clipping to the tile plus a margin keeps the loops short for curves
+    //running far off screen; the margin hides the artificial endpoints
+    if(!clipLine(x1, y1, x2, y2, -2, rowBegin - 2, m_width + 1, rowEnd + 1))
+        return;
+    //Xiaolin Wu's algorithm
+    const bool steep = fabs(y2 - y1) > fabs(x2 - x1);
+    if(steep)
+    {
+        std::swap(x1, y1);
+        std::swap(x2, y2);
+    }
+    if(x1 > x2)
+    {
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+    }
+    const double dx = x2 - x1;
+    const double gradient = dx == 0 ? 1 : (y2 - y1) / dx;
+
+    const int xpxl1 = floor(x1 + 0.5);
+    double yend = y1 + gradient * (xpxl1 - x1);
+    double xgap = rfpart(x1 + 0.5);
+    plotPair(xpxl1, floor(yend), steep, c.color, rfpart(yend) * xgap, fpart(yend) * xgap,
+             rowBegin, rowEnd);
+    double intery = yend + gradient;
+
+    const int xpxl2 = floor(x2 + 0.5);
+    yend = y2 + gradient * (xpxl2 - x2);
+    xgap = fpart(x2 + 0.5);
+    if(xpxl2 != xpxl1)
+        plotPair(xpxl2, floor(yend), steep, c.color, rfpart(yend) * xgap, fpart(yend) * xgap,
+                 rowBegin, rowEnd);
+
+    for(int x = xpxl1 + 1; x < xpxl2; ++x)
+    {
+        plotPair(x, floor(intery), steep, c.color, rfpart(intery), fpart(intery),
+                 rowBegin, rowEnd);
+        intery += gradient;
+    }
+}
+
+void SoftRenderer::rasterizeGlyph(const Command &c, int rowBegin, int rowEnd)
+{
+    const int x = c.x1, y = c.y1;
+    const SDL_Rect &src = c.sourceRect;
+    const int fromRow = std::max(y, rowBegin), toRow = std::min(y + src.h, rowEnd);
+    const int fromCol = std::max(x, 0), toCol = std::min(x + src.w, m_width);
+    const uint8_t *source = static_cast<const uint8_t*>(c.source->pixels);
+    uint8_t *target = reinterpret_cast<uint8_t*>(m_pixels.data());
+    for(int row = fromRow; row < toRow; ++row)
+    {
+        const uint8_t *s = source + (src.y + row - y) * c.source->pitch +
+                (src.x + fromCol - x) * 4;
+        uint8_t *d = target + (row * m_width + fromCol) * 4;
+        for(int col = fromCol; col < toCol; ++col, s += 4, d += 4)
+        {
+            //The atlas is white, its alpha channel holds the coverage
+            if(s[3])
+                blend(d, c.color, blendFactor(c.color, s[3] / 255.0));
+        }
+    }
+}
+
+void SoftRenderer::rasterizeImage(const Command &c, int rowBegin, int rowEnd)
+{
+    const int x = c.x1, y = c.y1;
+    const SDL_Rect &src = c.sourceRect;
+    const int fromRow = std::max(y, rowBegin), toRow = std::min(y + src.h, rowEnd);
+    const int fromCol = std::max(x, 0), toCol = std::min(x + src.w, m_width);
+    uint8_t *target = reinterpret_cast<uint8_t*>(m_pixels.data());
+    for(int row = fromRow; row < toRow; ++row)
+    {
+        const uint32_t *s = c.image + size_t(row - y) * c.imagePitch + (fromCol - x);
+        uint8_t *d = target + (row * m_width + fromCol) * 4;
+        for(int col = fromCol; col < toCol; ++col, ++s, d += 4)
+        {
+            //Red in the high byte, alpha in the low one; the pixel's alpha
+            //is scaled by the opacity like a texture's by its alpha mod
+            const uint32_t p = *s;
+            if(!(p & 255))
+                continue;
+            const SDL_Color color {Uint8(p >> 24), Uint8(p >> 16), Uint8(p >> 8), 255};
+            blend(d, color, blendFactor(color, (p & 255) * c.color.a / (255.0 * 255.0)));
+        }
+    }
+}
+
+void SoftRenderer::plot(int x, int y, const SDL_Color &color, double coverage,
+                        int rowBegin, int rowEnd)
+{
+    if(x < 0 || x >= m_width || y < rowBegin || y >= rowEnd)
+        return;
+    blend(reinterpret_cast<uint8_t*>(&m_pixels[y * m_width + x]), color,
+          blendFactor(color, coverage));
+}
+
+void SoftRenderer::plotPair(int x, int y, bool steep, const SDL_Color &color,
+                            double coverage1, double coverage2, int rowBegin, int rowEnd)
+{
+    //In steep mode the coordinates are swapped and the pair lies in one row
+    const int px1 = steep ? y : x, py1 = steep ? x : y;
+    const int px2 = steep ? y + 1 : x, py2 = steep ? x : y + 1;
+    if(px1 >= 0 && px2 < m_width && py1 >= rowBegin && py2 < rowEnd)
+    {
+        blendPair(reinterpret_cast<uint8_t*>(&m_pixels[py1 * m_width + px1]),
+                  reinterpret_cast<uint8_t*>(&m_pixels[py2 * m_width + px2]),
+                  color, blendFactor(color, coverage1), blendFactor(color, coverage2));
+        return;
+    }
+    plot(px1, py1, color, coverage1, rowBegin, rowEnd);
+    plot(px2, py2, color, coverage2, rowBegin, rowEnd);
+}
+
+void SoftRenderer::savePPM(const std::string &pathToFile) const
+{
+    std::ofstream fo(pathToFile, std::ios::binary);
+    if(!fo.is_open())
+        throw std::runtime_error("Could not write image " + pathToFile);
+    fo << "P6\n" << m_width << " " << m_height << "\n255\n";
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(m_pixels.data());
+    std::vector<uint8_t> row(m_width * 3);
+    for(int y = 0; y < m_height; ++y)
+    {
+        for(int x = 0; x < m_width; ++x, p += 4)
+        {
+            row[x * 3] = p[0];
+            row[x * 3 + 1] = p[1];
+            row[x * 3 + 2] = p[2];
+        }
+        fo.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+}
+
+void SoftRenderer::savePNG(const std::string &pathToFile) const
+{
+    std::ofstream fo(pathToFile, std::ios::binary);
+    if(!fo.is_open())
+        throw std::runtime_error("Could not write image " + pathToFile);
+    static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    fo.write(reinterpret_cast<const char*>(signature), 8);
+    //8 bit RGBA, no interlacing
+    std::vector<uint8_t> header = {uint8_t(m_width >> 24), uint8_t(m_width >> 16),
+                                   uint8_t(m_width >> 8), uint8_t(m_width),
+                                   uint8_t(m_height >> 24), uint8_t(m_height >> 16),
+                                   uint8_t(m_height >> 8), uint8_t(m_height),
+                                   8, 6, 0, 0, 0};
+    writeChunk(fo, "IHDR", header);
+    //Every scanline is prefixed with filter type 0
+    const int stride = m_width * 4;
+    std::vector<uint8_t> raw((stride + 1) * m_height);
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(m_pixels.data());
+    for(int y = 0; y < m_height; ++y)
+    {
+        raw[y * (stride + 1)] = 0;
+        memcpy(&raw[y * (stride + 1) + 1], p + y * stride, stride);
+    }
+    uLongf size = compressBound(raw.size());
+    std::vector<uint8_t> compressed(size);
+    if(compress2(compressed.data(), &size, raw.data(), raw.size(), Z_BEST_SPEED) != Z_OK)
+        throw std::runtime_error("Could not compress image " + pathToFile);
+    compressed.resize(size);
+    writeChunk(fo, "IDAT", compressed);
+    writeChunk(fo, "IEND", {});
+}
+
+void SoftRenderer::save(const std::string &pathToFile) const
+{
+    std::string ext = pathToFile.substr(pathToFile.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if(ext == "ppm")
+        savePPM(pathToFile);
+    else if(ext == "png")
+        savePNG(pathToFile);
+    else
+        throw std::runtime_error("Unsupported image format: " + pathToFile);
+}
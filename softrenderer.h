@@ -0,0 +1,68 @@
+#ifndef SOFTRENDERER_H
+#define SOFTRENDERER_H
+
+#include <SDL2/SDL.h>
+#include "glyphatlas.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+//Headless renderer drawing into an in-memory RGBA framebuffer.
+//Drawing calls only record a display list; render() rasterizes it in
+//horizontal tiles on several threads. Every tile replays the whole list
+//clipped to its rows, so the result does not depend on the thread count.
+class SoftRenderer
+{
+public:
+    explicit SoftRenderer(int width, int height);
+    int width() const;
+    int height() const;
+    const std::vector<uint32_t> &pixels() const;
+    void setDrawColor(const SDL_Color &color);
+    void clear();
+    void drawLine(double x1, double y1, double x2, double y2);
+    void drawText(const GlyphAtlas &atlas, const std::string &text, int x, int y);
+    //Blends a width x height block of SDL_PIXELFORMAT_RGBA8888 pixels, rows
+    //pitch pixels apart, at x, y with alpha as its opacity, as
+    //SDL_BLENDMODE_BLEND would. The pixels must stay valid until render().
+    void drawImage(const uint32_t *pixels, int width, int height, int pitch, int x, int y,
+                   Uint8 alpha);
+    void render(int threads = 0);
+    void savePPM(const std::string &pathToFile) const;
+    void savePNG(const std::string &pathToFile) const;
+    void save(const std::string &pathToFile) const;
+private:
+    enum
+    {
+        TILE_HEIGHT = 32
+    };
+    enum class CommandType {CLEAR, LINE, GLYPH, IMAGE};
+    struct Command
+    {
+        CommandType type;
+        SDL_Color color;
+        double x1, y1, x2, y2;
+        const SDL_Surface *source;
+        SDL_Rect sourceRect;
+        //IMAGE pixels, sourceRect.w x sourceRect.h with rows imagePitch apart
+        const uint32_t *image;
+        int imagePitch;
+    };
+    int m_width, m_height;
+    //Pixels are stored as R, G, B, A bytes in memory order
+    std::vector<uint32_t> m_pixels;
+    std::vector<Command> m_commands;
+    SDL_Color m_color{0, 0, 0, 255};
+
+    void rasterizeTile(int rowBegin, int rowEnd);
+    void rasterizeLine(const Command &c, int rowBegin, int rowEnd);
+    void rasterizeGlyph(const Command &c, int rowBegin, int rowEnd);
+    void rasterizeImage(const Command &c, int rowBegin, int rowEnd);
+    void plot(int x, int y, const SDL_Color &color, double coverage, int rowBegin,
+              int rowEnd);
+    void plotPair(int x, int y, bool steep, const SDL_Color &color, double coverage1,
+                  double coverage2, int rowBegin, int rowEnd);
+};
+
+#endif // SOFTRENDERER_H
@@ -0,0 +1,32 @@
+#ifndef STOPWATCH_H
+#define STOPWATCH_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+//Named durations in milliseconds, in the order the stages ran
+using StageTimings = std::vector<std::pair<std::string, double>>;
+
+class Stopwatch
+{
+public:
+    Stopwatch(): m_start(std::chrono::steady_clock::now()) {}
+    //Milliseconds since construction or the last lap()
+    double elapsed() const
+    {
+        return std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - m_start).count();
+    }
+    double lap()
+    {
+        auto now = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - m_start).count();
+        m_start = now;
+        return ms;
+    }
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // STOPWATCH_H
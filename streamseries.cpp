@@ -0,0 +1,218 @@
+#include "streamseries.h"
+#include "dataseries.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+StreamSeries::StreamSeries(const std::string &pathToSource, std::function<void()> onData):
+    m_pathToSource(pathToSource),
+    m_onData(onData),
+    m_queue(QUEUE_CAPACITY),
+    m_history(HISTORY_CAPACITY),
+    m_buckets(HISTORY_CAPACITY / BUCKET_SIZE)
+{
+    //A FIFO is opened non blocking so a missing writer does not hang here
+    int fd = pathToSource == "-" ? STDIN_FILENO : open(pathToSource.c_str(), O_RDONLY | O_NONBLOCK);
+    if(fd < 0)
+        throw std::runtime_error("Could not open stream " + pathToSource);
+    if(fd != STDIN_FILENO)
+        close(fd);
+    m_reader = std::thread(&StreamSeries::readLoop, this);
+}
+
+StreamSeries::~StreamSeries()
+{
+    m_stop = true;
+    if(m_reader.joinable())
+        m_reader.join();
+}
+
+size_t StreamSeries::drain()
+{
+    m_notified = false;
+    std::pair<double, double> point;
+    size_t count = 0;
+    while(m_queue.pop(point))
+    {
+        const unsigned long long i = m_total++;
+        m_history[i % HISTORY_CAPACITY] = point;
+        //The summary of the newest bucket is updated in place, older
+        //buckets are overwritten together with their samples
+        Summary &s = m_buckets[(i / BUCKET_SIZE) % m_buckets.size()];
+        if(i % BUCKET_SIZE == 0)
+            s = {point.first, point.first, point.second, point.second};
+        s.Xmax = point.first;
+        s.Ymin = std::min(s.Ymin, point.second);
+        s.Ymax = std::max(s.Ymax, point.second);
+        ++count;
+    }
+    return count;
+}
+
+bool StreamSeries::empty() const
+{
+    return m_total == 0;
+}
+
+double StreamSeries::lastX() const
+{
+    return m_total > 0 ? at(m_total - 1).first : 0;
+}
+
+void StreamSeries::sample(double Xmin, double Xmax, int pixels,
+                          std::vector<std::pair<double, double>> &out) const
+{
+    out.clear();
+    if(m_total == 0 || pixels <= 0)
+        return;
+    unsigned long long lo = oldest(), hi = m_total;
+    while(lo < hi)
+    {
+        unsigned long long mid = lo + (hi - lo) / 2;
+        if(at(mid).first < Xmin) lo = mid + 1; else hi = mid;
+    }
+    const unsigned long long begin = lo > oldest() ? lo - 1 : oldest();
+    lo = begin;
+    hi = m_total;
+    while(lo < hi)
+    {
+        unsigned long long mid = lo + (hi - lo) / 2;
+        if(at(mid).first <= Xmax) lo = mid + 1; else hi = mid;
+    }
+    const unsigned long long end = std::min(m_total, lo + 1);
+    const unsigned long long visible = end - begin;
+    if(visible <= (unsigned long long)(2 * pixels))
+    {
+        for(unsigned long long i = begin; i < end; ++i)
+            out.push_back(at(i));
+        return;
+    }
+    if(visible < (unsigned long long)BUCKET_SIZE * pixels)
+    {
+        DataSeries::reducePerPixel(begin, end, Xmin, Xmax, pixels,
+                                   [this](unsigned long long i) { return at(i); }, out);
+        return;
+    }
+    //Enough buckets are merged per output pair to give about one per pixel
+    const unsigned long long group = std::max(1ULL, visible / pixels / BUCKET_SIZE);
+    unsigned long long b = begin / BUCKET_SIZE;
+    //The oldest bucket may already be partly overwritten
+    if(b * BUCKET_SIZE < oldest())
+    {
+        for(unsigned long long i = begin; i < std::min(end, (b + 1) * BUCKET_SIZE); ++i)
+            out.push_back(at(i));
+        ++b;
+    }
+    const unsigned long long last = (end - 1) / BUCKET_SIZE + 1;
+    for(; b < last; b += group)
+    {
+        Summary s = m_buckets[b % m_buckets.size()];
+        for(unsigned long long j = b + 1; j < std::min(last, b + group); ++j)
+        {
+            const Summary &next = m_buckets[j % m_buckets.size()];
+            s.Xmax = next.Xmax;
+            s.Ymin = std::min(s.Ymin, next.Ymin);
+            s.Ymax = std::max(s.Ymax, next.Ymax);
+        }
+        const double center = (s.Xmin + s.Xmax) / 2;
+        out.emplace_back(center, s.Ymin);
+        out.emplace_back(center, s.Ymax);
+    }
+}
+
+void StreamSeries::readLoop()
+{
+    const bool isStdin = m_pathToSource == "-";
+    int fd = isStdin ? STDIN_FILENO : open(m_pathToSource.c_str(), O_RDONLY | O_NONBLOCK);
+    if(fd < 0)
+        return;
+    std::vector<char> buffer(READ_BUFFER);
+    std::string pending;
+    unsigned long long counter = 0;
+    while(!m_stop)
+    {
+        //poll keeps the thread responsive to m_stop while a pipe is idle;
+        //a regular file at EOF reads zero bytes and is retried later, as tail -f
+        pollfd pfd {fd, POLLIN, 0};
+        if(poll(&pfd, 1, POLL_INTERVAL) <= 0)
+            continue;
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if(n < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if(n <= 0)
+        {
+            //stdin is done once closed, a file or FIFO may still grow
+            if(n < 0 || isStdin)
+                break;
+            usleep(POLL_INTERVAL * 1000);
+            continue;
+        }
+        const char *p = buffer.data();
+        const char *end = p + n;
+        while(p < end)
+        {
+            const char *newline = static_cast<const char*>(memchr(p, '\n', end - p));
+            if(!newline)
+            {
+                pending.append(p, end);
+                break;
+            }
+            //Copied so strtod sees a terminated line and never skips into the next one
+            pending.append(p, newline);
+            parseLine(pending.c_str(), counter);
+            pending.clear();
+            p = newline + 1;
+        }
+    }
+    if(!isStdin)
+        close(fd);
+}
+
+void StreamSeries::parseLine(const char *line, unsigned long long &counter)
+{
+    char *next;
+    const double first = strtod(line, &next);
+    if(next == line)
+        return;
+    while(*next == ' ' || *next == '\t' || *next == ',' || *next == ';')
+        ++next;
+    const char *rest = next;
+    const double second = strtod(rest, &next);
+    if(next == rest)
+        enqueue(double(counter), first);
+    else
+        enqueue(first, second);
+    ++counter;
+}
+
+void StreamSeries::enqueue(double x, double y)
+{
+    //A full queue means the GUI is behind; waiting here lets the pipe apply
+    //back pressure to the writer instead of growing memory
+    while(!m_queue.push({x, y}))
+    {
+        if(m_stop)
+            return;
+        if(m_onData && !m_notified.exchange(true))
+            m_onData();
+        usleep(1000);
+    }
+    if(m_onData && !m_notified.exchange(true))
+        m_onData();
+}
+
+unsigned long long StreamSeries::oldest() const
+{
+    return m_total > HISTORY_CAPACITY ? m_total - HISTORY_CAPACITY : 0;
+}
+
+const std::pair<double, double> &StreamSeries::at(unsigned long long i) const
+{
+    return m_history[i % HISTORY_CAPACITY];
+}
@@ -0,0 +1,65 @@
+#ifndef STREAMSERIES_H
+#define STREAMSERIES_H
+
+#include "spscring.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Samples followed live from an append-only file, a FIFO or stdin ("-"),
+//like tail -f. A reader thread parses "x y" or "x,y" lines (a single number
+//is taken as y with the sample count as x) into a lock-free queue; the GUI
+//thread drains it into a bounded history, so memory stays fixed and the GUI
+//never blocks on I/O. X is expected to grow, as time does.
+class StreamSeries
+{
+public:
+    //onData is called from the reader thread when new samples are queued
+    //after the previous drain()
+    explicit StreamSeries(const std::string &pathToSource, std::function<void()> onData);
+    ~StreamSeries();
+    StreamSeries(const StreamSeries&) = delete;
+    StreamSeries &operator=(const StreamSeries&) = delete;
+    //Moves the queued samples into the history; returns how many arrived
+    size_t drain();
+    bool empty() const;
+    double lastX() const;
+    //Same reduction as DataSeries::sample over the retained history
+    void sample(double Xmin, double Xmax, int pixels,
+                std::vector<std::pair<double, double>> &out) const;
+private:
+    enum
+    {
+        HISTORY_CAPACITY = 1 << 20,
+        QUEUE_CAPACITY = 1 << 18,
+        BUCKET_SIZE = 64,
+        READ_BUFFER = 1 << 16,
+        POLL_INTERVAL = 10
+    };
+    struct Summary
+    {
+        double Xmin, Xmax, Ymin, Ymax;
+    };
+    std::string m_pathToSource;
+    std::function<void()> m_onData;
+    SpscRing<std::pair<double, double>> m_queue;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_notified{false};
+    std::thread m_reader;
+    //History ring indexed by the absolute sample number modulo the capacity;
+    //bucket b summarizes the samples [b * BUCKET_SIZE, (b + 1) * BUCKET_SIZE)
+    std::vector<std::pair<double, double>> m_history;
+    std::vector<Summary> m_buckets;
+    unsigned long long m_total{0};
+
+    void readLoop();
+    void parseLine(const char *line, unsigned long long &counter);
+    void enqueue(double x, double y);
+    unsigned long long oldest() const;
+    const std::pair<double, double> &at(unsigned long long i) const;
+};
+
+#endif // STREAMSERIES_H